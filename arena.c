@@ -0,0 +1,203 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_FIRST_BLOCK (64 * 1024)          // Size of the first block
+#define ARENA_MAX_BLOCK (16 * 1024 * 1024)     // Blocks stop doubling at this size
+#define ARENA_FIRST_TABLE 64                   // Initial slots in the intern table, a power of two
+
+static ArenaBlock *arena_block_create(size_t capacity);
+static int arena_intern_grow(Arena *arena);
+static unsigned int arena_hash(const char *name);
+
+/**
+ * Initializes an empty `Arena`.
+ *
+ * No memory is allocated until the first allocation.
+ *
+ * @param[out] arena  Pointer to the `Arena` to initialize.
+ */
+void arena_init(Arena *arena) {
+    arena->blocks = NULL;
+    arena->next_block_size = ARENA_FIRST_BLOCK;
+    arena->interned = NULL;
+    arena->interned_count = 0;
+    arena->interned_capacity = 0;
+}
+
+/**
+ * Frees everything allocated from the `Arena` at once.
+ *
+ * Costs one `free` per block (a handful even for millions of objects), not one per object.
+ *
+ * @param[in,out] arena  Pointer to the `Arena` to free.
+ */
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena->interned);
+    arena_init(arena);
+}
+
+/**
+ * Allocates memory from the `Arena` by bumping a pointer.
+ *
+ * A new block is only allocated when the current one is full, and blocks double in size
+ * so the number of blocks stays logarithmic in the total size.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @param[in]     size   Number of bytes to allocate.
+ * @param[in]     align  Required alignment, a power of two.
+ * @return               Pointer to the memory, or NULL if it could not be allocated.
+ */
+void *arena_alloc(Arena *arena, size_t size, size_t align) {
+    ArenaBlock *block = arena->blocks;
+    uintptr_t start;
+
+    if (block != NULL) {
+        start = ((uintptr_t)(block->data + block->used) + align - 1) & ~(uintptr_t)(align - 1);
+        if (start + size <= (uintptr_t)(block->data + block->capacity)) {
+            block->used = start + size - (uintptr_t)block->data;
+            return (void*)start;
+        }
+    }
+
+    // The current block is full, start a new one big enough for this request
+    size_t capacity = arena->next_block_size;
+    while (capacity < size + align) {
+        capacity *= 2;
+    }
+    if (arena->next_block_size < ARENA_MAX_BLOCK) {
+        arena->next_block_size *= 2;
+    }
+
+    block = arena_block_create(capacity);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+
+    start = ((uintptr_t)block->data + align - 1) & ~(uintptr_t)(align - 1);
+    block->used = start + size - (uintptr_t)block->data;
+    return (void*)start;
+}
+
+/**
+ * Gives the memory the arena holds, including the unused end of each block.
+ *
+ * @param[in] arena  Pointer to the `Arena`.
+ * @return           Total block capacity in bytes.
+ */
+size_t arena_bytes(const Arena *arena) {
+    size_t total = 0;
+
+    for (const ArenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+        total += block->capacity;
+    }
+    return total;
+}
+
+/**
+ * Returns the arena's single copy of a name, copying it in the first time it is seen.
+ *
+ * Identical names (every "Fuel", every generated system prefix) share one string.
+ * Interned strings must never be modified.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @param[in]     name   Name to intern.
+ * @return               The interned copy, or NULL if it could not be allocated.
+ */
+char *arena_intern(Arena *arena, const char *name) {
+    unsigned int mask, slot;
+    char *copy;
+
+    // Keep the table at most half full so probes stay short
+    if ((arena->interned_count + 1) * 2 > arena->interned_capacity && !arena_intern_grow(arena)) {
+        return NULL;
+    }
+
+    mask = arena->interned_capacity - 1;
+    for (slot = arena_hash(name) & mask; arena->interned[slot] != NULL; slot = (slot + 1) & mask) {
+        if (strcmp(arena->interned[slot], name) == 0) {
+            return arena->interned[slot];
+        }
+    }
+
+    copy = arena_alloc(arena, strlen(name) + 1, 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    strcpy(copy, name);
+
+    arena->interned[slot] = copy;
+    arena->interned_count++;
+    return copy;
+}
+
+/**
+ * Allocates a block with room for `capacity` bytes of data.
+ *
+ * @param[in] capacity  Usable size of the block.
+ * @return              The block, or NULL if it could not be allocated.
+ */
+static ArenaBlock *arena_block_create(size_t capacity) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + capacity);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+/**
+ * Doubles the intern table and rehashes every name into it.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @return               Non-zero on success.
+ */
+static int arena_intern_grow(Arena *arena) {
+    unsigned int capacity = arena->interned_capacity ? arena->interned_capacity * 2 : ARENA_FIRST_TABLE;
+    char **table = calloc(capacity, sizeof(char*));
+
+    if (table == NULL) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < arena->interned_capacity; i++) {
+        if (arena->interned[i] != NULL) {
+            unsigned int slot = arena_hash(arena->interned[i]) & (capacity - 1);
+            while (table[slot] != NULL) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            table[slot] = arena->interned[i];
+        }
+    }
+
+    free(arena->interned);
+    arena->interned = table;
+    arena->interned_capacity = capacity;
+    return 1;
+}
+
+/**
+ * Hashes a name with 32-bit FNV-1a.
+ *
+ * @param[in] name  Name to hash.
+ * @return          The hash.
+ */
+static unsigned int arena_hash(const char *name) {
+    unsigned int hash = 2166136261u;
+    while (*name != '\0') {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
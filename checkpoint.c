@@ -0,0 +1,466 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// On-disk layout: header, resource records, system records, event records, then the name strings.
+// Every pointer is stored as an index into its array (or an offset into the names), -1 for NULL.
+
+#define CHECKPOINT_MAGIC "RKTCKPT"
+#define CHECKPOINT_VERSION 2
+
+typedef struct CheckpointHeader {
+    char magic[8];
+    int version;
+    int simulation_running;
+    int resource_count;
+    int system_count;
+    int event_count;
+    int names_size;
+} CheckpointHeader;
+
+typedef struct CheckpointResource {
+    int name;           // Offset into the names
+    int amount;
+    int max_capacity;
+} CheckpointResource;
+
+typedef struct CheckpointSystem {
+    int name;           // Offset into the names
+    int consumed;       // Resource index
+    int consumed_amount;
+    int produced;       // Resource index
+    int produced_amount;
+    int amount_stored;
+    int processing_time;
+    int status;
+    int phase;          // SYSTEM_PHASE_* the system resumes from
+    int remaining_us;   // Time left in the wait the system was in
+} CheckpointSystem;
+
+typedef struct CheckpointEvent {
+    int system;         // System index
+    int resource;       // Resource index
+    int status;
+    int priority;
+    int amount;
+} CheckpointEvent;
+
+// Maps an object's address back to its array index, sorted by address for binary search
+typedef struct CheckpointIndex {
+    const void *address;
+    int index;
+} CheckpointIndex;
+
+static CheckpointIndex *checkpoint_index_build(void **objects, int count);
+static int checkpoint_index_find(const CheckpointIndex *table, int count, const void *address);
+static int checkpoint_index_compare(const void *a, const void *b);
+static void checkpoint_event_store(CheckpointEvent *record, const Event *event,
+                                   const CheckpointIndex *resource_index, int resource_count,
+                                   const CheckpointIndex *system_index, int system_count);
+static int checkpoint_records_valid(const CheckpointHeader *header, const CheckpointResource *resources,
+                                    const CheckpointSystem *systems, const CheckpointEvent *events);
+
+/**
+ * Writes a binary checkpoint of the `Manager`, from the thread running the manager.
+ *
+ * The whole image is built in memory first and written with a single `write`, then
+ * renamed over `path` so a crash mid-save never leaves a truncated checkpoint behind.
+ * The image is copied behind a snapshot barrier: systems on their own threads are held at the
+ * start of their next step only for the copy, not for the write. Each system's phase and the time
+ * left in its current wait are saved, so a restored system picks up mid-processing or mid-backoff.
+ * Events still in the systems' channels are saved after the manager's queue.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to save.
+ * @param[in]     path     Path of the checkpoint file.
+ * @return                 0 on success, -1 on failure.
+ */
+int manager_checkpoint_save(Manager *manager, const char *path) {
+    CheckpointHeader header;
+    CheckpointResource *resources;
+    CheckpointSystem *systems;
+    CheckpointEvent *events;
+    CheckpointIndex *resource_index, *system_index;
+    EventNode *node;
+    Event *queued;
+    char *image, *names, tmp_path[256];
+    size_t image_size;
+    long long now_ns, remaining_ns;
+    unsigned int head, tail, k;
+    int i, c, fd, written;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        return -1;
+    }
+
+    // A system stuck on a full queue holds the barrier up, the next checkpoint tries again
+    if (snapshot_barrier_raise(&manager->snapshot_seq, CHECKPOINT_BARRIER_MS * 1000LL) != 0) {
+        return -1;
+    }
+    now_ns = latency_now_ns();
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.simulation_running = manager->simulation_running;
+    header.resource_count = manager->resource_array.size;
+    header.system_count = manager->system_array.size;
+
+    for (node = manager->event_queue.head; node != NULL; node = node->next) {
+        header.event_count++;
+    }
+    for (c = 0; c < manager->channel_count; c++) {
+        header.event_count += __atomic_load_n(&manager->channels[c].tail, __ATOMIC_ACQUIRE) - manager->channels[c].head;
+    }
+    for (i = 0; i < manager->resource_array.size; i++) {
+        header.names_size += strlen(manager->resource_array.resources[i]->name) + 1;
+    }
+    for (i = 0; i < manager->system_array.size; i++) {
+        header.names_size += strlen(manager->system_array.systems[i]->name) + 1;
+    }
+
+    image_size = sizeof(header)
+               + sizeof(CheckpointResource) * header.resource_count
+               + sizeof(CheckpointSystem) * header.system_count
+               + sizeof(CheckpointEvent) * header.event_count
+               + header.names_size;
+
+    image = malloc(image_size);
+    resource_index = checkpoint_index_build((void**)manager->resource_array.resources, header.resource_count);
+    system_index = checkpoint_index_build((void**)manager->system_array.systems, header.system_count);
+    if (image == NULL || resource_index == NULL || system_index == NULL) {
+        snapshot_barrier_lower(&manager->snapshot_seq);
+        free(image);
+        free(resource_index);
+        free(system_index);
+        return -1;
+    }
+
+    memcpy(image, &header, sizeof(header));
+    resources = (CheckpointResource*)(image + sizeof(header));
+    systems = (CheckpointSystem*)(resources + header.resource_count);
+    events = (CheckpointEvent*)(systems + header.system_count);
+    names = (char*)(events + header.event_count);
+
+    // Names are packed back to back, records refer to them by offset
+    written = 0;
+    for (i = 0; i < header.resource_count; i++) {
+        Resource *resource = manager->resource_array.resources[i];
+        resources[i].name = written;
+        resources[i].amount = __atomic_load_n(&resource->amount, __ATOMIC_RELAXED);
+        resources[i].max_capacity = resource->max_capacity;
+        strcpy(names + written, resource->name);
+        written += strlen(resource->name) + 1;
+    }
+
+    for (i = 0; i < header.system_count; i++) {
+        System *system = manager->system_array.systems[i];
+        systems[i].name = written;
+        systems[i].consumed = checkpoint_index_find(resource_index, header.resource_count, system->consumed.resource);
+        systems[i].consumed_amount = system->consumed.amount;
+        systems[i].produced = checkpoint_index_find(resource_index, header.resource_count, system->produced.resource);
+        systems[i].produced_amount = system->produced.amount;
+        systems[i].amount_stored = system->amount_stored;
+        systems[i].processing_time = system->processing_time;
+        systems[i].status = __atomic_load_n(&system->status, __ATOMIC_RELAXED);
+        systems[i].phase = system->phase;
+        // A system held at the barrier has a deadline in the past and nothing left to wait
+        remaining_ns = system->pacing.deadline_ns - now_ns;
+        systems[i].remaining_us = system->resume_us > 0 ? (int)system->resume_us : (remaining_ns > 0 ? (int)(remaining_ns / 1000) : 0);
+        strcpy(names + written, system->name);
+        written += strlen(system->name) + 1;
+    }
+
+    // The queue is already in priority order, so it is saved as is; restoring re-sorts the channels' events
+    i = 0;
+    for (node = manager->event_queue.head; node != NULL; node = node->next) {
+        checkpoint_event_store(&events[i++], &node->event, resource_index, header.resource_count, system_index, header.system_count);
+    }
+    for (c = 0; c < manager->channel_count; c++) {
+        // Only the manager pops, and the barrier keeps the systems from pushing
+        head = manager->channels[c].head;
+        tail = __atomic_load_n(&manager->channels[c].tail, __ATOMIC_ACQUIRE);
+        for (k = head; k != tail; k++) {
+            queued = &manager->channels[c].slots[k & manager->channels[c].mask];
+            checkpoint_event_store(&events[i++], queued, resource_index, header.resource_count, system_index, header.system_count);
+        }
+    }
+    snapshot_barrier_lower(&manager->snapshot_seq);
+    free(resource_index);
+    free(system_index);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(image);
+        return -1;
+    }
+
+    if (write(fd, image, image_size) != (ssize_t)image_size || close(fd) != 0) {
+        unlink(tmp_path);
+        free(image);
+        return -1;
+    }
+    free(image);
+
+    return rename(tmp_path, path) == 0 ? 0 : -1;
+}
+
+/**
+ * Saves the manager's checkpoint if one is due, from the thread running the manager.
+ *
+ * Used by the threaded and scheduled runs, which save every `CHECKPOINT_INTERVAL_MS`.
+ * A failed save is reported and retried at the next interval.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`, `checkpoint_path` NULL for no checkpoints.
+ */
+void manager_checkpoint_poll(Manager *manager) {
+    long long now_ns;
+
+    if (manager->checkpoint_path == NULL) {
+        return;
+    }
+
+    now_ns = latency_now_ns();
+    if (now_ns < manager->checkpoint_next_ns) {
+        return;
+    }
+    manager->checkpoint_next_ns = now_ns + CHECKPOINT_INTERVAL_MS * 1000000LL;
+
+    if (manager_checkpoint_save(manager, manager->checkpoint_path) != 0) {
+        fprintf(stderr, "Could not write checkpoint '%s'\n", manager->checkpoint_path);
+    }
+}
+
+/**
+ * Restores a `Manager` from a binary checkpoint.
+ *
+ * Maps the file with a single `mmap`, validates it, then recreates every resource, system
+ * and pending event, turning the stored indices back into pointers.
+ * The manager must be freshly initialized with `manager_init`.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to restore into.
+ * @param[in]     path     Path of the checkpoint file.
+ * @return                 0 on success, -1 on failure.
+ */
+int manager_checkpoint_restore(Manager *manager, const char *path) {
+    const CheckpointHeader *header;
+    const CheckpointResource *resources;
+    const CheckpointSystem *systems;
+    const CheckpointEvent *events;
+    const char *image, *names;
+    struct stat info;
+    size_t image_size;
+    int i, fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CheckpointHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    image_size = info.st_size;
+    image = mmap(NULL, image_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return -1;
+    }
+
+    // Reject anything that is not a complete checkpoint of this version
+    header = (const CheckpointHeader*)image;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+        header->version != CHECKPOINT_VERSION ||
+        header->resource_count < 0 || header->system_count < 0 ||
+        header->event_count < 0 || header->names_size < 0 ||
+        sizeof(*header)
+            + sizeof(CheckpointResource) * (size_t)header->resource_count
+            + sizeof(CheckpointSystem) * (size_t)header->system_count
+            + sizeof(CheckpointEvent) * (size_t)header->event_count
+            + (size_t)header->names_size != image_size) {
+        munmap((void*)image, image_size);
+        return -1;
+    }
+
+    resources = (const CheckpointResource*)(image + sizeof(*header));
+    systems = (const CheckpointSystem*)(resources + header->resource_count);
+    events = (const CheckpointEvent*)(systems + header->system_count);
+    names = (const char*)(events + header->event_count);
+
+    // A single bad record rejects the whole checkpoint, before anything is created
+    if ((header->names_size > 0 && names[header->names_size - 1] != '\0') ||
+        !checkpoint_records_valid(header, resources, systems, events)) {
+        munmap((void*)image, image_size);
+        return -1;
+    }
+
+    for (i = 0; i < header->resource_count; i++) {
+        Resource *resource;
+        resource_arena_create(&resource, &manager->arena, names + resources[i].name, resources[i].amount, resources[i].max_capacity);
+        resource_array_add(&manager->resource_array, resource);
+    }
+
+    for (i = 0; i < header->system_count; i++) {
+        System *system;
+        ResourceAmount consumed, produced;
+        Resource *consumed_resource = NULL, *produced_resource = NULL;
+
+        // Indices are checked against the arrays actually built, not just the header's counts
+        if (systems[i].consumed >= 0 && systems[i].consumed < manager->resource_array.size) {
+            consumed_resource = manager->resource_array.resources[systems[i].consumed];
+        }
+        if (systems[i].produced >= 0 && systems[i].produced < manager->resource_array.size) {
+            produced_resource = manager->resource_array.resources[systems[i].produced];
+        }
+
+        resource_amount_init(&consumed, consumed_resource, systems[i].consumed_amount);
+        resource_amount_init(&produced, produced_resource, systems[i].produced_amount);
+        system_arena_create(&system, &manager->arena, names + systems[i].name, consumed, produced, systems[i].processing_time, &manager->event_queue);
+        system->amount_stored = systems[i].amount_stored;
+        system->status = systems[i].status;
+        system->phase = systems[i].phase;
+        system->resume_us = systems[i].remaining_us;
+        system_array_add(&manager->system_array, system);
+    }
+
+    for (i = 0; i < header->event_count; i++) {
+        Event event;
+        System *system = NULL;
+        Resource *resource = NULL;
+
+        if (events[i].system >= 0 && events[i].system < manager->system_array.size) {
+            system = manager->system_array.systems[events[i].system];
+        }
+        if (events[i].resource >= 0 && events[i].resource < manager->resource_array.size) {
+            resource = manager->resource_array.resources[events[i].resource];
+        }
+
+        // Events reference both a system and a resource when they are reported
+        if (system == NULL || resource == NULL) {
+            continue;
+        }
+
+        event_init(&event, system, resource, events[i].status, events[i].priority, events[i].amount);
+        event_queue_push(&manager->event_queue, &event);
+    }
+
+    manager->simulation_running = header->simulation_running;
+    munmap((void*)image, image_size);
+    return 0;
+}
+
+/**
+ * Checks that every record of a mapped checkpoint refers to names, resources and systems it holds.
+ *
+ * References may be -1 for NULL; names must be set and start inside the names, and every system
+ * must be in a known phase with no negative wait left.
+ *
+ * @param[in] header     Pointer to the validated header.
+ * @param[in] resources  Resource records.
+ * @param[in] systems    System records.
+ * @param[in] events     Event records.
+ * @return               Non-zero if every record is valid, 0 otherwise.
+ */
+static int checkpoint_records_valid(const CheckpointHeader *header, const CheckpointResource *resources,
+                                    const CheckpointSystem *systems, const CheckpointEvent *events) {
+    int i;
+
+    for (i = 0; i < header->resource_count; i++) {
+        if (resources[i].name < 0 || resources[i].name >= header->names_size) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < header->system_count; i++) {
+        if (systems[i].name < 0 || systems[i].name >= header->names_size ||
+            systems[i].consumed < -1 || systems[i].consumed >= header->resource_count ||
+            systems[i].produced < -1 || systems[i].produced >= header->resource_count ||
+            systems[i].phase < SYSTEM_PHASE_START || systems[i].phase > SYSTEM_PHASE_STORE ||
+            systems[i].remaining_us < 0) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < header->event_count; i++) {
+        if (events[i].system < -1 || events[i].system >= header->system_count ||
+            events[i].resource < -1 || events[i].resource >= header->resource_count) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Fills an event record, turning the event's pointers into indices.
+ *
+ * @param[out] record          Pointer to the `CheckpointEvent` to fill.
+ * @param[in]  event           Pointer to the `Event` to save.
+ * @param[in]  resource_index  Lookup table of the resources.
+ * @param[in]  resource_count  Number of resources.
+ * @param[in]  system_index    Lookup table of the systems.
+ * @param[in]  system_count    Number of systems.
+ */
+static void checkpoint_event_store(CheckpointEvent *record, const Event *event,
+                                   const CheckpointIndex *resource_index, int resource_count,
+                                   const CheckpointIndex *system_index, int system_count) {
+    record->system = checkpoint_index_find(system_index, system_count, event->system);
+    record->resource = checkpoint_index_find(resource_index, resource_count, event->resource);
+    record->status = event->status;
+    record->priority = event->priority;
+    record->amount = event->amount;
+}
+
+/**
+ * Builds an address-sorted lookup table for an array of objects.
+ *
+ * @param[in] objects  Array of object pointers.
+ * @param[in] count    Number of objects.
+ * @return             The table (to be freed by the caller), or NULL if it could not be allocated.
+ */
+static CheckpointIndex *checkpoint_index_build(void **objects, int count) {
+    CheckpointIndex *table = malloc(sizeof(CheckpointIndex) * (count > 0 ? count : 1));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        table[i].address = objects[i];
+        table[i].index = i;
+    }
+    qsort(table, count, sizeof(CheckpointIndex), checkpoint_index_compare);
+    return table;
+}
+
+/**
+ * Finds the array index of an object in a lookup table.
+ *
+ * @param[in] table    Table built by `checkpoint_index_build`.
+ * @param[in] count    Number of entries in the table.
+ * @param[in] address  Address of the object to find, may be NULL.
+ * @return             The index, or -1 if not found.
+ */
+static int checkpoint_index_find(const CheckpointIndex *table, int count, const void *address) {
+    CheckpointIndex key, *found;
+
+    if (address == NULL) {
+        return -1;
+    }
+
+    key.address = address;
+    found = bsearch(&key, table, count, sizeof(CheckpointIndex), checkpoint_index_compare);
+    return found != NULL ? found->index : -1;
+}
+
+/**
+ * Orders lookup table entries by address for `qsort` and `bsearch`.
+ */
+static int checkpoint_index_compare(const void *a, const void *b) {
+    const char *left = ((const CheckpointIndex*)a)->address;
+    const char *right = ((const CheckpointIndex*)b)->address;
+    return (left > right) - (left < right);
+}
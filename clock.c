@@ -0,0 +1,248 @@
+#include "defs.h"
+#include <stdio.h>
+#include <errno.h>
+
+#define PACING_PRINT_SYSTEMS 16     // Above this many systems only the totals are printed
+
+/**
+ * Initializes a `SimClock`.
+ *
+ * @param[out] clock         Pointer to the `SimClock` to initialize.
+ * @param[in]  virtual_time  Non-zero to advance the clock instead of sleeping.
+ */
+void sim_clock_init(SimClock *clock, int virtual_time) {
+    clock->virtual_time = virtual_time;
+    clock->now_us = 0;
+}
+
+/**
+ * Sets the deadline of a wait on a `SimClock`, measured from the previous deadline rather than from now.
+ *
+ * In real time each wait ends at an absolute monotonic deadline, so wake-up overshoot and the work
+ * between waits do not add up over cycles and the long-run rate matches the configured one.
+ * A system that falls more than `PACING_RESYNC_US` behind is rebased to now instead of bursting
+ * to catch up. A virtual clock has no deadlines.
+ *
+ * @param[in]     clock        Pointer to the `SimClock`, may be NULL.
+ * @param[in,out] pacing       Pointer to the waiting system's `SystemPacing`.
+ * @param[in]     duration_us  Time to wait in microseconds.
+ */
+void sim_clock_pace(SimClock *clock, SystemPacing *pacing, long long duration_us) {
+    long long now_ns;
+
+    if (duration_us <= 0 || (clock != NULL && clock->virtual_time)) {
+        return;
+    }
+
+    now_ns = latency_now_ns();
+    if (pacing->deadline_ns == 0) {
+        pacing->anchor_ns = now_ns;
+        pacing->deadline_ns = now_ns;
+    } else if (now_ns - pacing->deadline_ns > PACING_RESYNC_US * 1000LL) {
+        pacing->resyncs++;
+        pacing->deadline_ns = now_ns;
+    }
+    pacing->deadline_ns += duration_us * 1000;
+}
+
+/**
+ * Waits on a `SimClock` until the deadline `sim_clock_pace` set for the same duration.
+ *
+ * In real time the wait is an absolute sleep (`clock_nanosleep` with `TIMER_ABSTIME`).
+ * With a `Shutdown` it is a timed wait on its condition variable against the same deadline,
+ * so a terminated system wakes at once instead of sleeping out its processing time or backoff.
+ * A virtual clock is simply advanced.
+ *
+ * @param[in,out] clock        Pointer to the `SimClock`, may be NULL.
+ * @param[in,out] shutdown     Pointer to the `Shutdown` that can cut the wait short, may be NULL.
+ * @param[in,out] pacing       Pointer to the waiting system's `SystemPacing`.
+ * @param[in]     duration_us  Time to wait in microseconds.
+ * @return                     Non-zero if the wait was cut short by the shutdown, 0 otherwise.
+ */
+int sim_clock_sleep_paced(SimClock *clock, Shutdown *shutdown, SystemPacing *pacing, long long duration_us) {
+    struct timespec deadline;
+    int interrupted = 0;
+
+    if (duration_us <= 0) {
+        return 0;
+    }
+
+    if (clock != NULL && clock->virtual_time) {
+        clock->now_us += duration_us;
+        return 0;
+    }
+
+    deadline.tv_sec = pacing->deadline_ns / 1000000000LL;
+    deadline.tv_nsec = pacing->deadline_ns % 1000000000LL;
+    if (shutdown == NULL) {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+    } else {
+        // The flag is checked under the mutex, so a signal sent just before the wait is never missed
+        pthread_mutex_lock(&shutdown->mutex);
+        while (!shutdown->terminated &&
+               pthread_cond_timedwait(&shutdown->cond, &shutdown->mutex, &deadline) != ETIMEDOUT) {
+        }
+        interrupted = shutdown->terminated;
+        pthread_mutex_unlock(&shutdown->mutex);
+    }
+
+    // A wait cut short says nothing about how well the deadlines were met, nor counts towards the rate
+    if (!interrupted) {
+        pacing->scheduled_ns += duration_us * 1000;
+        pacing_record(pacing, pacing->deadline_ns, latency_now_ns());
+    }
+    return interrupted;
+}
+
+/**
+ * Initializes a `Shutdown` that has not been signalled.
+ *
+ * @param[out] shutdown  Pointer to the `Shutdown` to initialize.
+ */
+void shutdown_init(Shutdown *shutdown) {
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&shutdown->mutex, NULL);
+    // Waits use the monotonic pacing deadlines as they are
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&shutdown->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    shutdown->terminated = 0;
+    shutdown->terminate_ns = 0;
+}
+
+/**
+ * Wakes every system waiting on a `Shutdown`, and makes their later waits return at once.
+ *
+ * Only the first call records `terminate_ns`, later ones do nothing.
+ *
+ * @param[in,out] shutdown  Pointer to the `Shutdown` to signal.
+ */
+void shutdown_signal(Shutdown *shutdown) {
+    pthread_mutex_lock(&shutdown->mutex);
+    if (!shutdown->terminated) {
+        shutdown->terminated = 1;
+        shutdown->terminate_ns = latency_now_ns();
+        pthread_cond_broadcast(&shutdown->cond);
+    }
+    pthread_mutex_unlock(&shutdown->mutex);
+}
+
+/**
+ * Sleeps for a duration unless a `Shutdown` is signalled first.
+ *
+ * @param[in,out] shutdown     Pointer to the `Shutdown` to wait on.
+ * @param[in]     duration_us  Time to wait in microseconds.
+ * @return                     Non-zero if the shutdown was signalled, before or during the wait.
+ */
+int shutdown_sleep(Shutdown *shutdown, long long duration_us) {
+    long long deadline_ns = latency_now_ns() + duration_us * 1000;
+    struct timespec deadline;
+    int terminated;
+
+    deadline.tv_sec = deadline_ns / 1000000000LL;
+    deadline.tv_nsec = deadline_ns % 1000000000LL;
+    pthread_mutex_lock(&shutdown->mutex);
+    while (!shutdown->terminated &&
+           pthread_cond_timedwait(&shutdown->cond, &shutdown->mutex, &deadline) != ETIMEDOUT) {
+    }
+    terminated = shutdown->terminated;
+    pthread_mutex_unlock(&shutdown->mutex);
+    return terminated;
+}
+
+/**
+ * Destroys a `Shutdown`, once no thread can be waiting on it.
+ *
+ * @param[in,out] shutdown  Pointer to the `Shutdown` to clean.
+ */
+void shutdown_clean(Shutdown *shutdown) {
+    pthread_cond_destroy(&shutdown->cond);
+    pthread_mutex_destroy(&shutdown->mutex);
+}
+
+/**
+ * Initializes an empty `SystemPacing`.
+ *
+ * @param[out] pacing  Pointer to the `SystemPacing` to initialize.
+ */
+void pacing_init(SystemPacing *pacing) {
+    pacing->deadline_ns = 0;
+    pacing->anchor_ns = 0;
+    pacing->scheduled_ns = 0;
+    pacing->last_wake_ns = 0;
+    pacing->waits = 0;
+    pacing->overshoot_total_ns = 0;
+    pacing->overshoot_max_ns = 0;
+    pacing->resyncs = 0;
+}
+
+/**
+ * Records how late a wait ended compared to its deadline.
+ *
+ * @param[in,out] pacing       Pointer to the `SystemPacing`.
+ * @param[in]     deadline_ns  Monotonic time the wait should have ended.
+ * @param[in]     wake_ns      Monotonic time it did end.
+ */
+void pacing_record(SystemPacing *pacing, long long deadline_ns, long long wake_ns) {
+    long long overshoot_ns = wake_ns > deadline_ns ? wake_ns - deadline_ns : 0;
+
+    pacing->waits++;
+    pacing->overshoot_total_ns += overshoot_ns;
+    if (overshoot_ns > pacing->overshoot_max_ns) {
+        pacing->overshoot_max_ns = overshoot_ns;
+    }
+    pacing->last_wake_ns = wake_ns;
+}
+
+/**
+ * Prints how closely each system's real-time waits kept to their deadlines.
+ *
+ * The rate is the time the system asked to wait divided by the time that actually went by,
+ * so 100% means it produced exactly at its configured rate.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ */
+void manager_pacing_print(const Manager *manager) {
+    SystemPacing total;
+    long long elapsed_total_ns = 0;
+    int paced = 0;
+    int each = manager->system_array.size <= PACING_PRINT_SYSTEMS;
+
+    pacing_init(&total);
+    for (int i = 0; i < manager->system_array.size; i++) {
+        const System *system = manager->system_array.systems[i];
+        const SystemPacing *pacing = &system->pacing;
+        long long elapsed_ns = pacing->last_wake_ns - pacing->anchor_ns;
+
+        if (pacing->waits == 0) {
+            continue;
+        }
+
+        if (paced++ == 0) {
+            printf("%-16s %10s %8s %18s %18s %8s\n", "System", "Waits", "Rate", "Mean overshoot us", "Max overshoot us", "Resyncs");
+        }
+        if (each) {
+            printf("%-16s %10lu %7.3f%% %18.1f %18.1f %8lu\n", system->name, pacing->waits,
+                   elapsed_ns > 0 ? 100.0 * pacing->scheduled_ns / elapsed_ns : 100.0,
+                   pacing->overshoot_total_ns / 1000.0 / pacing->waits, pacing->overshoot_max_ns / 1000.0, pacing->resyncs);
+        }
+
+        total.waits += pacing->waits;
+        total.scheduled_ns += pacing->scheduled_ns;
+        total.overshoot_total_ns += pacing->overshoot_total_ns;
+        total.resyncs += pacing->resyncs;
+        if (pacing->overshoot_max_ns > total.overshoot_max_ns) {
+            total.overshoot_max_ns = pacing->overshoot_max_ns;
+        }
+        elapsed_total_ns += elapsed_ns;
+    }
+
+    if (paced > 0 && !each) {
+        printf("%-16s %10lu %7.3f%% %18.1f %18.1f %8lu\n", "All systems", total.waits,
+               elapsed_total_ns > 0 ? 100.0 * total.scheduled_ns / elapsed_total_ns : 100.0,
+               total.overshoot_total_ns / 1000.0 / total.waits, total.overshoot_max_ns / 1000.0, total.resyncs);
+    }
+}
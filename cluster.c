@@ -0,0 +1,161 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+static void *cluster_thread(void *arg);
+static void cluster_handle_event(Cluster *cluster, const Event *event);
+
+/**
+ * Partitions the manager's systems into clusters, each with its own sub-manager thread.
+ *
+ * Every system is pointed at its cluster's event queue, which inherits the capacity and overflow
+ * policy of the manager's queue. Must be called after all systems are added and before they run.
+ *
+ * @param[in,out] manager       Pointer to the top-level `Manager`.
+ * @param[in]     cluster_size  Maximum number of systems per cluster.
+ */
+void manager_clusters_start(Manager *manager, int cluster_size) {
+    int count = manager->system_array.size;
+    int i, j;
+
+    if (manager->clusters != NULL || cluster_size <= 0 || count == 0) {
+        return;
+    }
+
+    manager->cluster_count = (count + cluster_size - 1) / cluster_size;
+    manager->clusters = malloc(sizeof(Cluster) * manager->cluster_count);
+    if (manager->clusters == NULL) {
+        manager->cluster_count = 0;
+        return;
+    }
+
+    for (i = 0; i < manager->cluster_count; i++) {
+        Cluster *cluster = &manager->clusters[i];
+
+        cluster->parent = manager;
+        // A copy, the array's storage may be replaced and reclaimed while the cluster runs
+        cluster->size = (i + 1) * cluster_size <= count ? cluster_size : count - i * cluster_size;
+        cluster->systems = malloc(sizeof(System*) * cluster->size);
+        if (cluster->systems == NULL) {
+            cluster->size = 0;
+        }
+        for (j = 0; j < cluster->size; j++) {
+            cluster->systems[j] = manager->system_array.systems[i * cluster_size + j];
+        }
+        cluster->running = 1;
+        cluster->handled = 0;
+        cluster->forwarded = 0;
+        cluster->fast = 0;
+        cluster->slow = 0;
+
+        event_queue_init(&cluster->event_queue);
+        event_queue_set_capacity(&cluster->event_queue, manager->event_queue.capacity, manager->event_queue.policy);
+
+        for (j = 0; j < cluster->size; j++) {
+            cluster->systems[j]->event_queue = &cluster->event_queue;
+        }
+    }
+
+    for (i = 0; i < manager->cluster_count; i++) {
+        pthread_create(&manager->clusters[i].thread, NULL, cluster_thread, &manager->clusters[i]);
+    }
+}
+
+/**
+ * Stops and joins every sub-manager.
+ *
+ * The cluster queues are closed first so no system can stay blocked on a queue nobody drains.
+ * The systems keep pointing at the closed queues until they are joined, so this must be followed
+ * by joining the system threads before the manager is cleaned.
+ *
+ * @param[in,out] manager  Pointer to the top-level `Manager`.
+ */
+void manager_clusters_stop(Manager *manager) {
+    int i;
+
+    for (i = 0; i < manager->cluster_count; i++) {
+        __atomic_store_n(&manager->clusters[i].running, 0, __ATOMIC_RELAXED);
+        event_queue_close(&manager->clusters[i].event_queue);
+    }
+
+    for (i = 0; i < manager->cluster_count; i++) {
+        pthread_join(manager->clusters[i].thread, NULL);
+    }
+}
+
+/**
+ * Releases the clusters once no system uses their queues anymore.
+ *
+ * @param[in,out] manager  Pointer to the top-level `Manager`.
+ */
+void manager_clusters_clean(Manager *manager) {
+    for (int i = 0; i < manager->cluster_count; i++) {
+        event_queue_clean(&manager->clusters[i].event_queue);
+        free(manager->clusters[i].systems);
+    }
+    free(manager->clusters);
+    manager->clusters = NULL;
+    manager->cluster_count = 0;
+}
+
+/**
+ * Sub-manager thread body, handles the cluster's events until stopped.
+ *
+ * @param[in,out] arg  Pointer to the `Cluster`.
+ * @return             NULL.
+ */
+static void *cluster_thread(void *arg) {
+    Cluster *cluster = (Cluster*)arg;
+    Event event;
+
+    TRACE_THREAD_NAME("Cluster sub-manager");
+    while (__atomic_load_n(&cluster->running, __ATOMIC_RELAXED)) {
+        while (event_queue_pop(&cluster->event_queue, &event)) {
+            TRACE_BEGIN("cluster_handle_event");
+            cluster_handle_event(cluster, &event);
+            TRACE_END("cluster_handle_event");
+        }
+        // Once the top-level manager has terminated the systems there is nothing left to handle
+        if (shutdown_sleep(&cluster->parent->shutdown, MANAGER_WAIT_TIME * 1000)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Handles one event inside its cluster.
+ *
+ * Terminal conditions go up to the top-level manager's queue, speed changes are applied to the
+ * cluster's own producers of the event's resource.
+ *
+ * @param[in,out] cluster  Pointer to the `Cluster`.
+ * @param[in]     event    Pointer to the `Event` to handle.
+ */
+static void cluster_handle_event(Cluster *cluster, const Event *event) {
+    int status = event_target_status(event);
+
+    if (status == TERMINATE) {
+        event_queue_push(&cluster->parent->event_queue, event);
+        __atomic_fetch_add(&cluster->forwarded, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(&cluster->handled, 1, __ATOMIC_RELAXED);
+    if (status == STATUS_OK) {
+        return;
+    }
+
+    __atomic_fetch_add(status == FAST ? &cluster->fast : &cluster->slow, 1, __ATOMIC_RELAXED);
+    snapshot_commit_begin(&cluster->parent->snapshot_seq);
+    for (int i = 0; i < cluster->size; i++) {
+        System *system = cluster->systems[i];
+        int current = __atomic_load_n(&system->status, __ATOMIC_RELAXED);
+
+        // Never undo a termination the top-level manager sent, even if it lands at the same time
+        while (system->produced.resource == event->resource && current != TERMINATE &&
+               !__atomic_compare_exchange_n(&system->status, &current, status, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+    snapshot_commit_end(&cluster->parent->snapshot_seq);
+}
@@ -0,0 +1,229 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#define CONTENTION_DEFAULT_OPS 1000000     // Operations per system thread
+#define CONTENTION_MAX_SIZES 16
+
+// The layout Resource had before its hot field got its own cache line, kept to compare against
+typedef struct PackedResource {
+    char *name;
+    int amount;
+    int max_capacity;
+} PackedResource;
+
+// The layout System had before its fields were grouped by writer, kept to compare against
+typedef struct PackedSystem {
+    char *name;
+    ResourceAmount consumed;
+    ResourceAmount produced;
+    int amount_stored;
+    int processing_time;
+    int status;
+    struct EventQueue *event_queue;
+} PackedSystem;
+
+// One system thread's fields, wherever the layout put them
+typedef struct ContentionWorker {
+    int *amount;            // Resource amount the system updates with a CAS, like storing production
+    int *amount_stored;     // Written by the system every operation
+    int *status;            // Written by the manager thread, read by the system every operation
+    long ops;
+    pthread_t thread;
+} ContentionWorker;
+
+// The manager thread's view, it keeps rewriting every system's status
+typedef struct ContentionManager {
+    ContentionWorker *workers;
+    int count;
+    int running;
+} ContentionManager;
+
+static int contention_parse_sizes(const char *spec, int *sizes);
+static double contention_run(ContentionWorker *workers, int count, long ops);
+static void *contention_system(void *arg);
+static void *contention_manager(void *arg);
+
+/**
+ * Measures how much false sharing the hot/cold layout of `Resource` and `System` avoids.
+ *
+ * For each thread count, that many system threads each update their own resource's amount and
+ * their own system's `amount_stored` while a manager thread keeps writing their statuses, first
+ * with the old packed layout (objects side by side) and then with the current cache-line layout.
+ * No two threads ever touch the same field, so any slowdown is cache lines bouncing between cores.
+ *
+ * Usage: --contention [--threads N[,N]...] [--ops N]
+ *
+ * @param[in] argc  Argument count, `argv[0]` is `--contention`.
+ * @param[in] argv  Arguments.
+ * @return          Process exit status.
+ */
+int contention_main(int argc, char *argv[]) {
+    int sizes[CONTENTION_MAX_SIZES] = { 2, 8, 32 };
+    int count = 3;
+    long ops = CONTENTION_DEFAULT_OPS;
+    int i, t;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            count = contention_parse_sizes(argv[++i], sizes);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops = atol(argv[++i]);
+        } else {
+            count = 0;
+            break;
+        }
+    }
+
+    if (count <= 0 || ops <= 0) {
+        fprintf(stderr, "Usage: --contention [--threads N[,N]...] [--ops N]\n");
+        return 1;
+    }
+
+    printf("%ld operations per system thread, plus one manager thread writing statuses\n\n", ops);
+    printf("%8s %16s %16s %9s\n", "Threads", "Packed Mops/s", "Aligned Mops/s", "Speedup");
+    for (i = 0; i < count; i++) {
+        int threads = sizes[i];
+        PackedResource *packed_resources = calloc(threads, sizeof(PackedResource));
+        PackedSystem *packed_systems = calloc(threads, sizeof(PackedSystem));
+        Resource *resources = aligned_alloc(CACHE_LINE, sizeof(Resource) * threads);
+        System *systems = aligned_alloc(CACHE_LINE, sizeof(System) * threads);
+        ContentionWorker *workers = malloc(sizeof(ContentionWorker) * threads);
+        double packed, aligned;
+
+        if (packed_resources == NULL || packed_systems == NULL || resources == NULL || systems == NULL || workers == NULL) {
+            free(packed_resources);
+            free(packed_systems);
+            free(resources);
+            free(systems);
+            free(workers);
+            return 1;
+        }
+        memset(resources, 0, sizeof(Resource) * threads);
+        memset(systems, 0, sizeof(System) * threads);
+
+        for (t = 0; t < threads; t++) {
+            workers[t].amount = &packed_resources[t].amount;
+            workers[t].amount_stored = &packed_systems[t].amount_stored;
+            workers[t].status = &packed_systems[t].status;
+        }
+        packed = contention_run(workers, threads, ops);
+
+        for (t = 0; t < threads; t++) {
+            workers[t].amount = &resources[t].amount;
+            workers[t].amount_stored = &systems[t].amount_stored;
+            workers[t].status = &systems[t].status;
+        }
+        aligned = contention_run(workers, threads, ops);
+
+        printf("%8d %16.1f %16.1f %8.2fx\n", threads, packed, aligned, aligned / packed);
+        fflush(stdout);
+
+        free(packed_resources);
+        free(packed_systems);
+        free(resources);
+        free(systems);
+        free(workers);
+    }
+    return 0;
+}
+
+/**
+ * Parses a comma-separated list of thread counts.
+ *
+ * @param[in]  spec   List such as "2,8,32".
+ * @param[out] sizes  Parsed counts, at most `CONTENTION_MAX_SIZES`.
+ * @return            Number of counts, 0 if the list is invalid.
+ */
+static int contention_parse_sizes(const char *spec, int *sizes) {
+    int count = 0;
+    char *end;
+
+    while (*spec != '\0') {
+        long size = strtol(spec, &end, 10);
+        if (end == spec || size <= 0 || count == CONTENTION_MAX_SIZES || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        sizes[count++] = (int)size;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/**
+ * Runs the system threads and the manager thread on one layout.
+ *
+ * @param[in,out] workers  System threads with their fields set.
+ * @param[in]     count    Number of system threads.
+ * @param[in]     ops      Operations per system thread.
+ * @return                 Millions of system operations per second.
+ */
+static double contention_run(ContentionWorker *workers, int count, long ops) {
+    ContentionManager manager = { workers, count, 1 };
+    pthread_t manager_thread;
+    long long start_ns, elapsed_ns;
+    int t;
+
+    // Zeroed memory reads as TERMINATE, which would stop the systems right away
+    for (t = 0; t < count; t++) {
+        *workers[t].status = STANDARD;
+    }
+    pthread_create(&manager_thread, NULL, contention_manager, &manager);
+
+    start_ns = latency_now_ns();
+    for (t = 0; t < count; t++) {
+        workers[t].ops = ops;
+        pthread_create(&workers[t].thread, NULL, contention_system, &workers[t]);
+    }
+    for (t = 0; t < count; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    elapsed_ns = latency_now_ns() - start_ns;
+
+    __atomic_store_n(&manager.running, 0, __ATOMIC_RELAXED);
+    pthread_join(manager_thread, NULL);
+
+    return (double)ops * count / (elapsed_ns / 1e9) / 1e6;
+}
+
+/**
+ * System thread body, the same writes `system_store_resources` and the system loop make.
+ *
+ * @param[in,out] arg  Pointer to the `ContentionWorker`.
+ * @return             NULL.
+ */
+static void *contention_system(void *arg) {
+    ContentionWorker *worker = (ContentionWorker*)arg;
+
+    for (long i = 0; i < worker->ops; i++) {
+        int current = __atomic_load_n(worker->amount, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(worker->amount, &current, current + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        }
+        __atomic_store_n(worker->amount_stored, __atomic_load_n(worker->amount_stored, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+        if (__atomic_load_n(worker->status, __ATOMIC_RELAXED) == TERMINATE) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Manager thread body, alternates every system between FAST and STANDARD until stopped.
+ *
+ * @param[in,out] arg  Pointer to the `ContentionManager`.
+ * @return             NULL.
+ */
+static void *contention_manager(void *arg) {
+    ContentionManager *manager = (ContentionManager*)arg;
+    int status = FAST;
+
+    while (__atomic_load_n(&manager->running, __ATOMIC_RELAXED)) {
+        for (int t = 0; t < manager->count; t++) {
+            __atomic_store_n(manager->workers[t].status, status, __ATOMIC_RELAXED);
+        }
+        status = status == FAST ? STANDARD : FAST;
+    }
+    return NULL;
+}
@@ -1,4 +1,7 @@
 #include <semaphore.h>
+#include <time.h>
+#include <pthread.h>
+#include "subsystem.h"
 
 // Don't worry about these! These are special codes that allow us to do some formatting in the terminal
 // Such as clearing the line before printing or moving the location of the "cursor" that will print.
@@ -25,18 +28,204 @@
 #define THRESHOLD_RESOURCE_LOW 0.3  // Percentage of resource before it is considered low.
 #define MANAGER_WAIT_TIME 5         // Milliseconds for the manager to wait between popping the queue
 #define SYSTEM_WAIT_TIME 20         // Milliseconds between loops of the system when production cannot occur
+#define PACING_RESYNC_US 100000     // A system this far behind its deadline is rebased instead of catching up
+#define CHECKPOINT_INTERVAL_MS 100  // Milliseconds between checkpoints of the threaded and scheduled runs
+#define CHECKPOINT_BARRIER_MS 10    // Longest a checkpoint waits for the systems' steps in progress
+
+#define SYSTEM_PHASE_START      0  // About to begin a pass of the main loop
+#define SYSTEM_PHASE_PROCESSING 1  // Resources consumed, waiting out the processing time
+#define SYSTEM_PHASE_STORE      2  // Backing off after a failed conversion, about to store
+
+#define SYSTEM_REQUEST_NONE    0   // The step changes no resource
+#define SYSTEM_REQUEST_CONSUME 1   // The step consumes `amount`, all or nothing
+#define SYSTEM_REQUEST_STORE   2   // The step stores as much of `amount` as fits
+
+#define CHANNEL_CAPACITY 64     // Events each system's channel can hold, must be a power of two
+#define CHANNEL_WORD_BITS 64    // Channels tracked by each word of the manager's non-empty bitmap
+
+#define OVERFLOW_BLOCK       0  // A full queue makes producers wait for room
+#define OVERFLOW_DROP_LOWEST 1  // A full queue evicts its lowest priority event, or drops the new one
+#define OVERFLOW_MERGE       2  // A full queue folds the new event into a matching queued one
 
 #define PRIORITY_HIGH 3
 #define PRIORITY_MED 2
 #define PRIORITY_LOW 1
 
+#define LATENCY_SUB_BITS 4                              // Sub-buckets per power of two, as a bit count (~6% precision)
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (60 * LATENCY_SUB_COUNT)        // Enough buckets for any non-negative 64-bit value
+
+#define STREAM_NDJSON 0          // Headless records as one JSON object per line
+#define STREAM_BINARY 1          // Headless records in the compact binary format
+#define STREAM_CAPACITY 65536    // Records the headless ring can hold, must be a power of two
+
+#define STREAM_RECORD_EVENT     1
+#define STREAM_RECORD_RESOURCE  2
+#define STREAM_RECORD_ITERATION 3
+
+#define RCU_MAX_READERS 64          // Threads that can iterate the live arrays at once
+
+#define RCU_RETIRED_VERSION  0      // Replaced array storage
+#define RCU_RETIRED_SYSTEM   1      // System removed from a live simulation
+
+#define DETERMINISTIC_EPOCH_US 1000  // Default virtual length of a deterministic epoch
+
+#define SHARED_MAGIC            0x524b5348u  // "RKSH", marks a mapped shared-memory segment
+#define SHARED_CHANNEL_CAPACITY 64           // Events one system can have in flight to the manager process, a power of two
+#define SHARED_MAX_WORKERS      64           // Worker processes a shared-memory run can fork
+#define SHARED_CRASH_DELAY_MS   50           // How long --crash-worker lets the worker run before killing it
+
+#define SERIES_LEVELS  4            // Levels of a resource's history, each SERIES_FANOUT times coarser than the one below
+#define SERIES_FANOUT  8
+#define SERIES_SLOTS   64           // Buckets kept per level
+#define SERIES_DISPLAY_WINDOW_MS 1000   // Window of the rate shown next to each resource
+
+#define OUTCOME_RUNNING     0   // Simulation has not reached a terminal condition yet
+#define OUTCOME_DESTINATION 1   // Distance reached its capacity
+#define OUTCOME_DEPLETED    2   // Oxygen ran out
+
+// Time source for a simulation, either sleeping for real or advancing a virtual clock
+typedef struct SimClock {
+    int virtual_time;   // non-zero to advance `now_us` instead of sleeping
+    long long now_us;   // Virtual time elapsed in microseconds
+} SimClock;
+
+// Lets the manager wake every system sleeping in real time as soon as it terminates them
+typedef struct Shutdown {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        // Timed on CLOCK_MONOTONIC, broadcast when the systems are terminated
+    int terminated;             // non-zero once signalled, set under mutex
+    long long terminate_ns;     // Monotonic time of the first signal, 0 until then
+} Shutdown;
+
+// One chunk of arena memory, chained to the previously filled chunk
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t capacity;    // Usable bytes in data
+    size_t used;        // Bytes handed out so far
+    char data[];
+} ArenaBlock;
+
+// Bump allocator whose memory is all released at once, with a table of interned names
+typedef struct Arena {
+    ArenaBlock *blocks;          // Current block first
+    size_t next_block_size;      // Size of the next block, doubles up to a limit
+    char **interned;             // Open-addressed table of the interned names, NULL slots are free
+    unsigned int interned_count;
+    unsigned int interned_capacity;  // Power of two
+} Arena;
+
+// Commit counters for consistent snapshots: writers bump start before changing an amount or status
+// and end afterwards, so a reader that sees start == end before and the same start after has a
+// copy no commit overlapped. Writers never wait, each counter has its own cache line.
+// Whole system steps are counted too, and the barrier holds new steps back while a checkpoint
+// copies the state only the systems' own threads write.
+typedef struct SnapshotSeq {
+    _Alignas(CACHE_LINE) unsigned long start;   // Commits and steps begun
+    _Alignas(CACHE_LINE) unsigned long end;     // Commits and steps finished
+    _Alignas(CACHE_LINE) int barrier;           // non-zero while steps may not begin
+} SnapshotSeq;
+
+// Every resource amount and system status as they were at one instant between commits
+typedef struct SnapshotFrame {
+    int *amounts;               // Indexed like the manager's resource array
+    int resource_count;
+    int resource_capacity;
+    int *statuses;              // Indexed like the manager's system array
+    struct Resource **resources; // The array versions copied, valid until the reader's next quiescent point
+    struct System **systems;
+    int system_count;
+    int system_capacity;
+    unsigned long commit;       // Commits the frame includes
+    unsigned long retries;      // Copies thrown away because a commit overlapped them
+} SnapshotFrame;
+
+// One published version of a system or resource array, its entries follow the header
+// Appends fill spare capacity in place and then publish the new size, removals publish a copy
+typedef struct ArrayVersion {
+    int size;       // Entries readers may use, only ever grows within a version
+    int capacity;
+} ArrayVersion;
+
+// Something no longer published that a reader may still be using
+typedef struct RcuRetired {
+    int kind;                   // RCU_RETIRED_*
+    void *object;
+    int owned;                  // non-zero when malloc'd, arena objects are left to the arena
+    int waiting;                // non-zero while a removed system's executor may still run it
+    unsigned long epoch;        // Epoch every reader must have reported before it is reclaimed
+    struct RcuRetired *next;
+} RcuRetired;
+
+// Quiescent-state based reclamation for the live arrays: readers never lock, they report between
+// passes that they hold nothing, and writers reclaim what they unpublished once every reader has
+typedef struct Rcu {
+    unsigned long epoch;                        // Bumped by every retire
+    unsigned long readers[RCU_MAX_READERS];     // Epoch each reader last reported, 0 for a free slot
+    sem_t mutex;                                // Serializes writers
+    RcuRetired *retired;                        // Waiting for their grace period, newest first
+    RcuRetired *spare;                          // Reclaimed arena systems, reused by manager_system_create_live
+    unsigned long reclaimed;                    // Retired objects and versions reclaimed so far
+    void (*release)(void *context, void *system);   // Called as a retired system is reclaimed, may be NULL
+    void *release_context;
+} Rcu;
+
+// Absolute-deadline pacing of one system's waits, and how closely the sleeps met the deadlines
+typedef struct SystemPacing {
+    long long deadline_ns;          // Monotonic deadline of the current or last wait, 0 before the first
+    long long anchor_ns;            // When pacing started, the rate is measured from here
+    long long scheduled_ns;         // Sum of the waits asked for since the anchor
+    long long last_wake_ns;         // When the last wait ended
+    unsigned long waits;
+    long long overshoot_total_ns;   // Sum of wake time minus deadline
+    long long overshoot_max_ns;
+    unsigned long resyncs;          // Times the system fell so far behind that its deadline was rebased
+} SystemPacing;
+
 // Represents the resource amounts for the entire rocket
+// The amount every system writes gets a cache line of its own, so updating one resource never
+// invalidates the line holding another resource or this one's read-only fields
 typedef struct Resource {
-    char *name;      // Dynamically allocated string
-    int amount;
+    char *name;      // Dynamically allocated string, or interned in the owning arena
     int max_capacity;
+    struct ResourceSeries *series;  // Sampled history of the amount, NULL if not recorded
+    _Alignas(CACHE_LINE) int amount;
 } Resource;
 
+// Aggregate of the samples falling in one time bucket, two buckets merge in O(1)
+typedef struct SeriesBucket {
+    long long number;   // Bucket number counted from the first sample, -1 while unused
+    int count;
+    int min;
+    int max;
+    double sum;         // Sums for the mean and the least-squares slope, times in seconds since the first sample
+    double sum_t;
+    double sum_tt;
+    double sum_ta;
+} SeriesBucket;
+
+// Fixed-size history of one resource's amount, written by the manager and readable from any thread
+// Level l keeps SERIES_SLOTS buckets each SERIES_FANOUT^l sampling intervals wide
+typedef struct ResourceSeries {
+    long long interval_ns;      // Time between samples
+    long long start_ns;         // Time of the first sample, 0 before it
+    long long next_ns;          // Earliest time of the next sample
+    long long last_ns;          // Time of the latest sample
+    unsigned long samples;
+    unsigned int seq;           // Seqlock counter, odd while a sample is being added
+    SeriesBucket levels[SERIES_LEVELS][SERIES_SLOTS];
+} ResourceSeries;
+
+// Result of a window query on a `ResourceSeries`
+typedef struct SeriesStats {
+    int count;          // Samples in the window
+    int min;
+    int max;
+    double mean;
+    double slope;       // Least-squares rate of change, in amount per second
+    long long span_ns;  // Time the window actually covers, in whole buckets of the level that answered
+} SeriesStats;
+
 // Represents the amount of a resource consumed/produced for a single system
 typedef struct ResourceAmount {
     Resource *resource;
@@ -44,14 +233,28 @@ typedef struct ResourceAmount {
 } ResourceAmount;
 
 // A system which consumes resources, waits for `processing_time` milliseconds, then produced the produced resource
+// Fields are grouped by writer: read-only configuration first, then the status the manager writes,
+// then the state only the system's own thread writes, each group starting a new cache line
 typedef struct System {
-    char *name;     // Dynamically allocated string
+    char *name;     // Dynamically allocated string, or interned in the owning arena
     ResourceAmount consumed;
     ResourceAmount produced;
-    int amount_stored;
     int processing_time;
-    int status; 
     struct EventQueue *event_queue;  // Pointer to event queue shared by all systems and manager
+    SubsystemCollection *health;     // Manager's collection holding the packed health status, NULL if not tracked
+    int health_index;                // Slot in health, fixed until the system is reclaimed
+    SimClock *clock;                 // Clock used for processing and backoff waits, NULL to sleep in real time
+    Shutdown *shutdown;              // Cuts real-time waits short on TERMINATE, NULL to always sleep them out
+    struct EventChannel *channel;    // Private event ring to the manager, NULL to push to event_queue
+    SnapshotSeq *snapshot_seq;       // Commit counters of the manager's snapshots, NULL if not tracked
+    _Alignas(CACHE_LINE) int status;         // Written by the manager
+    int retired;                     // Set when removed from a live simulation, its executor drops it
+    _Alignas(CACHE_LINE) int amount_stored;  // Everything from here is written by the system
+    int released;                    // non-zero while no thread or scheduler is running the system
+    int phase;                       // SYSTEM_PHASE_* the main loop will resume from
+    long long resume_us;             // Wait a restored checkpoint was in, waited out before the next step
+    unsigned long conversions;       // Processing cycles completed
+    SystemPacing pacing;             // Deadlines and overshoot of the system's real-time waits
 } System;
 
 // Used to send notifications to the manager about an issue / state of the system
@@ -61,8 +264,22 @@ typedef struct Event {
     int status;     
     int priority;   // Higher values indicate higher priority
     int amount;     // Amount of the resource in question
+    long long push_ns;  // Monotonic time the event was reported, for latency tracking
 } Event;
 
+// The resource change one step of a system needs, and its outcome once committed
+typedef struct SystemRequest {
+    int kind;               // SYSTEM_REQUEST_*
+    int converting;         // non-zero when the step is a conversion, even one consuming nothing
+    Resource *resource;
+    int amount;
+    int status;             // STATUS_OK, or why the commit fell short
+    int stored;             // Amount a store added
+    int defer_event;        // non-zero to keep the step's event in `event` instead of reporting it
+    int has_event;
+    Event event;
+} SystemRequest;
+
 // Linked List Node for the Event queue
 typedef struct EventNode {
     Event event;
@@ -70,45 +287,428 @@ typedef struct EventNode {
 } EventNode;
 
 // Linked List structure with a head and no tail, single instance shared by all systems
+// PRIORITY_HIGH events are never dropped: when nothing can be evicted or merged the producer waits
 typedef struct EventQueue {
     EventNode *head;
     int size;
+    sem_t mutex;        // Serializes pushes and pops when systems run on their own threads
+    int capacity;       // Maximum number of queued events, 0 for unbounded
+    int policy;         // OVERFLOW_* applied when the queue is full
+    int closed;         // Non-zero once the consumer has stopped, producers no longer wait
+    int waiters;        // Producers waiting for room
+    sem_t space;        // Posted by pops and close to wake waiting producers
+    unsigned long dropped;  // New events discarded because the queue was full
+    unsigned long evicted;  // Queued events discarded to make room for higher priority ones
+    unsigned long merged;   // New events folded into a matching queued event
+    unsigned long waits;    // Pushes that had to wait for room
+    long long wait_us;      // Total time producers spent waiting, in microseconds
 } EventQueue;
 
+// Lock-free single-producer/single-consumer ring carrying one system's events to the manager
+// head is only written by the manager and tail only by the system, so each gets its own cache line
+typedef struct EventChannel {
+    Event *slots;
+    unsigned int mask;                  // capacity - 1
+    _Alignas(64) unsigned int head;     // Next slot the manager reads
+    _Alignas(64) unsigned int tail;     // Next slot the system writes
+    unsigned int dropped;               // Low priority events lost because the ring was full
+    unsigned long long *active;         // Word of the manager's non-empty bitmap holding this channel
+    unsigned long long bit;             // This channel's bit in *active
+} EventChannel;
+
 // A basic dynamic array to store all of the systems in the simulation
+// Readers running alongside live changes use system_array_read, the fields are the writer's view
 typedef struct SystemArray {
     System **systems;
     int size;
     int capacity;
+    Arena *arena;           // Owner of every system, NULL when they are malloc'd
+    ArrayVersion *version;  // Published storage, `systems` points at its entries
+    Rcu *rcu;               // Defers freeing replaced storage and removed systems, NULL to free at once
+    unsigned long changes;  // Bumped after every add and remove, so executors notice new systems
 } SystemArray;
 
 // A basic resource array to store all resources in the simulation
+// Readers running alongside live changes use resource_array_read, the fields are the writer's view
 typedef struct ResourceArray {
     Resource **resources;
     int size;
     int capacity;
+    Arena *arena;           // Owner of every resource, NULL when they are malloc'd
+    ArrayVersion *version;  // Published storage, `resources` points at its entries
+    Rcu *rcu;               // Defers freeing replaced storage, NULL to free at once
 } ResourceArray;
 
+// Log-bucketed (HDR-style) histogram of latencies in nanoseconds, written by a single thread
+typedef struct LatencyHistogram {
+    unsigned long long counts[LATENCY_BUCKETS];
+    unsigned long long total;
+    long long max;
+} LatencyHistogram;
+
+// A group of systems handled by its own sub-manager thread
+// SLOW/FAST reactions stay inside the cluster, only terminal events go up to the top-level manager
+typedef struct Cluster {
+    struct Manager *parent;     // Top-level manager that receives the terminal events
+    System **systems;           // Copy of the cluster's slice of the parent's system array
+    int size;
+    EventQueue event_queue;     // Events reported by the cluster's systems
+    pthread_t thread;
+    int running;                // Cleared by the parent to stop the sub-manager
+    unsigned long handled;      // Events handled inside the cluster
+    unsigned long forwarded;    // Events forwarded to the parent
+    unsigned long fast;         // FAST decisions made by the cluster
+    unsigned long slow;         // SLOW decisions made by the cluster
+} Cluster;
+
+// One headless output record, encoded by the writer thread rather than the manager
+typedef struct StreamRecord {
+    int type;               // STREAM_RECORD_*
+    long long ts_ns;        // Monotonic time the record was made
+    const char *system;     // Interned names, valid until the manager is cleaned
+    const char *resource;
+    int status;
+    int priority;
+    int amount;             // Event or resource amount, or the iteration number
+    int max_capacity;
+} StreamRecord;
+
+// Binary id given to a name the first time the writer sees it
+typedef struct StreamName {
+    const char *name;
+    unsigned int id;
+} StreamName;
+
+// Headless output: the manager pushes records into a lock-free ring, a writer thread encodes and writes them
+typedef struct OutputStream {
+    StreamRecord *slots;
+    unsigned int mask;                  // STREAM_CAPACITY - 1
+    _Alignas(64) unsigned int head;     // Next record the writer reads
+    _Alignas(64) unsigned int tail;     // Next record the manager writes
+    unsigned long dropped;              // Records lost because the writer fell behind
+    long long last_snapshot_ns;         // When resources were last recorded
+    _Alignas(64) int running;           // Cleared to have the writer drain the ring and exit
+    int started;
+    pthread_t thread;
+    int format;                         // STREAM_NDJSON or STREAM_BINARY
+    int fd;
+    char *buffer;                       // Encoded bytes waiting for the next write
+    size_t buffer_used;
+    StreamName *names;                  // Binary name ids, open-addressed by pointer
+    unsigned int name_count;
+    unsigned int name_capacity;
+    unsigned long long written;         // Records encoded so far
+} OutputStream;
+
 // Container structure which contains all of the core data for our simulation
 typedef struct Manager {
     int simulation_running; // non-zero if the simulation is running, zero if it should be stopped
+    Arena arena;            // Storage of every resource, system and name, released in one go
     SystemArray system_array;
     ResourceArray resource_array;
     EventQueue event_queue;
+    EventChannel *channels;                 // One channel per system, NULL when systems share event_queue
+    unsigned long long *active_channels;    // Bit set for every channel that may hold events
+    int channel_count;
+    Cluster *clusters;                      // Sub-managers in hierarchical mode, NULL otherwise
+    int cluster_count;
+    SubsystemCollection health;  // One packed status byte per system, updated live by system_run
+    struct System *health_owners[MAX_ARR];   // System of each health slot, NULL for a free slot
+    int health_tracked;          // Non-zero once manager_health_attach ran, systems added later get a slot too
+    const SubsysQuery *watch;    // Compiled query whose matching systems the display lists, NULL for none
+    SubsysFeed *feed;            // Change feed over health, polled every pass, NULL for none
+    SnapshotSeq snapshot_seq;    // Commit counters shared by every writer of amounts and statuses
+    Rcu rcu;                     // Grace periods for systems changed while running
+    SnapshotFrame frame;         // Latest consistent snapshot, read by the display and the headless stream
+    LatencyHistogram queue_latency[PRIORITY_HIGH + 1];   // Report-to-handling wait, indexed by priority
+    LatencyHistogram handle_latency[PRIORITY_HIGH + 1];  // Time spent handling, indexed by priority
+    SimClock clock;              // Virtual clock shared by systems that point at it
+    Shutdown shutdown;           // Wakes the system threads when they are terminated
+    int quiet;                   // non-zero to skip the display and per-event output
+    OutputStream *stream;        // Headless record output replacing the display, NULL for the terminal
+    int outcome;                 // OUTCOME_* reached by the simulation
+    time_t last_display_time;    // When the display was last refreshed
+    const char *checkpoint_path; // Saved by manager_checkpoint_poll, NULL for none
+    long long checkpoint_next_ns;    // Monotonic time the next checkpoint is due
 } Manager;
 
+// What the single-thread scheduler did over a run
+typedef struct SchedulerStats {
+    unsigned long long steps;   // System steps executed
+    long long late_max_us;      // Worst delay between a deadline and its step
+    long long late_total_us;    // Sum of those delays, for the mean
+    long long manager_ns;       // Time spent in manager_run
+} SchedulerStats;
+
+// Header of the shared-memory segment of a multi-process run
+// Nothing in the segment is a pointer, every link is a byte offset from the header or an array index,
+// so the segment means the same in every process whatever address it is mapped at
+typedef struct SharedHeader {
+    unsigned int magic;             // SHARED_MAGIC
+    int resource_count;
+    int system_count;
+    int workers;
+    unsigned long size;             // Bytes in the segment
+    unsigned long resources;        // Offset of the SharedResource array
+    unsigned long systems;          // Offset of the SharedSystem array
+    unsigned long channels;         // Offset of the SharedChannel array, one per system
+    int terminated;                 // Futex word, set and woken by the manager process to stop every worker
+} SharedHeader;
+
+// A resource in the segment, its amount is only ever changed by single atomic operations
+typedef struct SharedResource {
+    _Alignas(CACHE_LINE) int amount;
+    int max_capacity;
+} SharedResource;
+
+// A system's control state in the segment, resources are referred to by index, -1 for none
+typedef struct SharedSystem {
+    int consumed;
+    int consumed_amount;
+    int produced;
+    int produced_amount;
+    int processing_time;
+    int worker;                     // Worker process running the system
+    _Alignas(CACHE_LINE) int status;         // Written by the manager process
+    _Alignas(CACHE_LINE) int amount_stored;  // Everything from here is written by the worker
+    int phase;
+    long long resume_us;            // Wait a restored checkpoint was in, waited out before the first step
+    unsigned long conversions;
+} SharedSystem;
+
+// An event in the segment, the system and resource are indices
+typedef struct SharedEvent {
+    int system;
+    int resource;
+    int status;
+    int priority;
+    int amount;
+    long long push_ns;
+} SharedEvent;
+
+// Single-producer/single-consumer ring from one system in a worker to the manager process
+// Like EventChannel, head is only written by the manager and tail only by the system
+typedef struct SharedChannel {
+    _Alignas(CACHE_LINE) unsigned int head;
+    _Alignas(CACHE_LINE) unsigned int tail;
+    unsigned long dropped;          // Low priority events discarded because the ring was full
+    SharedEvent slots[SHARED_CHANNEL_CAPACITY];
+} SharedChannel;
+
+// What a multi-process run did
+typedef struct ProcessStats {
+    int workers;                    // Worker processes forked
+    int crashed;                    // Workers that died before the run stopped them
+    unsigned long long conversions; // Processing cycles completed by every system
+    unsigned long long events;      // Events taken from the shared channels
+    unsigned long long dropped;     // Low priority events the channels had no room for
+    unsigned long long rejected;    // Events with out-of-range fields, never handed to the manager
+    long long elapsed_ns;           // Wall-clock time from forking the workers to stopping them
+} ProcessStats;
+
+// Where the threads of a threaded run are pinned, systems sharing resources are kept on the same core
+typedef struct Placement {
+    int *cpus;              // Usable CPUs ordered by package then core, so the CPUs of a core are adjacent
+    int cpu_count;
+    int *core_first;        // Index in `cpus` of each core's first CPU, `core_count` + 1 entries
+    int core_count;
+    int manager_core;       // Core kept for the manager thread, -1 when there is only one core
+    int *system_core;       // Core of each system, indexed like the system array
+    int system_count;
+    int shared_planned;     // Extra cores each resource is touched from, summed, with this placement
+    int shared_spread;      // The same with the systems dealt round-robin over the cores
+} Placement;
+
+// Counters of what the threads of a run cost the memory system, -1 where the kernel does not provide them
+typedef struct TrafficCounters {
+    int cache_fd;                   // perf event descriptors, -1 if unavailable
+    int migration_fd;
+    long long cache_misses;         // Last-level cache misses in user space
+    long long migrations;           // Times a thread was moved to another CPU
+} TrafficCounters;
+
+// What a deterministic run did, the digest identifies the run's trajectory
+typedef struct DeterministicStats {
+    unsigned long long epochs;
+    unsigned long long rounds;      // Barrier-separated gather/commit/complete rounds
+    unsigned long long steps;       // System steps executed
+    unsigned long long events;      // Events queued for the manager
+    unsigned long long digest;      // FNV-1a of every amount and status at the end of every epoch
+    long long virtual_us;           // Virtual time simulated
+} DeterministicStats;
+
+// Parameters of a generated topology
+typedef struct TopologyParams {
+    int systems;
+    int resources;
+    int degree;             // Resources each system picks its input from, sets how far fan-out reaches
+    unsigned int seed;
+} TopologyParams;
+
+// Parameters for the four-system rocket scenario
+typedef struct RocketParams {
+    int fuel, fuel_capacity;
+    int oxygen, oxygen_capacity;
+    int energy, energy_capacity;
+    int distance_capacity;
+    int propulsion_time;
+    int life_support_time;
+    int crew_time;
+    int generator_time;
+} RocketParams;
+
 // Manager functions
 void manager_init(Manager *manager);
 void manager_clean(Manager *manager);
 void manager_run(Manager *manager);
+void manager_health_attach(Manager *manager);
+int manager_feed_attach(Manager *manager, SubsysFeed *feed, unsigned char mask);
+void manager_channels_attach(Manager *manager);
+
+// Live change functions, safe while the simulation runs
+System *manager_system_create_live(Manager *manager, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time);
+int manager_system_add_live(Manager *manager, System *system);
+int manager_system_remove_live(Manager *manager, System **systems, int count);
+void manager_reclaim(Manager *manager);
+
+// RCU functions
+void rcu_init(Rcu *rcu);
+void rcu_clean(Rcu *rcu);
+int rcu_register(Rcu *rcu);
+void rcu_unregister(Rcu *rcu, int slot);
+void rcu_quiescent(Rcu *rcu, int slot);
+void rcu_lock(Rcu *rcu);
+void rcu_unlock(Rcu *rcu);
+void rcu_retire(Rcu *rcu, int kind, void *object, int owned);
+void rcu_reclaim(Rcu *rcu);
+
+// Arena functions
+void arena_init(Arena *arena);
+void arena_free(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size, size_t align);
+char *arena_intern(Arena *arena, const char *name);
+size_t arena_bytes(const Arena *arena);
+
+// Snapshot functions
+void manager_snapshot_attach(Manager *manager);
+void manager_snapshot(Manager *manager, SnapshotFrame *frame);
+void snapshot_seq_init(SnapshotSeq *seq);
+void snapshot_commit_begin(SnapshotSeq *seq);
+void snapshot_commit_end(SnapshotSeq *seq);
+void snapshot_step_begin(SnapshotSeq *seq);
+int snapshot_barrier_raise(SnapshotSeq *seq, long long timeout_us);
+void snapshot_barrier_lower(SnapshotSeq *seq);
+void snapshot_frame_init(SnapshotFrame *frame);
+void snapshot_frame_clean(SnapshotFrame *frame);
+
+// Latency functions
+long long latency_now_ns(void);
+void latency_histogram_init(LatencyHistogram *histogram);
+void latency_histogram_record(LatencyHistogram *histogram, long long value_ns);
+long long latency_histogram_percentile(const LatencyHistogram *histogram, double percentile);
+void manager_latency_print(const Manager *manager);
+
+// Trace functions, only built with `make TRACE=1` so spans cost nothing otherwise
+#ifdef ENABLE_TRACE
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_thread_name(const char *name);
+int trace_write(const char *path);
+#define TRACE_BEGIN(name)       trace_begin(name)
+#define TRACE_END(name)         trace_end(name)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_BEGIN(name)       ((void)0)
+#define TRACE_END(name)         ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+// Headless output functions
+int output_stream_start(OutputStream *stream, int format, const char *path);
+void output_stream_stop(OutputStream *stream);
+void output_stream_event(OutputStream *stream, const Event *event);
+void output_stream_snapshot(OutputStream *stream, Manager *manager);
+void output_stream_iteration(OutputStream *stream, int iteration);
+
+// Scheduler functions
+void manager_run_scheduled(Manager *manager, long long limit_us, SchedulerStats *stats);
+
+// Deterministic parallel functions
+int manager_run_deterministic(Manager *manager, int workers, long long epoch_us, long long limit_us, DeterministicStats *stats);
+
+// Shared-memory multi-process functions
+int manager_run_processes(Manager *manager, int workers, int crash_worker, ProcessStats *stats);
+
+// Placement functions
+int placement_plan(Placement *placement, Manager *manager);
+int placement_attr(const Placement *placement, int core, pthread_attr_t *attr);
+int placement_pin_self(const Placement *placement, int core);
+void placement_print(const Placement *placement, Manager *manager);
+void placement_clean(Placement *placement);
+void traffic_counters_start(TrafficCounters *counters);
+void traffic_counters_stop(TrafficCounters *counters);
+
+// Cluster functions
+void manager_clusters_start(Manager *manager, int cluster_size);
+void manager_clusters_stop(Manager *manager);
+void manager_clusters_clean(Manager *manager);
+
+// Clock functions
+void sim_clock_init(SimClock *clock, int virtual_time);
+void sim_clock_pace(SimClock *clock, SystemPacing *pacing, long long duration_us);
+int sim_clock_sleep_paced(SimClock *clock, Shutdown *shutdown, SystemPacing *pacing, long long duration_us);
+void shutdown_init(Shutdown *shutdown);
+void shutdown_signal(Shutdown *shutdown);
+int shutdown_sleep(Shutdown *shutdown, long long duration_us);
+void shutdown_clean(Shutdown *shutdown);
+void pacing_init(SystemPacing *pacing);
+void pacing_record(SystemPacing *pacing, long long deadline_ns, long long wake_ns);
+void manager_pacing_print(const Manager *manager);
+
+// Resource time-series functions
+ResourceSeries *series_create(long long interval_ns);
+void series_destroy(ResourceSeries *series);
+void series_sample(ResourceSeries *series, long long now_ns, int amount);
+int series_query(const ResourceSeries *series, long long window_ns, SeriesStats *stats);
+void manager_series_attach(Manager *manager, int interval_ms);
+void manager_series_sample(Manager *manager);
+void manager_series_print(const Manager *manager);
+void manager_series_clean(Manager *manager);
+
+// Scenario functions
+void rocket_params_default(RocketParams *params);
+void scenario_load_rocket(Manager *manager, const RocketParams *params);
+void scenario_generate(Manager *manager, const TopologyParams *params);
+
+// Contention benchmark functions
+int contention_main(int argc, char *argv[]);
+
+// Sweep functions
+int sweep_main(int argc, char *argv[]);
+
+// Scaling harness functions
+int scale_main(int argc, char *argv[]);
+
+// Checkpoint functions
+int manager_checkpoint_save(Manager *manager, const char *path);
+int manager_checkpoint_restore(Manager *manager, const char *path);
+void manager_checkpoint_poll(Manager *manager);
 
 // System functions
 void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
+void system_arena_create(System **system, Arena *arena, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
+void system_arena_reuse(System *system, Arena *arena, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
 void system_destroy(System *system);
 void system_run(System *system);
+long long system_step(System *system);
+void system_step_request(System *system, SystemRequest *request);
+void system_request_commit(SystemRequest *request, SnapshotSeq *seq);
+long long system_step_complete(System *system, SystemRequest *request);
+void *system_thread(void *arg);
 
 // Resource functions
 void resource_create(Resource **resource, const char *name, int amount, int max_capacity);
+void resource_arena_create(Resource **resource, Arena *arena, const char *name, int amount, int max_capacity);
 void resource_destroy(Resource *resource);
 
 // ResourceAmount functions
@@ -116,18 +716,34 @@ void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, i
 
 // Event functions
 void event_init(Event *event, System *system, Resource *resource, int status, int priority, int amount);
+int event_target_status(const Event *event);
 
 // EventQueue functions
 void event_queue_init(EventQueue *queue);
 void event_queue_clean(EventQueue *queue);
 void event_queue_push(EventQueue *queue, const Event *event); 
 int event_queue_pop(EventQueue *queue, Event* event);
+void event_queue_set_capacity(EventQueue *queue, int capacity, int policy);
+int event_queue_try_push(EventQueue *queue, const Event *event);
+void event_queue_close(EventQueue *queue);
+
+// EventChannel functions
+int event_channel_init(EventChannel *channel, unsigned int capacity, unsigned long long *active, int index);
+void event_channel_clean(EventChannel *channel);
+int event_channel_push(EventChannel *channel, const Event *event);
+int event_channel_peek(EventChannel *channel, Event *event);
+int event_channel_pop(EventChannel *channel, Event *event);
 
 // Dynamic array functions for systems and resources
 void system_array_init(SystemArray *array);
+void system_array_init_arena(SystemArray *array, Arena *arena);
 void system_array_clean(SystemArray *array);
 void system_array_add(SystemArray *array, System *system);
+int system_array_remove(SystemArray *array, System **systems, int count);
+System **system_array_read(SystemArray *array, int *size);
 
 void resource_array_init(ResourceArray *array);
+void resource_array_init_arena(ResourceArray *array, Arena *arena);
 void resource_array_clean(ResourceArray *array);
-void resource_array_add(ResourceArray *array, Resource *resource);
\ No newline at end of file
+void resource_array_add(ResourceArray *array, Resource *resource);
+Resource **resource_array_read(ResourceArray *array, int *size);
\ No newline at end of file
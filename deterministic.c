@@ -0,0 +1,282 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define DETERMINISTIC_MAX_ROUNDS 64     // Rounds per epoch, systems still due carry over to the next epoch
+
+// State shared by the workers of a deterministic run
+typedef struct DeterministicRun {
+    Manager *manager;
+    int workers;
+    System **systems;           // Fixed for the run, indexed by system ID
+    int count;
+    long long *due_us;          // Virtual time each system's next step is due
+    int *active;                // non-zero until the system is terminated
+    SystemRequest *requests;    // Each system's request of the current round
+    long long *waits;           // Wait each system's completed step asked for
+    int *due;                   // IDs of the systems stepping this round, ascending
+    int due_count;
+    int running;                // Cleared by the coordinator to stop the workers
+    sem_t gate;                 // Holds the workers until the barrier is sized to the threads that started
+    pthread_barrier_t barrier;
+} DeterministicRun;
+
+// One worker thread
+typedef struct DeterministicWorker {
+    DeterministicRun *run;
+    int index;
+    pthread_t thread;
+} DeterministicWorker;
+
+static void deterministic_round(DeterministicRun *run, int index);
+static void *deterministic_worker(void *arg);
+static unsigned long long deterministic_digest(unsigned long long digest, Manager *manager, long long now_us);
+static unsigned long long deterministic_fold(unsigned long long digest, int value);
+
+/**
+ * Runs the simulation in parallel with an outcome that never depends on thread timing.
+ *
+ * Virtual time advances in epochs of `epoch_us`. Every system due within the epoch steps in a
+ * round of three phases separated by barriers: the workers gather each system's resource request
+ * in parallel, commit them with each resource owned by one worker which applies its requests in
+ * system ID order, then complete the steps in parallel. Events are queued in system ID order after
+ * the round, and the manager handles them every `MANAGER_WAIT_TIME` of virtual time, so its
+ * reactions are ordered too. The result is the same for any run and any number of workers.
+ * Systems added or removed while running are not picked up.
+ *
+ * @param[in,out] manager   Pointer to the loaded `Manager`, its systems must use the shared queue.
+ * @param[in]     workers   Threads sharing the work, including the calling one.
+ * @param[in]     epoch_us  Virtual length of an epoch, coarser epochs batch more systems per round.
+ * @param[in]     limit_us  Virtual time after which the run is stopped, 0 to run until a terminal condition.
+ * @param[out]    stats     Pointer to the `DeterministicStats` to fill.
+ * @return                  0 on success, -1 if the run could not be set up.
+ */
+int manager_run_deterministic(Manager *manager, int workers, long long epoch_us, long long limit_us, DeterministicStats *stats) {
+    DeterministicRun run;
+    DeterministicWorker *threads;
+    long long now_us = 0, next_manager_us = 0, epoch_end_us;
+    int started = 1, rounds, remaining, i, k;
+
+    stats->epochs = 0;
+    stats->rounds = 0;
+    stats->steps = 0;
+    stats->events = 0;
+    stats->digest = 14695981039346656037ULL;
+    stats->virtual_us = 0;
+
+    run.manager = manager;
+    run.workers = workers > 0 ? workers : 1;
+    run.systems = system_array_read(&manager->system_array, &run.count);
+    run.due_us = calloc(run.count + 1, sizeof(long long));
+    run.active = calloc(run.count + 1, sizeof(int));
+    run.requests = malloc(sizeof(SystemRequest) * (run.count + 1));
+    run.waits = calloc(run.count + 1, sizeof(long long));
+    run.due = malloc(sizeof(int) * (run.count + 1));
+    run.due_count = 0;
+    run.running = 1;
+    threads = malloc(sizeof(DeterministicWorker) * run.workers);
+
+    if (run.due_us == NULL || run.active == NULL || run.requests == NULL || run.waits == NULL ||
+        run.due == NULL || threads == NULL) {
+        free(run.due_us);
+        free(run.active);
+        free(run.requests);
+        free(run.waits);
+        free(run.due);
+        free(threads);
+        return -1;
+    }
+
+    for (i = 0; i < run.count; i++) {
+        run.active[i] = __atomic_load_n(&run.systems[i]->status, __ATOMIC_RELAXED) != TERMINATE;
+        // A restored system finishes the wait it was checkpointed in first
+        run.due_us[i] = run.systems[i]->resume_us;
+        run.systems[i]->resume_us = 0;
+        // Events are kept in the request and queued in ID order once the round is over
+        run.requests[i].defer_event = 1;
+    }
+
+    // The calling thread is worker 0, a worker that fails to start just leaves fewer to share the work
+    sem_init(&run.gate, 0, 0);
+    for (i = 1; i < run.workers; i++) {
+        threads[started].run = &run;
+        threads[started].index = started;
+        if (pthread_create(&threads[started].thread, NULL, deterministic_worker, &threads[started]) == 0) {
+            started++;
+        }
+    }
+    run.workers = started;
+    pthread_barrier_init(&run.barrier, NULL, run.workers);
+    for (i = 1; i < run.workers; i++) {
+        sem_post(&run.gate);
+    }
+
+    TRACE_THREAD_NAME("Deterministic coordinator");
+    while (manager->simulation_running && (limit_us == 0 || now_us < limit_us)) {
+        epoch_end_us = now_us + epoch_us;
+
+        for (rounds = 0; rounds < DETERMINISTIC_MAX_ROUNDS; rounds++) {
+            // Systems due in this epoch, in ID order; terminated ones leave at the start of a pass
+            run.due_count = 0;
+            remaining = 0;
+            for (i = 0; i < run.count; i++) {
+                if (!run.active[i]) {
+                    continue;
+                }
+                if (run.systems[i]->phase == SYSTEM_PHASE_START &&
+                    __atomic_load_n(&run.systems[i]->status, __ATOMIC_RELAXED) == TERMINATE) {
+                    run.active[i] = 0;
+                    continue;
+                }
+                remaining++;
+                if (run.due_us[i] < epoch_end_us) {
+                    run.due[run.due_count++] = i;
+                }
+            }
+            if (run.due_count == 0) {
+                break;
+            }
+
+            pthread_barrier_wait(&run.barrier);
+            deterministic_round(&run, 0);
+
+            for (k = 0; k < run.due_count; k++) {
+                i = run.due[k];
+                run.due_us[i] += run.waits[i];
+                if (run.requests[i].has_event) {
+                    event_queue_push(&manager->event_queue, &run.requests[i].event);
+                    stats->events++;
+                }
+            }
+            stats->rounds++;
+            stats->steps += run.due_count;
+        }
+
+        now_us = epoch_end_us;
+        if (now_us >= next_manager_us) {
+            manager_run(manager);
+            next_manager_us = now_us + MANAGER_WAIT_TIME * 1000;
+        }
+        stats->digest = deterministic_digest(stats->digest, manager, now_us);
+        stats->epochs++;
+
+        if (rounds == 0 && remaining == 0) {
+            break;
+        }
+    }
+    stats->virtual_us = now_us;
+
+    run.running = 0;
+    pthread_barrier_wait(&run.barrier);
+    for (i = 1; i < run.workers; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    pthread_barrier_destroy(&run.barrier);
+    sem_destroy(&run.gate);
+    free(run.due_us);
+    free(run.active);
+    free(run.requests);
+    free(run.waits);
+    free(run.due);
+    free(threads);
+    return 0;
+}
+
+/**
+ * Runs one worker's share of a round, between the barrier that started it and the one that ends it.
+ *
+ * Requests and completions only touch the system's own fields, so the workers take contiguous
+ * slices of the due list. Commits are split by resource instead, each worker applying the requests
+ * on the resources it owns in due-list order, which is system ID order.
+ *
+ * @param[in,out] run    Pointer to the `DeterministicRun`.
+ * @param[in]     index  Index of the calling worker.
+ */
+static void deterministic_round(DeterministicRun *run, int index) {
+    int first = (int)((long long)run->due_count * index / run->workers);
+    int last = (int)((long long)run->due_count * (index + 1) / run->workers);
+    int k, i;
+
+    for (k = first; k < last; k++) {
+        i = run->due[k];
+        system_step_request(run->systems[i], &run->requests[i]);
+    }
+    pthread_barrier_wait(&run->barrier);
+
+    for (k = 0; k < run->due_count; k++) {
+        SystemRequest *request = &run->requests[run->due[k]];
+        if (request->kind != SYSTEM_REQUEST_NONE &&
+            (int)(((uintptr_t)request->resource / sizeof(Resource)) % run->workers) == index) {
+            system_request_commit(request, &run->manager->snapshot_seq);
+        }
+    }
+    pthread_barrier_wait(&run->barrier);
+
+    for (k = first; k < last; k++) {
+        i = run->due[k];
+        run->waits[i] = system_step_complete(run->systems[i], &run->requests[i]);
+    }
+    pthread_barrier_wait(&run->barrier);
+}
+
+/**
+ * Worker thread body, runs its share of every round until the coordinator stops the run.
+ *
+ * @param[in,out] arg  Pointer to the `DeterministicWorker`.
+ * @return             NULL.
+ */
+static void *deterministic_worker(void *arg) {
+    DeterministicWorker *worker = (DeterministicWorker*)arg;
+    DeterministicRun *run = worker->run;
+
+    TRACE_THREAD_NAME("Deterministic worker");
+    sem_wait(&run->gate);
+    for (;;) {
+        // Released by the coordinator once the round's due list is ready, or the run is over
+        pthread_barrier_wait(&run->barrier);
+        if (!run->running) {
+            break;
+        }
+        deterministic_round(run, worker->index);
+    }
+    return NULL;
+}
+
+/**
+ * Folds the state at the end of an epoch into a running FNV-1a digest.
+ *
+ * Two runs with the same digest went through the same amounts and statuses at every epoch.
+ *
+ * @param[in] digest   Digest so far.
+ * @param[in] manager  Pointer to the `Manager`, no system may be stepping.
+ * @param[in] now_us   Virtual time at the end of the epoch.
+ * @return             The new digest.
+ */
+static unsigned long long deterministic_digest(unsigned long long digest, Manager *manager, long long now_us) {
+    int i;
+
+    digest = deterministic_fold(digest, (int)(now_us / 1000));
+    for (i = 0; i < manager->resource_array.size; i++) {
+        digest = deterministic_fold(digest, manager->resource_array.resources[i]->amount);
+    }
+    for (i = 0; i < manager->system_array.size; i++) {
+        digest = deterministic_fold(digest, manager->system_array.systems[i]->status);
+    }
+    return digest;
+}
+
+/**
+ * Folds the four bytes of a value into an FNV-1a digest, lowest byte first.
+ *
+ * @param[in] digest  Digest so far.
+ * @param[in] value   Value to fold in.
+ * @return            The new digest.
+ */
+static unsigned long long deterministic_fold(unsigned long long digest, int value) {
+    for (int b = 0; b < 4; b++) {
+        digest ^= (unsigned char)((unsigned int)value >> (8 * b));
+        digest *= 1099511628211ULL;
+    }
+    return digest;
+}
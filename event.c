@@ -1,6 +1,8 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <string.h>
 
 /* Event functions */
 
@@ -8,6 +10,7 @@
  * Initializes an `Event` structure.
  *
  * Sets up an `Event` with the provided system, resource, status, priority, and amount.
+ * Events are reported right after they are initialized, so this also stamps the report time.
  *
  * @param[out] event     Pointer to the `Event` to initialize.
  * @param[in]  system    Pointer to the `System` that generated the event.
@@ -22,19 +25,77 @@ void event_init(Event *event, System *system, Resource *resource, int status, in
     event->status = status;
     event->priority = priority;
     event->amount = amount;
+    event->push_ns = latency_now_ns();
+}
+
+/**
+ * Works out how the systems producing an event's resource should react to it.
+ *
+ * Running out of Oxygen or reaching the Distance capacity ends the simulation, a resource that is
+ * low, empty or insufficient needs its producers sped up, and one at capacity needs them slowed down.
+ *
+ * @param[in] event  Pointer to the `Event`.
+ * @return           `TERMINATE` for every system, `FAST` or `SLOW` for the producers of the event's
+ *                   resource, or `STATUS_OK` if nothing should change.
+ */
+int event_target_status(const Event *event) {
+    int no_oxygen_flag        = (event->status == STATUS_EMPTY && strcmp(event->resource->name, "Oxygen") == 0);
+    int distance_reached_flag = (event->status == STATUS_CAPACITY && strcmp(event->resource->name, "Distance") == 0);
+
+    if (no_oxygen_flag || distance_reached_flag) {
+        return TERMINATE;
+    }
+    if (event->status == STATUS_LOW || event->status == STATUS_EMPTY || event->status == STATUS_INSUFFICIENT) {
+        return FAST;
+    }
+    if (event->status == STATUS_CAPACITY) {
+        return SLOW;
+    }
+    return STATUS_OK;
 }
 
 /* EventQueue functions */
 
+static void event_queue_insert(EventQueue *queue, EventNode *new_node);
+static int event_queue_overflow(EventQueue *queue, EventNode *new_node);
+static long long event_queue_now_us(void);
+
 /**
  * Initializes the `EventQueue`.
  *
  * Sets up the queue for use, initializing any necessary data (e.g., semaphores when threading).
+ * The queue starts unbounded, see `event_queue_set_capacity`.
  *
  * @param[out] queue  Pointer to the `EventQueue` to initialize.
  */
 void event_queue_init(EventQueue *queue) {
   queue->head = NULL;
+  queue->size = 0;
+  sem_init(&queue->mutex, 0, 1);
+  queue->capacity = 0;
+  queue->policy = OVERFLOW_DROP_LOWEST;
+  queue->closed = 0;
+  queue->waiters = 0;
+  sem_init(&queue->space, 0, 0);
+  queue->dropped = 0;
+  queue->evicted = 0;
+  queue->merged = 0;
+  queue->waits = 0;
+  queue->wait_us = 0;
+}
+
+/**
+ * Bounds the `EventQueue` and selects what happens when it is full.
+ *
+ * @param[in,out] queue     Pointer to the `EventQueue`.
+ * @param[in]     capacity  Maximum number of queued events, 0 for unbounded.
+ * @param[in]     policy    `OVERFLOW_BLOCK`, `OVERFLOW_DROP_LOWEST` or `OVERFLOW_MERGE`.
+ */
+void event_queue_set_capacity(EventQueue *queue, int capacity, int policy) {
+  sem_wait(&queue->mutex);
+  queue->capacity = capacity > 0 ? capacity : 0;
+  queue->policy = policy;
+  sem_post(&queue->mutex);
 }
 
 /**
@@ -52,23 +113,114 @@ void event_queue_clean(EventQueue *queue) {
       current = next;
   }
   queue->head = NULL;
+  queue->size = 0;
+  sem_destroy(&queue->mutex);
+  sem_destroy(&queue->space);
+}
+
+/**
+ * Marks the `EventQueue` as no longer consumed.
+ *
+ * Wakes every producer waiting for room. From then on a full queue drops new events
+ * instead of waiting, so system threads can always finish.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ */
+void event_queue_close(EventQueue *queue) {
+  sem_wait(&queue->mutex);
+  queue->closed = 1;
+  while (queue->waiters > 0) {
+      queue->waiters--;
+      sem_post(&queue->space);
+  }
+  sem_post(&queue->mutex);
 }
 
 /**
  * Pushes an `Event` onto the `EventQueue`.
  *
  * Adds the event to the queue in a thread-safe manner, maintaining priority order (highest first).
+ * When the queue is full the overflow policy decides whether the producer waits, an event is
+ * dropped, or the event is merged; waiting time is added to the queue's counters.
  *
  * @param[in,out] queue  Pointer to the `EventQueue`.
  * @param[in]     event  Pointer to the `Event` to push onto the queue.
  */
 void event_queue_push(EventQueue *queue, const Event *event) {
   EventNode *new_node = malloc(sizeof(EventNode));
+  if (new_node == NULL) {
+      return;
+  }
+  new_node->event = *event;
+  new_node->next = NULL;
+
+  sem_wait(&queue->mutex);
+
+  while (queue->capacity > 0 && queue->size >= queue->capacity) {
+      // The policy either dealt with the event or needs the producer to wait for room
+      if (event_queue_overflow(queue, new_node)) {
+          sem_post(&queue->mutex);
+          return;
+      }
+
+      long long start = event_queue_now_us();
+      queue->waiters++;
+      queue->waits++;
+      sem_post(&queue->mutex);
+      sem_wait(&queue->space);
+      sem_wait(&queue->mutex);
+      queue->wait_us += event_queue_now_us() - start;
+  }
+
+  event_queue_insert(queue, new_node);
+  sem_post(&queue->mutex);
+}
+
+/**
+ * Pushes an `Event` onto the `EventQueue` only if there is room.
+ *
+ * Never applies the overflow policy and never waits, for consumers that feed the queue themselves.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[in]     event  Pointer to the `Event` to push onto the queue.
+ * @return               `STATUS_OK` if pushed, or `STATUS_CAPACITY` if the queue is full.
+ */
+int event_queue_try_push(EventQueue *queue, const Event *event) {
+  EventNode *new_node;
+
+  sem_wait(&queue->mutex);
+  if (queue->capacity > 0 && queue->size >= queue->capacity) {
+      sem_post(&queue->mutex);
+      return STATUS_CAPACITY;
+  }
+  sem_post(&queue->mutex);
+
+  // Only the consumer pushes this way, so the room checked above is still there
+  new_node = malloc(sizeof(EventNode));
+  if (new_node == NULL) {
+      return STATUS_CAPACITY;
+  }
   new_node->event = *event;
   new_node->next = NULL;
 
+  sem_wait(&queue->mutex);
+  event_queue_insert(queue, new_node);
+  sem_post(&queue->mutex);
+  return STATUS_OK;
+}
+
+/**
+ * Inserts a node in priority order (highest first, oldest first within a priority).
+ * The caller must hold the queue's mutex.
+ *
+ * @param[in,out] queue     Pointer to the `EventQueue`.
+ * @param[in]     new_node  Node to insert.
+ */
+static void event_queue_insert(EventQueue *queue, EventNode *new_node) {
+  queue->size++;
+
   // If queue is empty or new event has higher priority than head
-  if (queue->head == NULL || queue->head->event.priority < event->priority) {
+  if (queue->head == NULL || queue->head->event.priority < new_node->event.priority) {
       new_node->next = queue->head;
       queue->head = new_node;
       return;
@@ -77,7 +229,7 @@ void event_queue_push(EventQueue *queue, const Event *event) {
   // Find the insertion point
   EventNode *current = queue->head;
   while (current->next != NULL && 
-         current->next->event.priority >= event->priority) {
+         current->next->event.priority >= new_node->event.priority) {
       current = current->next;
   }
 
@@ -86,6 +238,85 @@ void event_queue_push(EventQueue *queue, const Event *event) {
   current->next = new_node;
 }
 
+/**
+ * Applies the overflow policy to a node that does not fit in the full queue.
+ * The caller must hold the queue's mutex.
+ *
+ * Merging folds the node into a queued event from the same system about the same resource and
+ * status, keeping the newest amount. Eviction removes the lowest priority (newest) queued event.
+ * PRIORITY_HIGH events are never discarded, if neither is possible the producer has to wait.
+ *
+ * @param[in,out] queue     Pointer to the `EventQueue`.
+ * @param[in]     new_node  Node that does not fit, freed or inserted when handled.
+ * @return                  Non-zero if the node was handled, zero if the producer must wait.
+ */
+static int event_queue_overflow(EventQueue *queue, EventNode *new_node) {
+  Event *event = &new_node->event;
+  EventNode *current, *match = NULL, *before_tail = NULL, *tail = queue->head;
+
+  // Nobody consumes a closed queue anymore, waiting would never end
+  if (queue->closed) {
+      queue->dropped++;
+      free(new_node);
+      return 1;
+  }
+
+  if (queue->policy == OVERFLOW_BLOCK) {
+      return 0;
+  }
+
+  for (current = queue->head; current != NULL; current = current->next) {
+      if (match == NULL && current->event.system == event->system &&
+          current->event.resource == event->resource && current->event.status == event->status) {
+          match = current;
+      }
+      if (current->next != NULL) {
+          before_tail = current;
+      }
+      tail = current;
+  }
+
+  // Merging is tried first under OVERFLOW_MERGE, and last for high priority events under OVERFLOW_DROP_LOWEST
+  if (match != NULL && (queue->policy == OVERFLOW_MERGE || tail->event.priority >= event->priority)) {
+      match->event.amount = event->amount;
+      queue->merged++;
+      free(new_node);
+      return 1;
+  }
+
+  if (tail != NULL && tail->event.priority < event->priority) {
+      if (before_tail == NULL) {
+          queue->head = NULL;
+      } else {
+          before_tail->next = NULL;
+      }
+      free(tail);
+      queue->size--;
+      queue->evicted++;
+      event_queue_insert(queue, new_node);
+      return 1;
+  }
+
+  if (event->priority < PRIORITY_HIGH) {
+      queue->dropped++;
+      free(new_node);
+      return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Current time in microseconds.
+ */
+static long long event_queue_now_us(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
 /**
  * Pops an `Event` from the `EventQueue`.
  *
@@ -96,7 +327,9 @@ void event_queue_push(EventQueue *queue, const Event *event) {
  * @return               Non-zero if an event was successfully popped; zero otherwise.
  */
 int event_queue_pop(EventQueue *queue, Event *event) {
+  sem_wait(&queue->mutex);
   if (queue->head == NULL) {
+    sem_post(&queue->mutex);
     return STATUS_EMPTY;  // Queue is empty
   }
 
@@ -106,7 +339,122 @@ int event_queue_pop(EventQueue *queue, Event *event) {
   // Remove the head node
   EventNode *temp = queue->head;
   queue->head = queue->head->next;
+  queue->size--;
+
+  // Hand the freed slot to a waiting producer
+  if (queue->waiters > 0) {
+    queue->waiters--;
+    sem_post(&queue->space);
+  }
+  sem_post(&queue->mutex);
   free(temp);
 
   return STATUS_OK;  // Successfully popped event
 }
+
+/* EventChannel functions */
+
+/**
+ * Initializes an `EventChannel`.
+ *
+ * Allocates the ring and records which bit of the manager's non-empty bitmap belongs to the channel.
+ *
+ * @param[out] channel   Pointer to the `EventChannel` to initialize.
+ * @param[in]  capacity  Number of events the ring holds, must be a power of two.
+ * @param[in]  active    Pointer to the manager's non-empty bitmap.
+ * @param[in]  index     Index of the channel, selects its word and bit in the bitmap.
+ * @return               `STATUS_OK` if successful, or `STATUS_EMPTY` if the ring could not be allocated.
+ */
+int event_channel_init(EventChannel *channel, unsigned int capacity, unsigned long long *active, int index) {
+  channel->slots = malloc(sizeof(Event) * capacity);
+  if (channel->slots == NULL) {
+      return STATUS_EMPTY;
+  }
+
+  channel->mask = capacity - 1;
+  channel->head = 0;
+  channel->tail = 0;
+  channel->dropped = 0;
+  channel->active = &active[index / CHANNEL_WORD_BITS];
+  channel->bit = 1ULL << (index % CHANNEL_WORD_BITS);
+  return STATUS_OK;
+}
+
+/**
+ * Cleans up an `EventChannel`, discarding any events still in it.
+ *
+ * @param[in,out] channel  Pointer to the `EventChannel` to clean.
+ */
+void event_channel_clean(EventChannel *channel) {
+  free(channel->slots);
+  channel->slots = NULL;
+}
+
+/**
+ * Pushes an `Event` onto a system's `EventChannel`.
+ *
+ * Only the owning system may push. The event is published with a release store of the tail,
+ * then the channel's bit is set so the manager knows to look at it. Nothing ever blocks.
+ *
+ * @param[in,out] channel  Pointer to the `EventChannel`.
+ * @param[in]     event    Pointer to the `Event` to push.
+ * @return                 `STATUS_OK` if pushed, or `STATUS_CAPACITY` if the ring is full.
+ */
+int event_channel_push(EventChannel *channel, const Event *event) {
+  unsigned int tail = channel->tail;
+  unsigned int head = __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE);
+
+  if (tail - head > channel->mask) {
+      return STATUS_CAPACITY;
+  }
+
+  channel->slots[tail & channel->mask] = *event;
+  __atomic_store_n(&channel->tail, tail + 1, __ATOMIC_RELEASE);
+
+  // Set after the tail so a manager that clears the bit always sees the event
+  __atomic_fetch_or(channel->active, channel->bit, __ATOMIC_RELEASE);
+  return STATUS_OK;
+}
+
+/**
+ * Reads the oldest `Event` of an `EventChannel` without removing it.
+ *
+ * Only the manager may peek.
+ *
+ * @param[in]  channel  Pointer to the `EventChannel`.
+ * @param[out] event    Pointer to the `Event` structure to store the event.
+ * @return              Non-zero if an event was available; zero otherwise.
+ */
+int event_channel_peek(EventChannel *channel, Event *event) {
+  unsigned int head = channel->head;
+  unsigned int tail = __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE);
+
+  if (head == tail) {
+      return STATUS_EMPTY;
+  }
+
+  *event = channel->slots[head & channel->mask];
+  return STATUS_OK;
+}
+
+/**
+ * Pops the oldest `Event` from an `EventChannel`.
+ *
+ * Only the manager may pop.
+ *
+ * @param[in,out] channel  Pointer to the `EventChannel`.
+ * @param[out]    event    Pointer to the `Event` structure to store the popped event.
+ * @return                 Non-zero if an event was successfully popped; zero otherwise.
+ */
+int event_channel_pop(EventChannel *channel, Event *event) {
+  unsigned int head = channel->head;
+  unsigned int tail = __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE);
+
+  if (head == tail) {
+      return STATUS_EMPTY;
+  }
+
+  *event = channel->slots[head & channel->mask];
+  __atomic_store_n(&channel->head, head + 1, __ATOMIC_RELEASE);
+  return STATUS_OK;
+}
@@ -0,0 +1,145 @@
+#include "defs.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static int latency_bucket_index(long long value_ns);
+static long long latency_bucket_upper(int index);
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Current time in nanoseconds.
+ */
+long long latency_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Initializes an empty `LatencyHistogram`.
+ *
+ * @param[out] histogram  Pointer to the `LatencyHistogram` to initialize.
+ */
+void latency_histogram_init(LatencyHistogram *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+/**
+ * Records one latency sample.
+ *
+ * A count-leading-zeros, a shift and an increment, so it can stay enabled on the hot path.
+ * Only one thread may record into a histogram.
+ *
+ * @param[in,out] histogram  Pointer to the `LatencyHistogram`.
+ * @param[in]     value_ns   Latency in nanoseconds, negative values count as 0.
+ */
+void latency_histogram_record(LatencyHistogram *histogram, long long value_ns) {
+    if (value_ns < 0) {
+        value_ns = 0;
+    }
+
+    histogram->counts[latency_bucket_index(value_ns)]++;
+    histogram->total++;
+    if (value_ns > histogram->max) {
+        histogram->max = value_ns;
+    }
+}
+
+/**
+ * Estimates a percentile of the recorded latencies.
+ *
+ * Returns the upper bound of the bucket holding the percentile, capped at the exact maximum.
+ *
+ * @param[in] histogram   Pointer to the `LatencyHistogram`.
+ * @param[in] percentile  Percentile between 0 and 100 (e.g. 99.9).
+ * @return                The latency in nanoseconds, 0 if nothing was recorded.
+ */
+long long latency_histogram_percentile(const LatencyHistogram *histogram, double percentile) {
+    unsigned long long target, seen = 0;
+    long long upper;
+
+    if (histogram->total == 0) {
+        return 0;
+    }
+
+    // The rank of the sample we want, at least the first one
+    target = (unsigned long long)(percentile / 100.0 * histogram->total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            upper = latency_bucket_upper(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * Prints the queueing and handling latency percentiles of every priority that saw events.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ */
+void manager_latency_print(const Manager *manager) {
+    static const char *names[PRIORITY_HIGH + 1] = { "", "LOW", "MED", "HIGH" };
+
+    printf("%-6s %-8s %10s %12s %12s %12s %12s\n", "Prio", "Latency", "Events", "p50 us", "p99 us", "p999 us", "max us");
+    for (int priority = PRIORITY_HIGH; priority >= PRIORITY_LOW; priority--) {
+        const LatencyHistogram *histograms[2] = { &manager->queue_latency[priority], &manager->handle_latency[priority] };
+        static const char *kinds[2] = { "queued", "handling" };
+
+        for (int k = 0; k < 2; k++) {
+            if (histograms[k]->total == 0) {
+                continue;
+            }
+            printf("%-6s %-8s %10llu %12.1f %12.1f %12.1f %12.1f\n", names[priority], kinds[k], histograms[k]->total,
+                   latency_histogram_percentile(histograms[k], 50.0) / 1000.0,
+                   latency_histogram_percentile(histograms[k], 99.0) / 1000.0,
+                   latency_histogram_percentile(histograms[k], 99.9) / 1000.0,
+                   histograms[k]->max / 1000.0);
+        }
+    }
+}
+
+/**
+ * Maps a value to its bucket.
+ *
+ * Values below `LATENCY_SUB_COUNT` get a bucket each, above that every power of two is split into
+ * `LATENCY_SUB_COUNT` equal sub-buckets using the bits right below the leading one.
+ *
+ * @param[in] value_ns  Non-negative value.
+ * @return              Bucket index.
+ */
+static int latency_bucket_index(long long value_ns) {
+    unsigned long long value = (unsigned long long)value_ns;
+
+    if (value < LATENCY_SUB_COUNT) {
+        return (int)value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - LATENCY_SUB_BITS;
+    int sub = (int)((value >> shift) & (LATENCY_SUB_COUNT - 1));
+    return (shift + 1) * LATENCY_SUB_COUNT + sub;
+}
+
+/**
+ * Gives the largest value that maps to a bucket.
+ *
+ * @param[in] index  Bucket index.
+ * @return           Upper bound of the bucket.
+ */
+static long long latency_bucket_upper(int index) {
+    if (index < LATENCY_SUB_COUNT) {
+        return index;
+    }
+
+    int shift = index / LATENCY_SUB_COUNT - 1;
+    long long lower = (long long)(LATENCY_SUB_COUNT + index % LATENCY_SUB_COUNT) << shift;
+    return lower + (1LL << shift) - 1;
+}
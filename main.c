@@ -3,13 +3,268 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 
-void load_data(Manager *manager);
+static void run_threaded(Manager *manager, int shared_queue, int cluster_size, int place);
+static void print_queue_stats(const EventQueue *queue);
+static void print_channel_stats(const Manager *manager);
+static void write_trace(const char *path);
+static void stop_stream(Manager *manager);
+static void print_scheduler_stats(const SchedulerStats *stats);
+static void print_deterministic_stats(const Manager *manager, const DeterministicStats *stats, int workers);
+static void print_process_stats(const ProcessStats *stats);
 
-int main(void) {
+int main(int argc, char *argv[]) {
   Manager manager;
+  const char *checkpoint_path = NULL;
+  const char *restore_path = NULL;
+  const char *trace_path = NULL;
+  int threaded = 0;
+  int scheduled = 0;
+  SchedulerStats scheduler_stats;
+  int deterministic = 0;
+  int workers = 1;
+  long long epoch_us = DETERMINISTIC_EPOCH_US;
+  DeterministicStats deterministic_stats;
+  int processes = 0;
+  int crash_worker = -1;
+  ProcessStats process_stats;
+  int shared_queue = 0;
+  int place = 0;
+  int cluster_size = 0;
+  int queue_capacity = 0;
+  int overflow_policy = OVERFLOW_DROP_LOWEST;
+  int series_ms = 0;
+  const char *watch_text = NULL;
+  SubsysQuery watch;
+  int transitions = 0;
+  SubsysFeed feed;
+  int headless_format = -1;
+  const char *output_path = NULL;
+  OutputStream stream;
+
+  // --sweep hands the remaining arguments to the parameter sweep driver
+  if (argc > 1 && strcmp(argv[1], "--sweep") == 0) {
+      return sweep_main(argc - 1, argv + 1);
+  }
+
+  // --contention measures false sharing between the old and current Resource/System layouts
+  if (argc > 1 && strcmp(argv[1], "--contention") == 0) {
+      return contention_main(argc - 1, argv + 1);
+  }
+
+  // --scale runs generated topologies of growing size and reports how throughput scales
+  if (argc > 1 && strcmp(argv[1], "--scale") == 0) {
+      return scale_main(argc - 1, argv + 1);
+  }
+
+  // --checkpoint FILE saves the state after every iteration, --restore FILE resumes from one
+  for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+          checkpoint_path = argv[++i];
+      } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+          restore_path = argv[++i];
+      } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+          trace_path = argv[++i];
+      } else if (strcmp(argv[i], "--threaded") == 0) {
+          threaded = 1;
+      } else if (strcmp(argv[i], "--scheduled") == 0) {
+          scheduled = 1;
+      } else if (strcmp(argv[i], "--deterministic") == 0) {
+          deterministic = 1;
+      } else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+          processes = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--crash-worker") == 0 && i + 1 < argc) {
+          crash_worker = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+          workers = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--epoch-us") == 0 && i + 1 < argc) {
+          epoch_us = atoll(argv[++i]);
+      } else if (strcmp(argv[i], "--placement") == 0) {
+          place = 1;
+      } else if (strcmp(argv[i], "--shared-queue") == 0) {
+          shared_queue = 1;
+      } else if (strcmp(argv[i], "--cluster-size") == 0 && i + 1 < argc) {
+          cluster_size = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--queue-capacity") == 0 && i + 1 < argc) {
+          queue_capacity = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--overflow") == 0 && i + 1 < argc && strcmp(argv[i + 1], "block") == 0) {
+          overflow_policy = OVERFLOW_BLOCK;
+          i++;
+      } else if (strcmp(argv[i], "--overflow") == 0 && i + 1 < argc && strcmp(argv[i + 1], "drop") == 0) {
+          overflow_policy = OVERFLOW_DROP_LOWEST;
+          i++;
+      } else if (strcmp(argv[i], "--overflow") == 0 && i + 1 < argc && strcmp(argv[i + 1], "merge") == 0) {
+          overflow_policy = OVERFLOW_MERGE;
+          i++;
+      } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc && strcmp(argv[i + 1], "ndjson") == 0) {
+          headless_format = STREAM_NDJSON;
+          i++;
+      } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc && strcmp(argv[i + 1], "binary") == 0) {
+          headless_format = STREAM_BINARY;
+          i++;
+      } else if (strcmp(argv[i], "--series") == 0 && i + 1 < argc) {
+          series_ms = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+          watch_text = argv[++i];
+      } else if (strcmp(argv[i], "--transitions") == 0) {
+          transitions = 1;
+      } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+          output_path = argv[++i];
+      } else {
+          fprintf(stderr, "Usage: %s [--checkpoint FILE] [--restore FILE] [--trace FILE] [--series MS] [--watch QUERY] [--transitions]\n"
+                          "          [--threaded [--shared-queue] [--cluster-size N] [--placement] | --scheduled | --deterministic [--workers N] [--epoch-us N]\n"
+                          "           | --processes N [--crash-worker N]]\n"
+                          "          [--queue-capacity N] [--overflow block|drop|merge] [--headless ndjson|binary [--output FILE]]\n"
+                          "          | --sweep RUNS [options] | --scale N[,N]... [options] | --contention [options]\n", argv[0]);
+          return 1;
+      }
+  }
+
+  if (threaded + scheduled + deterministic + (processes != 0) > 1) {
+      fprintf(stderr, "--threaded, --scheduled, --deterministic and --processes are different execution modes, pick one\n");
+      return 1;
+  }
+
+  // Checkpoints are taken by the thread running the manager, behind a barrier that holds the system threads
+  // Sub-managers and worker processes run outside that barrier
+  if (checkpoint_path != NULL && (deterministic || processes != 0 || cluster_size > 0)) {
+      fprintf(stderr, "--checkpoint does not work with --deterministic, --processes or --cluster-size\n");
+      return 1;
+  }
+
+  if (processes < 0 || processes > SHARED_MAX_WORKERS) {
+      fprintf(stderr, "--processes must be between 1 and %d\n", SHARED_MAX_WORKERS);
+      return 1;
+  }
+
+  if (series_ms < 0) {
+      fprintf(stderr, "--series must be a positive number of milliseconds\n");
+      return 1;
+  }
+
+  if (watch_text != NULL && subsys_query_compile(&watch, watch_text) != ERR_SUCCESS) {
+      return 1;
+  }
+
+  if (workers <= 0 || epoch_us <= 0) {
+      fprintf(stderr, "--workers and --epoch-us must be positive\n");
+      return 1;
+  }
+
+#ifndef ENABLE_TRACE
+  if (trace_path != NULL) {
+      fprintf(stderr, "Tracing is compiled out, rebuild with 'make clean && make TRACE=1' to use --trace\n");
+      return 1;
+  }
+#endif
+  TRACE_THREAD_NAME("Manager");
+
   manager_init(&manager);
-  load_data(&manager);
+  if (restore_path != NULL) {
+      if (manager_checkpoint_restore(&manager, restore_path) != 0) {
+          fprintf(stderr, "Could not restore checkpoint '%s'\n", restore_path);
+          manager_clean(&manager);
+          return 1;
+      }
+  } else {
+      RocketParams params;
+      rocket_params_default(&params);
+      scenario_load_rocket(&manager, &params);
+  }
+  manager_health_attach(&manager);
+  manager_snapshot_attach(&manager);
+  if (series_ms > 0) {
+      manager_series_attach(&manager, series_ms);
+  }
+  if (watch_text != NULL) {
+      manager.watch = &watch;
+  }
+  if (transitions) {
+      manager_feed_attach(&manager, &feed, 1 << STATUS_ERROR | 1 << STATUS_POWER);
+  }
+  manager.checkpoint_path = checkpoint_path;
+
+  if (queue_capacity > 0) {
+      // Without threads the manager and the systems take turns, so a producer could never be woken
+      if (!threaded && overflow_policy == OVERFLOW_BLOCK) {
+          fprintf(stderr, "--overflow block requires --threaded\n");
+          manager_clean(&manager);
+          return 1;
+      }
+      // Each system reports at most two events per iteration, so high priority ones always fit
+      if (!threaded && queue_capacity < 2 * manager.system_array.size) {
+          queue_capacity = 2 * manager.system_array.size;
+      }
+      event_queue_set_capacity(&manager.event_queue, queue_capacity, overflow_policy);
+  }
+
+  // Headless mode replaces the display and per-event prints with records written by their own thread
+  if (headless_format >= 0) {
+      if (output_stream_start(&stream, headless_format, output_path) != 0) {
+          fprintf(stderr, "Could not open headless output '%s'\n", output_path != NULL ? output_path : "-");
+          manager_clean(&manager);
+          return 1;
+      }
+      manager.stream = &stream;
+  }
+
+  if (threaded) {
+      run_threaded(&manager, shared_queue, cluster_size, place);
+      stop_stream(&manager);
+      print_queue_stats(&manager.event_queue);
+      print_channel_stats(&manager);
+      manager_latency_print(&manager);
+      manager_pacing_print(&manager);
+      manager_series_print(&manager);
+      manager_clean(&manager);
+      write_trace(trace_path);
+      return 0;
+  }
+
+  if (scheduled) {
+      manager_run_scheduled(&manager, 0, &scheduler_stats);
+      stop_stream(&manager);
+      print_scheduler_stats(&scheduler_stats);
+      print_queue_stats(&manager.event_queue);
+      manager_latency_print(&manager);
+      manager_pacing_print(&manager);
+      manager_series_print(&manager);
+      manager_clean(&manager);
+      write_trace(trace_path);
+      return 0;
+  }
+
+  if (deterministic) {
+      // The display refreshes on wall-clock time, which would make the output differ between runs
+      manager.quiet = 1;
+      if (manager_run_deterministic(&manager, workers, epoch_us, 0, &deterministic_stats) != 0) {
+          fprintf(stderr, "Could not start the deterministic run\n");
+      } else {
+          print_deterministic_stats(&manager, &deterministic_stats, workers);
+      }
+      stop_stream(&manager);
+      print_queue_stats(&manager.event_queue);
+      manager_series_print(&manager);
+      manager_clean(&manager);
+      write_trace(trace_path);
+      return 0;
+  }
+
+  if (processes > 0) {
+      if (manager_run_processes(&manager, processes, crash_worker, &process_stats) != 0) {
+          fprintf(stderr, "Could not start the worker processes\n");
+      } else {
+          print_process_stats(&process_stats);
+      }
+      stop_stream(&manager);
+      print_queue_stats(&manager.event_queue);
+      manager_latency_print(&manager);
+      manager_series_print(&manager);
+      manager_clean(&manager);
+      write_trace(trace_path);
+      return 0;
+  }
 
   int counter = 0;  // Add counter
   const int MAX_ITERATIONS = 10;  // Define maximum iterations
@@ -20,57 +275,260 @@ int main(void) {
           system_run(manager.system_array.systems[i]);
       }
       counter++;  // Increment counter
-      printf("Iteration %d of %d\n", counter, MAX_ITERATIONS);  // Optional: add progress output
+      // Every system is between steps here, so the synchronous loop saves after every iteration
+      if (checkpoint_path != NULL && manager_checkpoint_save(&manager, checkpoint_path) != 0) {
+          fprintf(stderr, "Could not write checkpoint '%s'\n", checkpoint_path);
+      }
+      if (manager.stream != NULL) {
+          output_stream_iteration(manager.stream, counter);
+      } else {
+          printf("Iteration %d of %d\n", counter, MAX_ITERATIONS);  // Optional: add progress output
+      }
   }
 
+  stop_stream(&manager);
+  print_queue_stats(&manager.event_queue);
+  manager_latency_print(&manager);
+  manager_series_print(&manager);
   manager_clean(&manager);
+  write_trace(trace_path);
   return 0;
 }
 
 /**
- * Loads sample data for the simulation.
+ * Runs the simulation with every system on its own thread.
+ *
+ * Each system reports through its own channel (or the shared queue), and the manager polls
+ * every `MANAGER_WAIT_TIME` milliseconds until a terminal condition stops the simulation.
+ * With `place`, systems sharing resources are pinned to the same cores and the manager gets a
+ * core of its own (see `placement_plan`). The run's throughput and the cache misses and CPU
+ * migrations of its threads are printed, to compare runs with and without placement.
+ *
+ * @param[in,out] manager       Pointer to the loaded `Manager`.
+ * @param[in]     shared_queue  Non-zero to have all systems push to the shared event queue.
+ * @param[in]     cluster_size  Systems per sub-manager in hierarchical mode, 0 for a single manager.
+ * @param[in]     place         Non-zero to pin the threads by the resources their systems share.
+ */
+static void run_threaded(Manager *manager, int shared_queue, int cluster_size, int place) {
+    int count = manager->system_array.size;
+    int started = 0, placed = 0, reader;
+    long long start_ns, joined_ns;
+    unsigned long long conversions = 0;
+    Placement placement;
+    TrafficCounters traffic;
+    pthread_attr_t attr;
+    pthread_t *threads = malloc(sizeof(pthread_t) * (count > 0 ? count : 1));
+
+    if (threads == NULL) {
+        return;
+    }
+
+    if (place && placement_plan(&placement, manager) == 0) {
+        placed = 1;
+        placement_print(&placement, manager);
+        // Before the sub-managers start, so they share the manager's core
+        placement_pin_self(&placement, placement.manager_core);
+    }
+    traffic_counters_start(&traffic);
+    start_ns = latency_now_ns();
+
+    // Clusters give each group of systems its own queue and sub-manager instead of per-system channels
+    if (cluster_size > 0) {
+        manager_clusters_start(manager, cluster_size);
+    } else if (!shared_queue) {
+        manager_channels_attach(manager);
+    }
+
+    for (int i = 0; i < count; i++) {
+        System *system = manager->system_array.systems[i];
+        system->released = 0;
+        system->shutdown = &manager->shutdown;
+        pthread_attr_init(&attr);
+        if (placed) {
+            placement_attr(&placement, placement.system_core[i], &attr);
+        }
+        if (pthread_create(&threads[started], &attr, system_thread, system) == 0) {
+            started++;
+        } else {
+            system->released = 1;
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // The manager reads the live arrays, and holds nothing from them between passes
+    reader = rcu_register(&manager->rcu);
+    while (manager->simulation_running) {
+        manager_run(manager);
+        manager_checkpoint_poll(manager);
+        rcu_quiescent(&manager->rcu, reader);
+        shutdown_sleep(&manager->shutdown, MANAGER_WAIT_TIME * 1000);
+    }
+    rcu_unregister(&manager->rcu, reader);
+
+    // The manager has set every system to TERMINATE and woken the sleeping ones, so the threads exit
+    // within a step. The signal is repeated in case the run stopped another way.
+    // Closing the queue releases any system still waiting for room in it.
+    shutdown_signal(&manager->shutdown);
+    event_queue_close(&manager->event_queue);
+    manager_clusters_stop(manager);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    joined_ns = latency_now_ns();
+    traffic_counters_stop(&traffic);
+    free(threads);
+
+    fprintf(stderr, "Shutdown: %d system threads joined %.3f ms after TERMINATE\n",
+            started, (joined_ns - manager->shutdown.terminate_ns) / 1e6);
+
+    for (int i = 0; i < count; i++) {
+        conversions += manager->system_array.systems[i]->conversions;
+    }
+    printf("Threads%s: %llu conversions in %.3f s (%.0f/s), ", placed ? " (placed)" : "",
+           conversions, (joined_ns - start_ns) / 1e9, conversions / ((joined_ns - start_ns) / 1e9));
+    if (traffic.cache_misses >= 0) {
+        printf("%lld cache misses (%.1f per conversion), ", traffic.cache_misses,
+               conversions > 0 ? (double)traffic.cache_misses / conversions : 0.0);
+    } else {
+        printf("cache misses unavailable, ");
+    }
+    if (traffic.migrations >= 0) {
+        printf("%lld CPU migrations\n", traffic.migrations);
+    } else {
+        printf("CPU migrations unavailable\n");
+    }
+    if (placed) {
+        placement_clean(&placement);
+    }
+}
+
+/**
+ * Prints the overflow counters of a bounded `EventQueue`.
+ *
+ * @param[in] queue  Pointer to the `EventQueue`.
+ */
+static void print_queue_stats(const EventQueue *queue) {
+    if (queue->capacity == 0) {
+        return;
+    }
+
+    printf("Event queue (capacity %d): %lu dropped, %lu evicted, %lu merged, %lu waits totalling %.3f ms\n",
+           queue->capacity, queue->dropped, queue->evicted, queue->merged, queue->waits, queue->wait_us / 1000.0);
+}
+
+/**
+ * Prints how many low priority events each system's `EventChannel` had to drop.
  *
- * Calls all of the functions required to create resources and systems and add them to the Manager's data.
+ * Nothing is printed when the systems shared the event queue.
+ *
+ * @param[in] manager  Pointer to the `Manager` after the run.
+ */
+static void print_channel_stats(const Manager *manager) {
+    unsigned long total = 0;
+
+    if (manager->channels == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < manager->channel_count; i++) {
+        total += manager->channels[i].dropped;
+    }
+    printf("Event channels (capacity %d): %lu dropped\n", CHANNEL_CAPACITY, total);
+
+    for (int i = 0; i < manager->channel_count; i++) {
+        const char *name = "(detached)";
+
+        if (manager->channels[i].slots == NULL) {
+            continue;
+        }
+        for (int j = 0; j < manager->system_array.size; j++) {
+            if (manager->system_array.systems[j]->channel == &manager->channels[i]) {
+                name = manager->system_array.systems[j]->name;
+                break;
+            }
+        }
+        printf("  %-20s %u dropped\n", name, manager->channels[i].dropped);
+    }
+}
+
+/**
+ * Prints the outcome of a deterministic run, identical for every run and worker count.
+ *
+ * @param[in] manager  Pointer to the `Manager` after the run.
+ * @param[in] stats    Pointer to the `DeterministicStats` of the run.
+ * @param[in] workers  Number of workers asked for.
+ */
+static void print_deterministic_stats(const Manager *manager, const DeterministicStats *stats, int workers) {
+    static const char *outcomes[] = { "Running", "Destination reached", "Oxygen depleted" };
+
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        printf("%s: %d / %d\n", manager->resource_array.resources[i]->name,
+               manager->resource_array.resources[i]->amount, manager->resource_array.resources[i]->max_capacity);
+    }
+    printf("Outcome: %s after %.3f virtual s\n", outcomes[manager->outcome], stats->virtual_us / 1e6);
+    printf("Deterministic: %llu epochs, %llu rounds, %llu steps, %llu events, digest %016llx\n",
+           stats->epochs, stats->rounds, stats->steps, stats->events, stats->digest);
+    fprintf(stderr, "Deterministic run used %d workers\n", workers);
+}
+
+/**
+ * Prints what the worker processes of a shared-memory run did.
+ *
+ * @param[in] stats  Pointer to the `ProcessStats` of the run.
+ */
+static void print_process_stats(const ProcessStats *stats) {
+    printf("Processes: %d workers (%d crashed), %llu conversions in %.3f s (%.0f/s), %llu events, %llu dropped, %llu rejected\n",
+           stats->workers, stats->crashed, stats->conversions, stats->elapsed_ns / 1e9,
+           stats->elapsed_ns > 0 ? stats->conversions / (stats->elapsed_ns / 1e9) : 0.0,
+           stats->events, stats->dropped, stats->rejected);
+}
+
+/**
+ * Prints how many steps the single-thread scheduler ran and how late they were.
+ *
+ * @param[in] stats  Pointer to the `SchedulerStats` of the run.
+ */
+static void print_scheduler_stats(const SchedulerStats *stats) {
+    printf("Scheduler: %llu steps, mean lateness %.1f us, max lateness %lld us\n", stats->steps,
+           stats->steps > 0 ? (double)stats->late_total_us / stats->steps : 0.0, stats->late_max_us);
+}
+
+/**
+ * Drains and stops the headless output stream, if there is one, and reports it on stderr.
+ *
+ * When the records went to standard output the human-readable summaries that follow are
+ * silenced too, so the stream stays machine-readable.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` whose stream to stop.
+ */
+static void stop_stream(Manager *manager) {
+    OutputStream *stream = manager->stream;
+
+    if (stream == NULL) {
+        return;
+    }
+
+    int to_stdout = stream->fd == STDOUT_FILENO;
+    output_stream_stop(stream);
+    fprintf(stderr, "Headless output: %llu records written, %lu dropped\n", stream->written, stream->dropped);
+    manager->stream = NULL;
+
+    if (to_stdout && freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Could not silence standard output\n");
+    }
+}
+
+/**
+ * Writes the span trace if one was requested and tracing is compiled in.
  *
- * @param[in,out] manager  Pointer to the `Manager` to populate with resource and system data.
+ * @param[in] path  Path of the Chrome trace JSON file, NULL if no trace was requested.
  */
-void load_data(Manager *manager) {
-    // Create resources
-    Resource *fuel, *oxygen, *energy, *distance;
-    resource_create(&fuel, "Fuel", 1000, 1000);
-    resource_create(&oxygen, "Oxygen", 20, 50);
-    resource_create(&energy, "Energy", 30, 50);
-    resource_create(&distance, "Distance", 0, 5000);
-
-    resource_array_add(&manager->resource_array, fuel);
-    resource_array_add(&manager->resource_array, oxygen);
-    resource_array_add(&manager->resource_array, energy);
-    resource_array_add(&manager->resource_array, distance);
-
-    // Create systems
-    System *propulsion_system, *life_support_system, *crew_capsule_system, *generator_system;
-    ResourceAmount consume_fuel, produce_distance;
-    resource_amount_init(&consume_fuel, fuel, 5);
-    resource_amount_init(&produce_distance, distance, 25);
-    system_create(&propulsion_system, "Propulsion", consume_fuel, produce_distance, 50, &manager->event_queue);
-
-    ResourceAmount consume_energy, produce_oxygen;
-    resource_amount_init(&consume_energy, energy, 7);
-    resource_amount_init(&produce_oxygen, oxygen, 4);
-    system_create(&life_support_system, "Life Support", consume_energy, produce_oxygen, 10, &manager->event_queue);
-
-    ResourceAmount consume_oxygen, produce_nothing;
-    resource_amount_init(&consume_oxygen, oxygen, 1);
-    resource_amount_init(&produce_nothing, NULL, 0);
-    system_create(&crew_capsule_system, "Crew", consume_oxygen, produce_nothing, 2, &manager->event_queue);
-
-    ResourceAmount consume_fuel_for_energy, produce_energy;
-    resource_amount_init(&consume_fuel_for_energy, fuel, 5);
-    resource_amount_init(&produce_energy, energy, 10);
-    system_create(&generator_system, "Generator", consume_fuel_for_energy, produce_energy, 20, &manager->event_queue);
-
-    system_array_add(&manager->system_array, propulsion_system);
-    system_array_add(&manager->system_array, life_support_system);
-    system_array_add(&manager->system_array, crew_capsule_system);
-    system_array_add(&manager->system_array, generator_system);
+static void write_trace(const char *path) {
+#ifdef ENABLE_TRACE
+    if (path != NULL && trace_write(path) != 0) {
+        fprintf(stderr, "Could not write trace '%s'\n", path);
+    }
+#else
+    (void)path;
+#endif
 }
@@ -8,6 +8,9 @@
 // This function is only used by this file, so declared here and set to static to avoid having it linked by any other file
 
 static void display_simulation_state(Manager *manager);
+static void manager_collect_channels(Manager *manager);
+static void manager_health_release(void *context, void *system);
+static void manager_print_transitions(const SubsysChange *changes, unsigned int count, void *context);
 
 /**
  * Initializes the `Manager`.
@@ -19,34 +22,268 @@ static void display_simulation_state(Manager *manager);
  */
 void manager_init(Manager *manager) {
     manager->simulation_running = 1; // Any non-zero value to state the sim is running
-    system_array_init(&manager->system_array);
-    resource_array_init(&manager->resource_array);
+    arena_init(&manager->arena);
+    system_array_init_arena(&manager->system_array, &manager->arena);
+    resource_array_init_arena(&manager->resource_array, &manager->arena);
+    rcu_init(&manager->rcu);
+    manager->rcu.release = manager_health_release;
+    manager->rcu.release_context = manager;
+    manager->system_array.rcu = &manager->rcu;
+    manager->resource_array.rcu = &manager->rcu;
     event_queue_init(&manager->event_queue);
+    manager->channels = NULL;
+    manager->active_channels = NULL;
+    manager->channel_count = 0;
+    manager->clusters = NULL;
+    manager->cluster_count = 0;
+    subsys_collection_init(&manager->health);
+    manager->health_tracked = 0;
+    manager->watch = NULL;
+    manager->feed = NULL;
+    snapshot_seq_init(&manager->snapshot_seq);
+    snapshot_frame_init(&manager->frame);
+    sim_clock_init(&manager->clock, 0);
+    shutdown_init(&manager->shutdown);
+    manager->quiet = 0;
+    manager->stream = NULL;
+    manager->outcome = OUTCOME_RUNNING;
+    manager->last_display_time = 0;
+    manager->checkpoint_path = NULL;
+    manager->checkpoint_next_ns = 0;
+    for (int i = 0; i <= PRIORITY_HIGH; i++) {
+        latency_histogram_init(&manager->queue_latency[i]);
+        latency_histogram_init(&manager->handle_latency[i]);
+    }
 }
 
 /**
  * Cleans up the `Manager`.
  *
  * Frees all resources associated with the manager.
+ * Resources, systems and names live in the arena, so they go with a handful of `free`s.
  *
  * @param[in,out] manager  Pointer to the `Manager` to clean.
  */
 void manager_clean(Manager *manager) {
   if (manager != NULL) {
+    // Free the resource histories, arena resources are not destroyed one by one
+    manager_series_clean(manager);
+
     // Clean up resources array
     resource_array_clean(&manager->resource_array);
     
     // Clean up systems array
     system_array_clean(&manager->system_array);
+
+    // Free the array versions and objects still waiting for a grace period, the health goes as a whole
+    manager->rcu.release = NULL;
+    rcu_clean(&manager->rcu);
+
+    // Release every resource, system and name at once
+    arena_free(&manager->arena);
     
-    // Clean up event queue
+    // Clean up event queue, the per-system channels and the cluster queues
     event_queue_clean(&manager->event_queue);
+    manager_clusters_clean(manager);
+    for (int i = 0; i < manager->channel_count; i++) {
+        event_channel_clean(&manager->channels[i]);
+    }
+    free(manager->channels);
+    free(manager->active_channels);
+    manager->channels = NULL;
+    manager->active_channels = NULL;
+    manager->channel_count = 0;
+    snapshot_frame_clean(&manager->frame);
+
+    // Every system thread has been joined by now, so none can still be waiting on it
+    shutdown_clean(&manager->shutdown);
     
     // Reset simulation running flag
     manager->simulation_running = 0;
   }
 }
 
+/**
+ * Gives every system in the manager a live health status byte.
+ *
+ * Gives each system that does not have one yet a `Subsystem` slot in the manager's health
+ * collection, so `subsys_filter` can be run on the live fleet. A slot freed by a reclaimed
+ * system is reused before the collection grows, and a system keeps its slot until it is
+ * reclaimed itself. Systems past the collection's capacity are left untracked.
+ * Slots are attached and, through the `Rcu`, released under the writer lock, so systems can be
+ * added and reclaimed from another thread while the manager attaches them.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` whose systems are attached.
+ */
+void manager_health_attach(Manager *manager) {
+    Subsystem subsystem;
+    System *system = NULL;
+    int free_slot = 0;
+
+    rcu_lock(&manager->rcu);
+    manager->health_tracked = 1;
+    for (int i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->health != NULL) {
+            continue;
+        }
+
+        while (free_slot < (int)manager->health.size && manager->health_owners[free_slot] != NULL) {
+            free_slot++;
+        }
+
+        if (free_slot < (int)manager->health.size) {
+            // Nothing writes a free slot, its counter only keeps the readers' copies consistent
+            Subsystem *slot = &manager->health.subsystems[free_slot];
+            subsys_seq_write_begin(&slot->seq);
+            strncpy(slot->name, system->name, MAX_STR - 1);
+            slot->name[MAX_STR - 1] = '\0';
+            __atomic_store_n(&slot->status, 0, __ATOMIC_RELAXED);
+            subsys_seq_write_end(&slot->seq);
+        } else {
+            // Built directly rather than with subsys_init, which reports every subsystem it creates
+            strncpy(subsystem.name, system->name, MAX_STR - 1);
+            subsystem.name[MAX_STR - 1] = '\0';
+            subsystem.status = 0;
+            subsystem.data = 0;
+            subsystem.seq = 0;
+            subsystem.ring = NULL;
+            if (subsys_append(&manager->health, &subsystem) != ERR_SUCCESS) {
+                continue;
+            }
+        }
+
+        manager->health_owners[free_slot] = system;
+        system->health_index = free_slot;
+        __atomic_store_n(&system->health, &manager->health, __ATOMIC_RELEASE);
+    }
+    rcu_unlock(&manager->rcu);
+}
+
+/**
+ * Frees the health slot of a system being reclaimed, called back by the manager's `Rcu`.
+ *
+ * The system's executor has let go of it, so nothing writes its slot any more. The slot is left
+ * in place with an empty name and a 0 status until `manager_health_attach` reuses it, so every
+ * other system keeps writing the slot it was given.
+ *
+ * @param[in,out] context  Pointer to the `Manager`.
+ * @param[in,out] system   Pointer to the `System` being reclaimed.
+ */
+static void manager_health_release(void *context, void *system) {
+    Manager *manager = (Manager*)context;
+    System *released = (System*)system;
+    Subsystem *slot;
+
+    if (__atomic_load_n(&released->health, __ATOMIC_ACQUIRE) == NULL) {
+        return;
+    }
+    slot = &manager->health.subsystems[released->health_index];
+    manager->health_owners[released->health_index] = NULL;
+    __atomic_store_n(&released->health, NULL, __ATOMIC_RELEASE);
+    released->health_index = -1;
+
+    subsys_seq_write_begin(&slot->seq);
+    slot->name[0] = '\0';
+    __atomic_store_n(&slot->status, 0, __ATOMIC_RELAXED);
+    subsys_seq_write_end(&slot->seq);
+}
+
+/**
+ * Reports transitions of the health statuses through a change feed.
+ *
+ * The feed starts from the current statuses and is polled on every manager pass. Changes that
+ * touch `mask` are printed, unless the manager is quiet or headless. Systems attached to the
+ * health collection later are reported from their first poll.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`, after `manager_health_attach`.
+ * @param[out]    feed     Pointer to the `SubsysFeed` to use, must outlive the run.
+ * @param[in]     mask     Status bits whose changes are printed.
+ * @return                 0 on success, -1 if the feed could not be set up.
+ */
+int manager_feed_attach(Manager *manager, SubsysFeed *feed, unsigned char mask) {
+    if (subsys_feed_init(feed, &manager->health) != ERR_SUCCESS ||
+        subsys_feed_subscribe(feed, mask, manager_print_transitions, manager) < 0) {
+        return -1;
+    }
+    manager->feed = feed;
+    return 0;
+}
+
+/**
+ * Gives every system its own `EventChannel` to the manager.
+ *
+ * Systems then report through their private lock-free ring instead of all contending on the
+ * shared `event_queue`. Must be called once, after all systems are added and before they run.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` whose systems are attached.
+ */
+void manager_channels_attach(Manager *manager) {
+    int count = manager->system_array.size;
+    int words = (count + CHANNEL_WORD_BITS - 1) / CHANNEL_WORD_BITS;
+
+    if (manager->channels != NULL || count == 0) {
+        return;
+    }
+
+    manager->channels = aligned_alloc(64, sizeof(EventChannel) * count);
+    manager->active_channels = calloc(words, sizeof(unsigned long long));
+    if (manager->channels == NULL || manager->active_channels == NULL) {
+        free(manager->channels);
+        free(manager->active_channels);
+        manager->channels = NULL;
+        manager->active_channels = NULL;
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        // A system without a channel keeps using the shared queue
+        if (event_channel_init(&manager->channels[i], CHANNEL_CAPACITY, manager->active_channels, i) == STATUS_OK) {
+            manager->system_array.systems[i]->channel = &manager->channels[i];
+        } else {
+            manager->channels[i].slots = NULL;
+        }
+    }
+    manager->channel_count = count;
+}
+
+/**
+ * Moves every event waiting in the systems' channels into the manager's priority queue.
+ *
+ * Only channels whose bit is set in the non-empty bitmap are visited, so idle systems cost
+ * one bit each. Merging through the queue orders events from all systems by priority.
+ * If the queue is bounded and fills up, collection stops and the remaining channels keep
+ * their bits, so the systems see full channels instead of the manager dropping events.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+static void manager_collect_channels(Manager *manager) {
+    int words = (manager->channel_count + CHANNEL_WORD_BITS - 1) / CHANNEL_WORD_BITS;
+    unsigned long long pending;
+    Event event;
+
+    for (int w = 0; w < words; w++) {
+        // Clear the word before draining, a system that pushes afterwards sets its bit again
+        pending = __atomic_exchange_n(&manager->active_channels[w], 0, __ATOMIC_ACQUIRE);
+
+        while (pending != 0) {
+            int bit = __builtin_ctzll(pending);
+            EventChannel *channel = &manager->channels[w * CHANNEL_WORD_BITS + bit];
+            pending &= pending - 1;
+
+            // A full queue leaves the rest in the channel, which pushes back on the system
+            while (event_channel_peek(channel, &event)) {
+                if (event_queue_try_push(&manager->event_queue, &event) != STATUS_OK) {
+                    // Later words were never cleared, so only this one needs its bits back
+                    __atomic_fetch_or(&manager->active_channels[w], pending | (1ULL << bit), __ATOMIC_RELAXED);
+                    return;
+                }
+                event_channel_pop(channel, &event);
+            }
+        }
+    }
+}
+
 /**
  * Runs the manager loop.
  *
@@ -57,66 +294,134 @@ void manager_clean(Manager *manager) {
  */
 void manager_run(Manager *manager) {
     Event event;
-    int i, status;
-    int event_found_flag = 0, no_oxygen_flag = 0, distance_reached_flag = 0, need_more_flag = 0, need_less_flag = 0;
+    int i, status, priority, count;
+    System **systems;
+    long long handle_start_ns;
+    int event_found_flag = 0, no_oxygen_flag = 0, distance_reached_flag = 0;
     
     System *sys = NULL;
 
-    // Update the display of the current state of things
-    display_simulation_state(manager);
+    // Record the resource histories before the display reads them
+    manager_series_sample(manager);
+
+    // Hand the health transitions since the last pass to the feed's subscribers
+    if (manager->feed != NULL) {
+        subsys_feed_poll(manager->feed, NULL);
+    }
+
+    // Update the display of the current state of things, or record it when headless
+    if (manager->stream != NULL) {
+        output_stream_snapshot(manager->stream, manager);
+    } else if (!manager->quiet) {
+        TRACE_BEGIN("display_simulation_state");
+        display_simulation_state(manager);
+        TRACE_END("display_simulation_state");
+    }
 
     // Process events if one is popped
-    
+    if (manager->channels != NULL) {
+        manager_collect_channels(manager);
+    }
+
     event_found_flag = event_queue_pop(&manager->event_queue, &event);
 
     while (event_found_flag) {
+        TRACE_BEGIN("handle_event");
+
+        // Time spent waiting since the system reported it
+        handle_start_ns = latency_now_ns();
+        priority = event.priority < PRIORITY_LOW ? PRIORITY_LOW : (event.priority > PRIORITY_HIGH ? PRIORITY_HIGH : event.priority);
+        latency_histogram_record(&manager->queue_latency[priority], handle_start_ns - event.push_ns);
+
         // Handle the event
-        printf("Event: [%s] Reported Resource [%s : %d] Status [%d]\n",
-                event.system->name,
-                event.resource->name,
-                event.amount,
-                event.status);
-
-        // Set some flags based on the event that we can react to below
-        no_oxygen_flag        = (event.status == STATUS_EMPTY && strcmp(event.resource->name, "Oxygen") == 0);
-        distance_reached_flag = (event.status == STATUS_CAPACITY && strcmp(event.resource->name, "Distance") == 0);
-        need_more_flag        = (event.status == STATUS_LOW || event.status == STATUS_EMPTY || event.status == STATUS_INSUFFICIENT);
-        need_less_flag        = (event.status == STATUS_CAPACITY);
+        if (manager->stream != NULL) {
+            output_stream_event(manager->stream, &event);
+        } else if (!manager->quiet) {
+            printf("Event: [%s] Reported Resource [%s : %d] Status [%d]\n",
+                    event.system->name,
+                    event.resource->name,
+                    event.amount,
+                    event.status);
+        }
+
+        // Work out the reaction, then report the terminal conditions
+        status = event_target_status(&event);
+        no_oxygen_flag        = (status == TERMINATE && event.status == STATUS_EMPTY);
+        distance_reached_flag = (status == TERMINATE && event.status == STATUS_CAPACITY);
 
         if (no_oxygen_flag) {
-            printf("Oxygen depleted. Terminating all systems.\n");
+            if (!manager->quiet && manager->stream == NULL) {
+                printf("Oxygen depleted. Terminating all systems.\n");
+            }
+            manager->outcome = OUTCOME_DEPLETED;
         }
 
         if (distance_reached_flag) {
-            printf("Destination reached. Terminating all systems.\n");
+            if (!manager->quiet && manager->stream == NULL) {
+                printf("Destination reached. Terminating all systems.\n");
+            }
+            manager->outcome = OUTCOME_DESTINATION;
         }
 
-        if (no_oxygen_flag || distance_reached_flag) {
-            status = TERMINATE;
+        if (status == TERMINATE) {
             manager->simulation_running = 0;
         }
-        else if (need_more_flag) {
-            status = FAST;
-        }
-        else if (need_less_flag) {
-            status = SLOW;
-        }
 
-        if (no_oxygen_flag || distance_reached_flag || need_more_flag || need_less_flag) {
-            // Update all of the systems to speed up or slow down production, or terminate
-            for (i = 0; i < manager->system_array.size; i++) {
-                sys = manager->system_array.systems[i];
+        if (status != STATUS_OK) {
+            // Update all of the systems to speed up or slow down production, or terminate, as one commit
+            // Systems may be added or removed meanwhile, iterate the version published now
+            systems = system_array_read(&manager->system_array, &count);
+            snapshot_commit_begin(&manager->snapshot_seq);
+            for (i = 0; i < count; i++) {
+                sys = systems[i];
                 if (status == TERMINATE || sys->produced.resource == event.resource) {
-                    sys->status = status;
+                    __atomic_store_n(&sys->status, status, __ATOMIC_RELAXED);
                 }
-            }   
+            }
+            snapshot_commit_end(&manager->snapshot_seq);
+
+            // Systems sleeping through a processing time or backoff see TERMINATE right away
+            if (status == TERMINATE) {
+                shutdown_signal(&manager->shutdown);
+            }
         }
 
+        latency_histogram_record(&manager->handle_latency[priority], latency_now_ns() - handle_start_ns);
+        TRACE_END("handle_event");
         event_found_flag = event_queue_pop(&manager->event_queue, &event);
     }
     
 }
 
+/**
+ * Prints each health field that changed in one poll of the manager's change feed.
+ *
+ * @param[in]     changes  Changes touching the subscribed bits.
+ * @param[in]     count    Number of changes.
+ * @param[in,out] context  Pointer to the `Manager`.
+ */
+static void manager_print_transitions(const SubsysChange *changes, unsigned int count, void *context) {
+    static const char *names[] = { "PWR", "DATA", "ACT", "ERR", "PERF", "RES" };
+    static const int shifts[] = { STATUS_POWER, STATUS_DATA, STATUS_ACTIVITY, STATUS_ERROR, STATUS_PERFORMANCE, STATUS_RESOURCE };
+    static const int widths[] = { 1, 1, 1, 1, 3, 3 };
+    Manager *manager = (Manager*)context;
+
+    if (manager->quiet || manager->stream != NULL) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned char before = changes[i].status ^ changes[i].changed;
+        printf("Transition: [%s]", manager->health.subsystems[changes[i].index].name);
+        for (int f = 0; f < 6; f++) {
+            if ((changes[i].changed >> shifts[f]) & widths[f]) {
+                printf(" %s %d->%d", names[f], (before >> shifts[f]) & widths[f], (changes[i].status >> shifts[f]) & widths[f]);
+            }
+        }
+        printf("\n");
+    }
+}
+
 // Don't worry much about these! These are special codes that allow us to do some formatting in the terminal
 // Such as clearing the line before printing or moving the location of the "cursor" that will print.
 #define ANSI_CLEAR "\033[2J"
@@ -135,16 +440,18 @@ void manager_run(Manager *manager) {
  * @param[in] manager  Pointer to the `Manager` containing the simulation state.
  */
 void display_simulation_state(Manager *manager) {
-    // Static integers are allocated to the data segment, so they persist between function calls
+    // The refresh time lives in the manager so independent simulations never share it
     static const int display_interval = 1;
-    static time_t last_display_time = 0;
 
     // If it has not been long enough since our previous display refresh, keep waiting.
     time_t current_time = time(NULL);
-    if (difftime(current_time, last_display_time) < display_interval) {
+    if (difftime(current_time, manager->last_display_time) < display_interval) {
         return;
     }
 
+    // Read everything from one consistent frame rather than field by field while systems write
+    manager_snapshot(manager, &manager->frame);
+
     // Otherwise display to the screen by resetting the timer
     printf(ANSI_CLEAR);
 
@@ -159,13 +466,19 @@ void display_simulation_state(Manager *manager) {
     Resource *resource = NULL;
     int amount = 0; 
     int max_capacity = 0;
-    for (int i = 0; i < manager->resource_array.size; i++) {
-        resource = manager->resource_array.resources[i];
+    SeriesStats trend;
+    for (int i = 0; i < manager->frame.resource_count; i++) {
+        resource = manager->frame.resources[i];
 
-        amount = resource->amount;
+        amount = manager->frame.amounts[i];
         max_capacity = resource->max_capacity;
 
-        printf(ANSI_LN_CLR "%s: %d / %d\n", resource->name, amount, max_capacity);
+        // With a history, show how fast the amount moved over the last second
+        if (resource->series != NULL && series_query(resource->series, SERIES_DISPLAY_WINDOW_MS * 1000000LL, &trend) == STATUS_OK) {
+            printf(ANSI_LN_CLR "%s: %d / %d (%+.1f/s)\n", resource->name, amount, max_capacity, trend.slope);
+        } else {
+            printf(ANSI_LN_CLR "%s: %d / %d\n", resource->name, amount, max_capacity);
+        }
     }
 
     printf(ANSI_LN_CLR "\n");
@@ -175,12 +488,12 @@ void display_simulation_state(Manager *manager) {
     printf(ANSI_LN_CLR "---------------\n");
 
     System *system = NULL;
-    for (int i = 0; i < manager->system_array.size; i++) {
-        system = manager->system_array.systems[i];
+    for (int i = 0; i < manager->frame.system_count; i++) {
+        system = manager->frame.systems[i];
 
         // Map system status code to a human-readable string
         const char *status_str;
-        switch (system->status) {
+        switch (manager->frame.statuses[i]) {
             case TERMINATE:
                 status_str = "TERMINATE";
                 break;
@@ -206,7 +519,32 @@ void display_simulation_state(Manager *manager) {
 
     printf(ANSI_LN_CLR  "\n");
 
-    last_display_time = current_time;
+    // Systems whose health matches the watch query, found in one pass without parsing it again
+    if (manager->watch != NULL) {
+        unsigned int matches[MAX_ARR], match_count;
+        subsys_query_select(manager->watch, &manager->health, matches, &match_count);
+        printf(ANSI_LN_CLR "Watch [%s]: %u of %u systems\n", manager->watch->text, match_count, manager->health.size);
+        for (unsigned int i = 0; i < match_count; i++) {
+            printf(ANSI_LN_CLR "  %s\n", manager->health.subsystems[matches[i]].name);
+        }
+        printf(ANSI_LN_CLR "\n");
+    }
+
+    // Summaries reported by the sub-managers in hierarchical mode
+    for (int i = 0; i < manager->cluster_count; i++) {
+        Cluster *cluster = &manager->clusters[i];
+        printf(ANSI_LN_CLR "Cluster %-3d (%d systems): %lu handled, %lu FAST, %lu SLOW, %lu forwarded\n",
+               i, cluster->size,
+               __atomic_load_n(&cluster->handled, __ATOMIC_RELAXED),
+               __atomic_load_n(&cluster->fast, __ATOMIC_RELAXED),
+               __atomic_load_n(&cluster->slow, __ATOMIC_RELAXED),
+               __atomic_load_n(&cluster->forwarded, __ATOMIC_RELAXED));
+    }
+    if (manager->cluster_count > 0) {
+        printf(ANSI_LN_CLR "\n");
+    }
+
+    manager->last_display_time = current_time;
     // Flush the output to ensure it appears immediately
     fflush(stdout);
 }
@@ -0,0 +1,442 @@
+#define _GNU_SOURCE     // cpu_set_t, sched_getaffinity and the pthread affinity calls
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PLACEMENT_GROUP_MIN 2   // Fewest systems put on a core while cores are left over
+
+// A usable CPU and where it sits
+typedef struct PlacementCpu {
+    int cpu;
+    int package;
+    int core;
+} PlacementCpu;
+
+static int placement_cpu_compare(const void *a, const void *b);
+static int placement_topology(int cpu, const char *field);
+static int placement_resource_index(Manager *manager, const Resource *resource);
+static int placement_shared(const Placement *placement, Manager *manager, const int *cores, const int *first, const int *members);
+static int traffic_counter_open(unsigned int type, unsigned long long config);
+static long long traffic_counter_read(int fd);
+
+/**
+ * Works out which core each system thread of a threaded run should be pinned to.
+ *
+ * The usable CPUs are grouped into cores (SMT siblings together) and ordered by package, so
+ * neighbouring cores share a socket. The first core is kept for the manager thread. The systems
+ * are ordered by a breadth-first walk of the resource graph, where two systems are neighbours when
+ * one consumes or produces a resource the other does, and the order is cut into one contiguous
+ * slice per remaining core, or fewer slices of `PLACEMENT_GROUP_MIN` when systems are scarce.
+ * Systems that share resources thus end up on the same core or on a neighbouring one, and each
+ * resource's cache line moves between as few cores as possible.
+ * Runs once before the threads start, in O(systems * resources).
+ *
+ * @param[out]    placement  Pointer to the `Placement` to fill, cleaned with `placement_clean`.
+ * @param[in,out] manager    Pointer to the loaded `Manager`.
+ * @return                   0 on success, -1 if the CPUs could not be read or memory ran out.
+ */
+int placement_plan(Placement *placement, Manager *manager) {
+    int count = manager->system_array.size;
+    int resource_count = manager->resource_array.size;
+    PlacementCpu *cpus = malloc(sizeof(PlacementCpu) * CPU_SETSIZE);
+    int *first = calloc(resource_count + 1, sizeof(int));
+    int *members = malloc(sizeof(int) * (2 * count + 1));
+    int *fill = calloc(resource_count + 1, sizeof(int));
+    int *order = malloc(sizeof(int) * (count + 1));
+    int *visited = calloc(count + 1, sizeof(int));
+    int *spread = malloc(sizeof(int) * (count + 1));
+    int ends[2], system_cores, groups, head, tail, i, j, k, r;
+    cpu_set_t set;
+
+    memset(placement, 0, sizeof(Placement));
+    placement->manager_core = -1;
+    placement->system_count = count;
+    placement->system_core = malloc(sizeof(int) * (count + 1));
+
+    if (cpus == NULL || first == NULL || members == NULL || fill == NULL || order == NULL ||
+        visited == NULL || spread == NULL || placement->system_core == NULL ||
+        sched_getaffinity(0, sizeof(set), &set) != 0) {
+        free(cpus);
+        free(first);
+        free(members);
+        free(fill);
+        free(order);
+        free(visited);
+        free(spread);
+        placement_clean(placement);
+        return -1;
+    }
+
+    // CPUs by package and core, the CPUs of one core next to each other
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &set)) {
+            cpus[placement->cpu_count].cpu = i;
+            cpus[placement->cpu_count].package = placement_topology(i, "physical_package_id");
+            cpus[placement->cpu_count].core = placement_topology(i, "core_id");
+            placement->cpu_count++;
+        }
+    }
+    qsort(cpus, placement->cpu_count, sizeof(PlacementCpu), placement_cpu_compare);
+
+    placement->cpus = malloc(sizeof(int) * placement->cpu_count);
+    placement->core_first = malloc(sizeof(int) * (placement->cpu_count + 1));
+    if (placement->cpus != NULL && placement->core_first != NULL) {
+        for (i = 0; i < placement->cpu_count; i++) {
+            placement->cpus[i] = cpus[i].cpu;
+            if (i == 0 || cpus[i].package != cpus[i - 1].package || cpus[i].core != cpus[i - 1].core) {
+                placement->core_first[placement->core_count++] = i;
+            }
+        }
+        placement->core_first[placement->core_count] = placement->cpu_count;
+    }
+    free(cpus);
+
+    // Systems touching each resource, as slices of `members` starting at `first`
+    for (i = 0; i < count; i++) {
+        ends[0] = placement_resource_index(manager, manager->system_array.systems[i]->consumed.resource);
+        ends[1] = placement_resource_index(manager, manager->system_array.systems[i]->produced.resource);
+        for (k = 0; k < 2; k++) {
+            if (ends[k] >= 0 && (k == 0 || ends[1] != ends[0])) {
+                first[ends[k] + 1]++;
+            }
+        }
+    }
+    for (r = 0; r < resource_count; r++) {
+        first[r + 1] += first[r];
+    }
+    for (i = 0; i < count; i++) {
+        ends[0] = placement_resource_index(manager, manager->system_array.systems[i]->consumed.resource);
+        ends[1] = placement_resource_index(manager, manager->system_array.systems[i]->produced.resource);
+        for (k = 0; k < 2; k++) {
+            if (ends[k] >= 0 && (k == 0 || ends[1] != ends[0])) {
+                members[first[ends[k]] + fill[ends[k]]++] = i;
+            }
+        }
+    }
+
+    // Breadth-first over systems sharing a resource, one connected group after another
+    head = 0;
+    tail = 0;
+    for (i = 0; i < count; i++) {
+        if (visited[i]) {
+            continue;
+        }
+        visited[i] = 1;
+        order[tail++] = i;
+        while (head < tail) {
+            System *system = manager->system_array.systems[order[head++]];
+            ends[0] = placement_resource_index(manager, system->consumed.resource);
+            ends[1] = placement_resource_index(manager, system->produced.resource);
+            for (k = 0; k < 2; k++) {
+                for (j = ends[k] >= 0 ? first[ends[k]] : 0; ends[k] >= 0 && j < first[ends[k] + 1]; j++) {
+                    if (!visited[members[j]]) {
+                        visited[members[j]] = 1;
+                        order[tail++] = members[j];
+                    }
+                }
+            }
+        }
+    }
+
+    // The manager gets the first core to itself when there is more than one
+    if (placement->core_count > 1) {
+        placement->manager_core = 0;
+    }
+    // Systems mostly wait, so a core takes at least PLACEMENT_GROUP_MIN of them rather than splitting sharers
+    system_cores = placement->core_count > 1 ? placement->core_count - 1 : 1;
+    groups = count / PLACEMENT_GROUP_MIN < system_cores ? count / PLACEMENT_GROUP_MIN : system_cores;
+    groups = groups > 0 ? groups : 1;
+    for (j = 0; j < count; j++) {
+        placement->system_core[order[j]] = placement->manager_core + 1 + (int)((long long)j * groups / count);
+        spread[j] = placement->manager_core + 1 + j % system_cores;
+    }
+
+    placement->shared_planned = placement_shared(placement, manager, placement->system_core, first, members);
+    placement->shared_spread = placement_shared(placement, manager, spread, first, members);
+
+    free(first);
+    free(members);
+    free(fill);
+    free(order);
+    free(visited);
+    free(spread);
+    if (placement->cpus == NULL || placement->core_first == NULL) {
+        placement_clean(placement);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sets a thread attribute so the thread it creates runs on the CPUs of a core.
+ *
+ * @param[in]     placement  Pointer to the planned `Placement`.
+ * @param[in]     core       Index of the core.
+ * @param[in,out] attr       Pointer to an initialized `pthread_attr_t`.
+ * @return                   0 on success, -1 otherwise.
+ */
+int placement_attr(const Placement *placement, int core, pthread_attr_t *attr) {
+    cpu_set_t set;
+
+    if (core < 0 || core >= placement->core_count) {
+        return -1;
+    }
+    CPU_ZERO(&set);
+    for (int i = placement->core_first[core]; i < placement->core_first[core + 1]; i++) {
+        CPU_SET(placement->cpus[i], &set);
+    }
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+/**
+ * Pins the calling thread to the CPUs of a core.
+ *
+ * @param[in] placement  Pointer to the planned `Placement`.
+ * @param[in] core       Index of the core.
+ * @return               0 on success, -1 otherwise.
+ */
+int placement_pin_self(const Placement *placement, int core) {
+    cpu_set_t set;
+
+    if (core < 0 || core >= placement->core_count) {
+        return -1;
+    }
+    CPU_ZERO(&set);
+    for (int i = placement->core_first[core]; i < placement->core_first[core + 1]; i++) {
+        CPU_SET(placement->cpus[i], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+/**
+ * Prints the cores, the systems pinned to each and how many resources end up shared between cores.
+ *
+ * @param[in] placement  Pointer to the planned `Placement`.
+ * @param[in] manager    Pointer to the `Manager` the plan was made for.
+ */
+void placement_print(const Placement *placement, Manager *manager) {
+    int core, i, listed;
+
+    printf("Placement: %d CPUs in %d cores", placement->cpu_count, placement->core_count);
+    if (placement->manager_core < 0) {
+        printf(", one core so every thread shares it\n");
+    } else {
+        printf(", manager on core 0\n");
+    }
+
+    for (core = 0; core < placement->core_count; core++) {
+        listed = 0;
+        for (i = 0; i < placement->system_count; i++) {
+            listed += placement->system_core[i] == core;
+        }
+        if (listed == 0 && core != placement->manager_core) {
+            continue;
+        }
+
+        printf("  Core %d (CPU", core);
+        for (i = placement->core_first[core]; i < placement->core_first[core + 1]; i++) {
+            printf("%s%d", i == placement->core_first[core] ? " " : ",", placement->cpus[i]);
+        }
+        printf("):%s", core == placement->manager_core ? " manager" : "");
+
+        listed = 0;
+        for (i = 0; i < placement->system_count; i++) {
+            if (placement->system_core[i] != core) {
+                continue;
+            }
+            // Large fleets only get a count per core
+            if (listed < 8) {
+                printf("%s%s", listed == 0 ? " " : ", ", manager->system_array.systems[i]->name);
+            }
+            listed++;
+        }
+        if (listed > 8) {
+            printf(" and %d more", listed - 8);
+        }
+        printf("\n");
+    }
+    printf("  Resources shared across cores: %d placed, %d dealt round-robin\n",
+           placement->shared_planned, placement->shared_spread);
+}
+
+/**
+ * Frees the arrays of a `Placement`.
+ *
+ * @param[in,out] placement  Pointer to the `Placement` to clean.
+ */
+void placement_clean(Placement *placement) {
+    free(placement->cpus);
+    free(placement->core_first);
+    free(placement->system_core);
+    placement->cpus = NULL;
+    placement->core_first = NULL;
+    placement->system_core = NULL;
+    placement->cpu_count = 0;
+    placement->core_count = 0;
+}
+
+/**
+ * Starts counting cache misses and CPU migrations of this thread and every thread it creates after.
+ *
+ * Uses perf events limited to user space, which unprivileged processes may open on themselves.
+ * Counters the kernel or the machine does not provide stay at -1.
+ *
+ * @param[out] counters  Pointer to the `TrafficCounters` to start.
+ */
+void traffic_counters_start(TrafficCounters *counters) {
+    counters->cache_fd = traffic_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters->migration_fd = traffic_counter_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+    counters->cache_misses = -1;
+    counters->migrations = -1;
+}
+
+/**
+ * Stops the counters and reads their totals.
+ *
+ * The threads being counted must have been joined, inherited counts only add up once they exit.
+ *
+ * @param[in,out] counters  Pointer to the started `TrafficCounters`.
+ */
+void traffic_counters_stop(TrafficCounters *counters) {
+    counters->cache_misses = traffic_counter_read(counters->cache_fd);
+    counters->migrations = traffic_counter_read(counters->migration_fd);
+    counters->cache_fd = -1;
+    counters->migration_fd = -1;
+}
+
+/**
+ * Orders CPUs by package, then core, then number.
+ *
+ * @param[in] a  Pointer to the first `PlacementCpu`.
+ * @param[in] b  Pointer to the second `PlacementCpu`.
+ * @return       Negative, zero or positive like `strcmp`.
+ */
+static int placement_cpu_compare(const void *a, const void *b) {
+    const PlacementCpu *x = (const PlacementCpu*)a;
+    const PlacementCpu *y = (const PlacementCpu*)b;
+
+    if (x->package != y->package) {
+        return x->package < y->package ? -1 : 1;
+    }
+    if (x->core != y->core) {
+        return x->core < y->core ? -1 : 1;
+    }
+    return x->cpu < y->cpu ? -1 : (x->cpu > y->cpu);
+}
+
+/**
+ * Reads one topology field of a CPU from sysfs.
+ *
+ * @param[in] cpu    Number of the CPU.
+ * @param[in] field  File under the CPU's topology directory.
+ * @return           The value, or the CPU number when it cannot be read so the CPU is its own core.
+ */
+static int placement_topology(int cpu, const char *field) {
+    char path[128];
+    FILE *file;
+    int value = cpu;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, field);
+    file = fopen(path, "r");
+    if (file != NULL) {
+        if (fscanf(file, "%d", &value) != 1) {
+            value = cpu;
+        }
+        fclose(file);
+    }
+    return value;
+}
+
+/**
+ * Finds the index of a resource in the manager's resource array.
+ *
+ * @param[in] manager   Pointer to the `Manager`.
+ * @param[in] resource  Pointer to the `Resource`, may be NULL.
+ * @return              The index, or -1 for NULL or a resource the manager does not hold.
+ */
+static int placement_resource_index(Manager *manager, const Resource *resource) {
+    for (int i = 0; resource != NULL && i < manager->resource_array.size; i++) {
+        if (manager->resource_array.resources[i] == resource) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Counts, over every resource, the cores touching it beyond the first.
+ *
+ * Each extra core is one more cache that the resource's amount line moves to and from.
+ *
+ * @param[in] placement  Pointer to the `Placement` giving the number of cores.
+ * @param[in] manager    Pointer to the `Manager`.
+ * @param[in] cores      Core of each system.
+ * @param[in] first      Start of each resource's slice of `members`, one more entry than resources.
+ * @param[in] members    Systems touching each resource.
+ * @return               The number of extra cores summed over the resources.
+ */
+static int placement_shared(const Placement *placement, Manager *manager, const int *cores, const int *first, const int *members) {
+    int *seen = calloc(placement->core_count + 1, sizeof(int));
+    int shared = 0, r, j;
+
+    if (seen == NULL) {
+        return 0;
+    }
+    for (r = 0; r < manager->resource_array.size; r++) {
+        int touched = 0;
+        for (j = first[r]; j < first[r + 1]; j++) {
+            // Stamped with the resource, so the marks never need clearing
+            if (seen[cores[members[j]]] != r + 1) {
+                seen[cores[members[j]]] = r + 1;
+                touched++;
+            }
+        }
+        shared += touched > 1 ? touched - 1 : 0;
+    }
+    free(seen);
+    return shared;
+}
+
+/**
+ * Opens a user-space perf counter on this process, inherited by the threads it creates.
+ *
+ * @param[in] type    PERF_TYPE_* of the event.
+ * @param[in] config  Event within the type.
+ * @return            The descriptor, or -1 if the event is not available.
+ */
+static int traffic_counter_open(unsigned int type, unsigned long long config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Reads and closes a perf counter.
+ *
+ * @param[in] fd  Descriptor from `traffic_counter_open`, -1 if it was not available.
+ * @return        The count, or -1 if it is not available.
+ */
+static long long traffic_counter_read(int fd) {
+    long long value = -1;
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+        value = -1;
+    }
+    close(fd);
+    return value;
+}
@@ -0,0 +1,319 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <limits.h>
+
+static unsigned long rcu_oldest_reader(Rcu *rcu);
+static void rcu_free(Rcu *rcu, RcuRetired *node);
+
+/**
+ * Creates a system for a live simulation, reusing the memory of a reclaimed one if there is any.
+ *
+ * The system is not added yet, pass it to `manager_system_add_live`. Arena allocation is not
+ * thread-safe, so only the thread making live changes may create systems while running.
+ *
+ * @param[in,out] manager          Pointer to the `Manager`.
+ * @param[in]     name             Name of the system (interned).
+ * @param[in]     consumed         `ResourceAmount` representing the resource consumed.
+ * @param[in]     produced         `ResourceAmount` representing the resource produced.
+ * @param[in]     processing_time  Processing time in milliseconds.
+ * @return                         The new system, NULL if the memory could not be allocated.
+ */
+System *manager_system_create_live(Manager *manager, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time) {
+    System *system = NULL;
+    RcuRetired *spare;
+
+    rcu_lock(&manager->rcu);
+    spare = manager->rcu.spare;
+    if (spare != NULL) {
+        manager->rcu.spare = spare->next;
+        system = (System*)spare->object;
+        free(spare);
+        system_arena_reuse(system, &manager->arena, name, consumed, produced, processing_time, &manager->event_queue);
+    } else {
+        system_arena_create(&system, &manager->arena, name, consumed, produced, processing_time, &manager->event_queue);
+    }
+    rcu_unlock(&manager->rcu);
+    return system;
+}
+
+/**
+ * Adds a system to a running simulation.
+ *
+ * The system is pointed at the manager's queue and commit counters and published to readers.
+ * Only `manager_run_scheduled` runs added systems, starting them at its next pass with a health
+ * slot if the manager tracks health. The other modes run the systems present at launch.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] system   Pointer to the `System`, owned like the manager's other systems.
+ * @return                 0 on success, -1 on failure.
+ */
+int manager_system_add_live(Manager *manager, System *system) {
+    int size;
+
+    if (system == NULL) {
+        return -1;
+    }
+    system->event_queue = &manager->event_queue;
+    system->snapshot_seq = &manager->snapshot_seq;
+
+    rcu_lock(&manager->rcu);
+    size = manager->system_array.size;
+    system_array_add(&manager->system_array, system);
+    size = manager->system_array.size > size ? 0 : -1;
+    rcu_unlock(&manager->rcu);
+    return size;
+}
+
+/**
+ * Removes systems from a running simulation.
+ *
+ * Readers keep iterating the version they hold, each executor drops its system at its next pass,
+ * and the memory is reclaimed by a later `manager_reclaim` once both have happened. Removing a
+ * batch publishes one version, so it costs O(systems) however many are removed.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     systems  Systems to remove, which must be in the simulation.
+ * @param[in]     count    Number of systems.
+ * @return                 Number of systems removed.
+ */
+int manager_system_remove_live(Manager *manager, System **systems, int count) {
+    int removed;
+
+    rcu_lock(&manager->rcu);
+    removed = system_array_remove(&manager->system_array, systems, count);
+    rcu_unlock(&manager->rcu);
+    return removed;
+}
+
+/**
+ * Reclaims whatever retired systems and array versions are past their grace period.
+ *
+ * Called by the thread making live changes, never by readers.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void manager_reclaim(Manager *manager) {
+    rcu_lock(&manager->rcu);
+    rcu_reclaim(&manager->rcu);
+    rcu_unlock(&manager->rcu);
+}
+
+/**
+ * Initializes an `Rcu` with no readers and nothing retired.
+ *
+ * @param[out] rcu  Pointer to the `Rcu` to initialize.
+ */
+void rcu_init(Rcu *rcu) {
+    rcu->epoch = 1;
+    for (int i = 0; i < RCU_MAX_READERS; i++) {
+        rcu->readers[i] = 0;
+    }
+    sem_init(&rcu->mutex, 0, 1);
+    rcu->retired = NULL;
+    rcu->spare = NULL;
+    rcu->reclaimed = 0;
+    rcu->release = NULL;
+    rcu->release_context = NULL;
+}
+
+/**
+ * Frees everything still retired, once no reader or executor is left.
+ *
+ * Arena-owned objects are left for the arena to release.
+ *
+ * @param[in,out] rcu  Pointer to the `Rcu` to clean.
+ */
+void rcu_clean(Rcu *rcu) {
+    RcuRetired *node;
+
+    while (rcu->retired != NULL) {
+        node = rcu->retired;
+        rcu->retired = node->next;
+        node->waiting = 0;
+        rcu_free(rcu, node);
+    }
+    while (rcu->spare != NULL) {
+        node = rcu->spare;
+        rcu->spare = node->next;
+        free(node);
+    }
+    sem_destroy(&rcu->mutex);
+}
+
+/**
+ * Registers the calling thread as a reader of the live arrays.
+ *
+ * From here on nothing the thread may have read is reclaimed until it reports a quiescent point.
+ *
+ * @param[in,out] rcu  Pointer to the `Rcu`.
+ * @return             The reader's slot, -1 if all `RCU_MAX_READERS` are taken.
+ */
+int rcu_register(Rcu *rcu) {
+    for (int slot = 0; slot < RCU_MAX_READERS; slot++) {
+        unsigned long free_slot = 0;
+        if (__atomic_compare_exchange_n(&rcu->readers[slot], &free_slot, __atomic_load_n(&rcu->epoch, __ATOMIC_SEQ_CST),
+                                        0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Unregisters a reader, which must not use anything it read from the live arrays afterwards.
+ *
+ * @param[in,out] rcu   Pointer to the `Rcu`.
+ * @param[in]     slot  Slot returned by `rcu_register`, ignored if negative.
+ */
+void rcu_unregister(Rcu *rcu, int slot) {
+    if (slot >= 0) {
+        __atomic_store_n(&rcu->readers[slot], 0, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Reports that a reader holds nothing from the live arrays, from the previous pass or otherwise.
+ *
+ * Readers call this between passes, so they never lock or wait for writers.
+ *
+ * @param[in,out] rcu   Pointer to the `Rcu`.
+ * @param[in]     slot  Slot returned by `rcu_register`, ignored if negative.
+ */
+void rcu_quiescent(Rcu *rcu, int slot) {
+    if (slot >= 0) {
+        // Sequentially consistent, so a writer scanning the readers cannot miss this report
+        __atomic_store_n(&rcu->readers[slot], __atomic_load_n(&rcu->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * Takes the writer lock, live changes are made one at a time.
+ *
+ * @param[in,out] rcu  Pointer to the `Rcu`.
+ */
+void rcu_lock(Rcu *rcu) {
+    sem_wait(&rcu->mutex);
+}
+
+/**
+ * Releases the writer lock.
+ *
+ * @param[in,out] rcu  Pointer to the `Rcu`.
+ */
+void rcu_unlock(Rcu *rcu) {
+    sem_post(&rcu->mutex);
+}
+
+/**
+ * Queues something just unpublished to be freed after the current readers have moved on.
+ *
+ * Called by the writer after the version without it is published.
+ * A removed system additionally waits for its executor to drop it, and its grace period only
+ * starts then, since its last events may still be on their way to the manager.
+ *
+ * @param[in,out] rcu     Pointer to the `Rcu`, NULL to free at once when no reader can exist.
+ * @param[in]     kind    RCU_RETIRED_* of the object.
+ * @param[in,out] object  The retired version or system.
+ * @param[in]     owned   non-zero if the object is malloc'd, zero if an arena owns it.
+ */
+void rcu_retire(Rcu *rcu, int kind, void *object, int owned) {
+    RcuRetired *node;
+
+    if (rcu == NULL) {
+        if (kind == RCU_RETIRED_VERSION) {
+            free(object);
+        } else if (owned) {
+            system_destroy((System*)object);
+        }
+        return;
+    }
+
+    node = malloc(sizeof(RcuRetired));
+    if (node == NULL) {
+        // Leaking is the only safe outcome without a node to wait on
+        return;
+    }
+    node->kind = kind;
+    node->object = object;
+    node->owned = owned;
+    node->waiting = kind == RCU_RETIRED_SYSTEM;
+    node->epoch = __atomic_add_fetch(&rcu->epoch, 1, __ATOMIC_SEQ_CST);
+    node->next = rcu->retired;
+    rcu->retired = node;
+    rcu_reclaim(rcu);
+}
+
+/**
+ * Reclaims every retired object whose grace period is over.
+ *
+ * A grace period ends when every registered reader has reported an epoch at least the one the
+ * object was retired at. Called with the writer lock held.
+ *
+ * @param[in,out] rcu  Pointer to the `Rcu`.
+ */
+void rcu_reclaim(Rcu *rcu) {
+    unsigned long oldest = rcu_oldest_reader(rcu);
+    RcuRetired **link = &rcu->retired;
+    RcuRetired *node;
+
+    while (*link != NULL) {
+        node = *link;
+        if (node->waiting) {
+            // The executor has let go, the manager may still hold its events until a grace period passes
+            if (__atomic_load_n(&((System*)node->object)->released, __ATOMIC_ACQUIRE)) {
+                node->waiting = 0;
+                node->epoch = __atomic_add_fetch(&rcu->epoch, 1, __ATOMIC_SEQ_CST);
+            }
+            link = &node->next;
+        } else if (node->epoch <= oldest) {
+            *link = node->next;
+            rcu_free(rcu, node);
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+/**
+ * Finds the oldest epoch any registered reader last reported.
+ *
+ * @param[in] rcu  Pointer to the `Rcu`.
+ * @return         That epoch, ULONG_MAX when no reader is registered.
+ */
+static unsigned long rcu_oldest_reader(Rcu *rcu) {
+    unsigned long oldest = ULONG_MAX;
+
+    for (int i = 0; i < RCU_MAX_READERS; i++) {
+        unsigned long epoch = __atomic_load_n(&rcu->readers[i], __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+/**
+ * Frees a reclaimed object and its node.
+ *
+ * Arena systems are kept as spares for `manager_system_create_live` instead. Either way the
+ * `release` callback hears about a system first, while it is still intact.
+ *
+ * @param[in,out] rcu   Pointer to the `Rcu`.
+ * @param[in,out] node  Node of the object, unlinked from the retired list.
+ */
+static void rcu_free(Rcu *rcu, RcuRetired *node) {
+    rcu->reclaimed++;
+    if (node->kind == RCU_RETIRED_SYSTEM && rcu->release != NULL) {
+        rcu->release(rcu->release_context, node->object);
+    }
+    if (node->kind == RCU_RETIRED_VERSION) {
+        free(node->object);
+    } else if (node->owned) {
+        system_destroy((System*)node->object);
+    } else {
+        node->next = rcu->spare;
+        rcu->spare = node;
+        return;
+    }
+    free(node);
+}
@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <string.h>
 
+static ArrayVersion *resource_array_copy(const ArrayVersion *from, int capacity);
+static void resource_array_publish(ResourceArray *array, ArrayVersion *version);
+
 /* Resource functions */
 
 /**
@@ -17,8 +20,8 @@
  * @param[in]  max_capacity  Maximum capacity of the resource.
  */
 void resource_create(Resource **resource, const char *name, int amount, int max_capacity) {
-    // Allocate memory for the resource structure
-    *resource = (Resource*)malloc(sizeof(Resource));
+    // Allocate memory for the resource structure, cache line aligned so its amount gets a line to itself
+    *resource = (Resource*)aligned_alloc(CACHE_LINE, sizeof(Resource));
     if (*resource == NULL) {
         return;
     }
@@ -35,6 +38,36 @@ void resource_create(Resource **resource, const char *name, int amount, int max_
     // Initialize the fields
     (*resource)->amount = amount;
     (*resource)->max_capacity = max_capacity;
+    (*resource)->series = NULL;
+}
+
+/**
+ * Creates a new `Resource` object inside an `Arena`.
+ *
+ * The struct is a pointer bump and the name is interned, so resources with the same name share it.
+ * The resource must not be passed to `resource_destroy`, it is freed with the arena.
+ *
+ * @param[out] resource      Pointer to the `Resource*` to be allocated and initialized.
+ * @param[in,out] arena      Arena that owns the resource.
+ * @param[in]  name          Name of the resource (interned).
+ * @param[in]  amount        Initial amount of the resource.
+ * @param[in]  max_capacity  Maximum capacity of the resource.
+ */
+void resource_arena_create(Resource **resource, Arena *arena, const char *name, int amount, int max_capacity) {
+    *resource = (Resource*)arena_alloc(arena, sizeof(Resource), _Alignof(Resource));
+    if (*resource == NULL) {
+        return;
+    }
+
+    (*resource)->name = arena_intern(arena, name);
+    if ((*resource)->name == NULL) {
+        *resource = NULL;
+        return;
+    }
+
+    (*resource)->amount = amount;
+    (*resource)->max_capacity = max_capacity;
+    (*resource)->series = NULL;
 }
 
 /**
@@ -47,6 +80,7 @@ void resource_create(Resource **resource, const char *name, int amount, int max_
 void resource_destroy(Resource *resource) {
   if (resource != NULL) {
     free(resource->name);  // Free the dynamically allocated name
+    series_destroy(resource->series);
     free(resource);        // Free the resource struct itself
   }
 }
@@ -70,35 +104,54 @@ void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, i
 /**
  * Initializes the `ResourceArray`.
  *
- * Allocates memory for the array of `Resource*` pointers and sets initial values.
+ * Allocates a first version of capacity 1 and sets initial values.
  *
  * @param[out] array  Pointer to the `ResourceArray` to initialize.
  */
 void resource_array_init(ResourceArray *array) {
-  array->resources = (Resource**)malloc(sizeof(Resource*));
-  if (array->resources == NULL) {
-      return;
-  }
+  array->resources = NULL;
   array->size = 0;
-  array->capacity = 1;
+  array->capacity = 0;
+  array->arena = NULL;
+  array->version = NULL;
+  array->rcu = NULL;
+  resource_array_publish(array, resource_array_copy(NULL, 1));
+}
+
+/**
+ * Initializes a `ResourceArray` whose resources belong to an `Arena`.
+ *
+ * Only resources created with `resource_arena_create` on the same arena may be added.
+ * The storage itself is malloc'd, so replaced versions can be reclaimed.
+ *
+ * @param[out]    array  Pointer to the `ResourceArray` to initialize.
+ * @param[in,out] arena  Arena that owns the resources.
+ */
+void resource_array_init_arena(ResourceArray *array, Arena *arena) {
+  resource_array_init(array);
+  array->arena = arena;
 }
 
 /**
  * Cleans up the `ResourceArray` by destroying all resources and freeing memory.
  *
  * Iterates through the array, calls `resource_destroy` on each `Resource`,
- * and frees the array memory.
+ * and frees the array memory. Arena-owned resources are left to the arena.
+ * No reader may still be running.
  *
  * @param[in,out] array  Pointer to the `ResourceArray` to clean.
  */
 void resource_array_clean(ResourceArray *array) {
   if (array != NULL) {
-    // Destroy all resources in the array
-    for (int i = 0; i < array->size; i++) {
-        resource_destroy(array->resources[i]);
+    if (array->arena == NULL) {
+        // Destroy all resources in the array
+        for (int i = 0; i < array->size; i++) {
+            resource_destroy(array->resources[i]);
+        }
     }
     // Free the array itself
-    free(array->resources);
+    free(array->version);
+    array->version = NULL;
     array->resources = NULL;
     array->size = 0;
     array->capacity = 0;
@@ -108,34 +161,99 @@ void resource_array_clean(ResourceArray *array) {
 /**
  * Adds a `Resource` to the `ResourceArray`, resizing if necessary (doubling the size).
  *
- * Resizes the array when the capacity is reached and adds the new `Resource`.
+ * The resource is written into spare capacity before the larger size is published, and a full
+ * version is replaced by a copy twice the size, so readers never see a half-added entry.
  * Use of realloc is NOT permitted.
+ * While readers run, the caller must hold the array's `rcu_lock`.
  * 
  * @param[in,out] array     Pointer to the `ResourceArray`.
  * @param[in]     resource  Pointer to the `Resource` to add.
  */
 void resource_array_add(ResourceArray *array, Resource *resource) {
-      // Check if we need to resize
-      if (array->size >= array->capacity) {
+    ArrayVersion *version = array->version;
+
+    // Check if we need to resize
+    if (version == NULL || version->size >= version->capacity) {
         // Double the capacity
-        int new_capacity = array->capacity * 2;
-        Resource **new_array = (Resource**)malloc(sizeof(Resource*) * new_capacity);
-        if (new_array == NULL) {
+        version = resource_array_copy(version, version != NULL ? version->capacity * 2 : 1);
+        if (version == NULL) {
             return;
         }
-        
-        // Copy existing elements
-        for (int i = 0; i < array->size; i++) {
-            new_array[i] = array->resources[i];
+        resource_array_publish(array, version);
+    }
+
+    // Add the new resource, then let readers see it
+    array->resources[version->size] = resource;
+    __atomic_store_n(&version->size, version->size + 1, __ATOMIC_RELEASE);
+    array->size = version->size;
+}
+
+/**
+ * Gets the resources of the published version without locking.
+ *
+ * The entries stay valid until the calling reader's next `rcu_quiescent`.
+ *
+ * @param[in]  array  Pointer to the `ResourceArray`.
+ * @param[out] size   Number of entries.
+ * @return            The entries, NULL when there are none.
+ */
+Resource **resource_array_read(ResourceArray *array, int *size) {
+    ArrayVersion *version = __atomic_load_n(&array->version, __ATOMIC_ACQUIRE);
+
+    if (version == NULL) {
+        *size = 0;
+        return NULL;
+    }
+    *size = __atomic_load_n(&version->size, __ATOMIC_ACQUIRE);
+    return (Resource**)(version + 1);
+}
+
+/**
+ * Allocates a version holding the entries of another.
+ *
+ * @param[in] from      Version to copy, NULL for an empty one.
+ * @param[in] capacity  Entries the new version can hold.
+ * @return              The new version, NULL if the memory could not be allocated.
+ */
+static ArrayVersion *resource_array_copy(const ArrayVersion *from, int capacity) {
+    ArrayVersion *version = malloc(sizeof(ArrayVersion) + sizeof(Resource*) * capacity);
+    Resource **entries;
+
+    if (version == NULL) {
+        return NULL;
+    }
+    entries = (Resource**)(version + 1);
+    version->size = 0;
+    version->capacity = capacity;
+
+    if (from != NULL) {
+        Resource * const *old = (Resource * const *)(from + 1);
+        for (int i = 0; i < from->size; i++) {
+            entries[version->size++] = old[i];
         }
-        
-        // Free old array and update pointer
-        free(array->resources);
-        array->resources = new_array;
-        array->capacity = new_capacity;
     }
-    
-    // Add the new resource
-    array->resources[array->size] = resource;
-    array->size++;
+    return version;
+}
+
+/**
+ * Makes a version the one readers see and retires the one it replaces.
+ *
+ * @param[in,out] array    Pointer to the `ResourceArray`.
+ * @param[in]     version  Version to publish, ignored if NULL.
+ */
+static void resource_array_publish(ResourceArray *array, ArrayVersion *version) {
+    ArrayVersion *old = array->version;
+
+    if (version == NULL) {
+        return;
+    }
+
+    // Entries are written before the pointer, readers load it with acquire
+    __atomic_store_n(&array->version, version, __ATOMIC_RELEASE);
+    array->resources = (Resource**)(version + 1);
+    array->size = version->size;
+    array->capacity = version->capacity;
+    if (old != NULL) {
+        rcu_retire(array->rcu, RCU_RETIRED_VERSION, old, 1);
+    }
 }
@@ -0,0 +1,305 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define SCALE_MAX_SIZES 32
+#define SCALE_DEFAULT_DURATION 5       // Seconds each size runs for
+#define SCALE_DEFAULT_RATIO 8          // Systems per resource
+#define SCALE_DEFAULT_DEGREE 3
+#define SCALE_CHURN_INTERVAL_MS 100    // Time between rounds of live replacements
+
+// Measurements of one size
+typedef struct ScaleResult {
+    int systems;
+    int resources;
+    double seconds;                 // Wall time the scheduler ran
+    unsigned long long conversions;
+    unsigned long long events;      // Events handled by the manager
+    double manager_cpu;             // Share of the wall time spent in manager_run
+    double process_cpu;             // User + system CPU over wall time
+    double mean_late_us;            // Mean lateness of a system step
+    double build_ms;                // Time to generate the topology
+    size_t arena_bytes;
+    long max_rss_kb;                // Peak resident set of the process so far
+    unsigned long replaced;         // Systems replaced while running
+    unsigned long reclaimed;        // Retired systems and array versions reclaimed
+} ScaleResult;
+
+// Thread replacing random systems of the running simulation, removing each and adding a copy
+typedef struct ScaleChurn {
+    Manager *manager;
+    int per_round;              // Systems replaced every SCALE_CHURN_INTERVAL_MS
+    unsigned int seed;
+    int running;                // Cleared to stop the thread
+    unsigned long replaced;
+    unsigned long long conversions; // Conversions of the replaced systems, which the results would miss
+} ScaleChurn;
+
+static int scale_parse_sizes(const char *spec, int *sizes);
+static void scale_run_one(ScaleResult *result, const TopologyParams *params, long long duration_us, int churn);
+static void *scale_churn_thread(void *arg);
+static double scale_cpu_seconds(void);
+static int scale_write_csv(const ScaleResult *results, int count, const char *path);
+
+/**
+ * Runs generated topologies of growing size and reports how the simulation scales.
+ *
+ * Every size runs on the single-thread scheduler for the same real time with a quiet manager,
+ * so the columns form a curve: throughput should grow linearly with the number of systems
+ * until a bottleneck bends it. With --churn, N random systems are replaced every 100 ms while
+ * the simulation runs, to measure what live changes cost the scheduler.
+ *
+ * Usage: --scale N[,N]... [--ratio SYSTEMS_PER_RESOURCE] [--degree D] [--seed S] [--duration SECONDS] [--churn N] [--csv FILE]
+ *
+ * @param[in] argc  Argument count, `argv[0]` is `--scale`.
+ * @param[in] argv  Arguments.
+ * @return          Process exit status.
+ */
+int scale_main(int argc, char *argv[]) {
+    int sizes[SCALE_MAX_SIZES];
+    int count = argc > 1 ? scale_parse_sizes(argv[1], sizes) : 0;
+    int ratio = SCALE_DEFAULT_RATIO;
+    int churn = 0;
+    long long duration_us = SCALE_DEFAULT_DURATION * 1000000LL;
+    const char *csv_path = NULL;
+    TopologyParams params;
+    ScaleResult results[SCALE_MAX_SIZES];
+    int i;
+
+    params.degree = SCALE_DEFAULT_DEGREE;
+    params.seed = 1;
+
+    for (i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--ratio") == 0 && i + 1 < argc) {
+            ratio = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--degree") == 0 && i + 1 < argc) {
+            params.degree = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            params.seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration_us = atof(argv[++i]) * 1000000LL;
+        } else if (strcmp(argv[i], "--churn") == 0 && i + 1 < argc) {
+            churn = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else {
+            count = 0;
+            break;
+        }
+    }
+
+    if (count <= 0 || ratio <= 0 || params.degree <= 0 || duration_us <= 0 || churn < 0) {
+        fprintf(stderr, "Usage: --scale N[,N]... [--ratio SYSTEMS_PER_RESOURCE] [--degree D] [--seed S] [--duration SECONDS] [--churn N] [--csv FILE]\n");
+        return 1;
+    }
+
+    printf("Scaling over %d sizes, %.1f s each, %d systems per resource, degree %d, seed %u\n\n",
+           count, duration_us / 1e6, ratio, params.degree, params.seed);
+    printf("%9s %9s %9s %12s %12s %9s %9s %10s %9s %9s %9s %9s %9s\n", "Systems", "Resources", "Build ms",
+           "Conv/s", "Events/s", "Mgr CPU", "CPU", "Late us", "Arena MB", "RSS MB", "Conv/sys", "Replaced", "Reclaimed");
+    for (i = 0; i < count; i++) {
+        ScaleResult *result = &results[i];
+
+        params.systems = sizes[i];
+        params.resources = sizes[i] / ratio > 1 ? sizes[i] / ratio : 1;
+        scale_run_one(result, &params, duration_us, churn);
+
+        printf("%9d %9d %9.1f %12.0f %12.0f %8.1f%% %8.1f%% %10.1f %9.1f %9.1f %9.2f %9lu %9lu\n",
+               result->systems, result->resources, result->build_ms,
+               result->conversions / result->seconds, result->events / result->seconds,
+               100.0 * result->manager_cpu, 100.0 * result->process_cpu, result->mean_late_us,
+               result->arena_bytes / 1048576.0, result->max_rss_kb / 1024.0,
+               (double)result->conversions / result->systems / result->seconds,
+               result->replaced, result->reclaimed);
+        fflush(stdout);
+    }
+
+    if (csv_path != NULL && scale_write_csv(results, count, csv_path) != 0) {
+        fprintf(stderr, "Could not write '%s'\n", csv_path);
+    }
+    return 0;
+}
+
+/**
+ * Parses a comma-separated list of sizes.
+ *
+ * @param[in]  spec   List such as "1000,10000,100000".
+ * @param[out] sizes  Parsed sizes, at most `SCALE_MAX_SIZES`.
+ * @return            Number of sizes, 0 if the list is invalid.
+ */
+static int scale_parse_sizes(const char *spec, int *sizes) {
+    int count = 0;
+    char *end;
+
+    while (*spec != '\0') {
+        long size = strtol(spec, &end, 10);
+        if (end == spec || size <= 0 || count == SCALE_MAX_SIZES || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        sizes[count++] = (int)size;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+/**
+ * Generates one topology, runs it on the scheduler and measures it.
+ *
+ * @param[out] result       Pointer to the `ScaleResult` to fill.
+ * @param[in]  params       Topology to generate.
+ * @param[in]  duration_us  Real time to run for.
+ * @param[in]  churn        Systems replaced every `SCALE_CHURN_INTERVAL_MS` while running, 0 for none.
+ */
+static void scale_run_one(ScaleResult *result, const TopologyParams *params, long long duration_us, int churn) {
+    Manager manager;
+    SchedulerStats stats;
+    ScaleChurn churner;
+    pthread_t churn_thread;
+    int churning = 0;
+    struct rusage usage;
+    long long start_ns, run_ns;
+    double cpu_start;
+    int priority, i;
+
+    start_ns = latency_now_ns();
+    manager_init(&manager);
+    manager.quiet = 1;
+    scenario_generate(&manager, params);
+    // Replaced systems hand their health slots to the replacements, as in any scheduled run
+    manager_health_attach(&manager);
+    result->build_ms = (latency_now_ns() - start_ns) / 1e6;
+
+    churner.manager = &manager;
+    churner.per_round = churn;
+    churner.seed = params->seed;
+    churner.running = 1;
+    churner.replaced = 0;
+    churner.conversions = 0;
+
+    cpu_start = scale_cpu_seconds();
+    start_ns = latency_now_ns();
+    if (churn > 0) {
+        churning = pthread_create(&churn_thread, NULL, scale_churn_thread, &churner) == 0;
+    }
+    manager_run_scheduled(&manager, duration_us, &stats);
+    run_ns = latency_now_ns() - start_ns;
+    if (churning) {
+        __atomic_store_n(&churner.running, 0, __ATOMIC_RELAXED);
+        pthread_join(churn_thread, NULL);
+    }
+
+    result->systems = params->systems;
+    result->resources = params->resources;
+    result->seconds = run_ns / 1e9;
+    result->process_cpu = (scale_cpu_seconds() - cpu_start) / result->seconds;
+    result->manager_cpu = (double)stats.manager_ns / run_ns;
+    result->mean_late_us = stats.steps > 0 ? (double)stats.late_total_us / stats.steps : 0.0;
+    result->arena_bytes = arena_bytes(&manager.arena);
+
+    result->conversions = churner.conversions;
+    for (i = 0; i < manager.system_array.size; i++) {
+        result->conversions += manager.system_array.systems[i]->conversions;
+    }
+    result->events = 0;
+    for (priority = PRIORITY_LOW; priority <= PRIORITY_HIGH; priority++) {
+        result->events += manager.handle_latency[priority].total;
+    }
+
+    result->replaced = churner.replaced;
+    result->reclaimed = manager.rcu.reclaimed;
+
+    getrusage(RUSAGE_SELF, &usage);
+    result->max_rss_kb = usage.ru_maxrss;
+    manager_clean(&manager);
+}
+
+/**
+ * Churn thread body, replaces random systems until stopped.
+ *
+ * It is the only writer, so it picks victims from the array without reading a published version.
+ *
+ * @param[in,out] arg  Pointer to the `ScaleChurn`.
+ * @return             NULL.
+ */
+static void *scale_churn_thread(void *arg) {
+    ScaleChurn *churn = (ScaleChurn*)arg;
+    Manager *manager = churn->manager;
+    System **victims = malloc(sizeof(System*) * churn->per_round * 2);
+    System **replacements = victims + churn->per_round;
+    int size, first, count, i;
+
+    if (victims == NULL) {
+        return NULL;
+    }
+
+    while (__atomic_load_n(&churn->running, __ATOMIC_RELAXED)) {
+        usleep(SCALE_CHURN_INTERVAL_MS * 1000);
+
+        // A run of distinct systems from a random offset, removed in one batch so the round
+        // publishes one copy of the array rather than one per system
+        size = manager->system_array.size;
+        first = size > 0 ? rand_r(&churn->seed) % size : 0;
+        for (count = 0; count < churn->per_round && count < size; count++) {
+            System *old = manager->system_array.systems[(first + count) % size];
+            replacements[count] = manager_system_create_live(manager, old->name, old->consumed, old->produced, old->processing_time);
+            if (replacements[count] == NULL) {
+                break;
+            }
+            victims[count] = old;
+        }
+
+        for (i = 0; i < count; i++) {
+            // Whatever a victim converts after this is lost, it is about to stop anyway
+            churn->conversions += __atomic_load_n(&victims[i]->conversions, __ATOMIC_RELAXED);
+        }
+        churn->replaced += manager_system_remove_live(manager, victims, count);
+        for (i = 0; i < count; i++) {
+            manager_system_add_live(manager, replacements[i]);
+        }
+        manager_reclaim(manager);
+    }
+    free(victims);
+    return NULL;
+}
+
+/**
+ * Reads the CPU time the process has used.
+ *
+ * @return  User plus system time in seconds.
+ */
+static double scale_cpu_seconds(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Writes one CSV row per size.
+ *
+ * @param[in] results  Measured sizes.
+ * @param[in] count    Number of sizes.
+ * @param[in] path     Path of the CSV file.
+ * @return             0 on success, -1 on failure.
+ */
+static int scale_write_csv(const ScaleResult *results, int count, const char *path) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "systems,resources,seconds,build_ms,conversions,events,manager_cpu,process_cpu,mean_late_us,arena_bytes,max_rss_kb,replaced,reclaimed\n");
+    for (int i = 0; i < count; i++) {
+        const ScaleResult *result = &results[i];
+        fprintf(file, "%d,%d,%.3f,%.3f,%llu,%llu,%.4f,%.4f,%.1f,%zu,%ld,%lu,%lu\n", result->systems, result->resources,
+                result->seconds, result->build_ms, result->conversions, result->events, result->manager_cpu,
+                result->process_cpu, result->mean_late_us, result->arena_bytes, result->max_rss_kb,
+                result->replaced, result->reclaimed);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -0,0 +1,124 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * Fills `RocketParams` with the values of the standard rocket.
+ *
+ * @param[out] params  Pointer to the `RocketParams` to fill.
+ */
+void rocket_params_default(RocketParams *params) {
+    params->fuel = 1000;
+    params->fuel_capacity = 1000;
+    params->oxygen = 20;
+    params->oxygen_capacity = 50;
+    params->energy = 30;
+    params->energy_capacity = 50;
+    params->distance_capacity = 5000;
+    params->propulsion_time = 50;
+    params->life_support_time = 10;
+    params->crew_time = 2;
+    params->generator_time = 20;
+}
+
+/**
+ * Loads the four-system rocket into a `Manager`.
+ *
+ * Calls all of the functions required to create resources and systems and add them to the Manager's data.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate with resource and system data.
+ * @param[in]     params   Initial amounts, capacities and processing times to use.
+ */
+void scenario_load_rocket(Manager *manager, const RocketParams *params) {
+    // Create resources
+    Resource *fuel, *oxygen, *energy, *distance;
+    resource_arena_create(&fuel, &manager->arena, "Fuel", params->fuel, params->fuel_capacity);
+    resource_arena_create(&oxygen, &manager->arena, "Oxygen", params->oxygen, params->oxygen_capacity);
+    resource_arena_create(&energy, &manager->arena, "Energy", params->energy, params->energy_capacity);
+    resource_arena_create(&distance, &manager->arena, "Distance", 0, params->distance_capacity);
+
+    resource_array_add(&manager->resource_array, fuel);
+    resource_array_add(&manager->resource_array, oxygen);
+    resource_array_add(&manager->resource_array, energy);
+    resource_array_add(&manager->resource_array, distance);
+
+    // Create systems
+    System *propulsion_system, *life_support_system, *crew_capsule_system, *generator_system;
+    ResourceAmount consume_fuel, produce_distance;
+    resource_amount_init(&consume_fuel, fuel, 5);
+    resource_amount_init(&produce_distance, distance, 25);
+    system_arena_create(&propulsion_system, &manager->arena, "Propulsion", consume_fuel, produce_distance, params->propulsion_time, &manager->event_queue);
+
+    ResourceAmount consume_energy, produce_oxygen;
+    resource_amount_init(&consume_energy, energy, 7);
+    resource_amount_init(&produce_oxygen, oxygen, 4);
+    system_arena_create(&life_support_system, &manager->arena, "Life Support", consume_energy, produce_oxygen, params->life_support_time, &manager->event_queue);
+
+    ResourceAmount consume_oxygen, produce_nothing;
+    resource_amount_init(&consume_oxygen, oxygen, 1);
+    resource_amount_init(&produce_nothing, NULL, 0);
+    system_arena_create(&crew_capsule_system, &manager->arena, "Crew", consume_oxygen, produce_nothing, params->crew_time, &manager->event_queue);
+
+    ResourceAmount consume_fuel_for_energy, produce_energy;
+    resource_amount_init(&consume_fuel_for_energy, fuel, 5);
+    resource_amount_init(&produce_energy, energy, 10);
+    system_arena_create(&generator_system, &manager->arena, "Generator", consume_fuel_for_energy, produce_energy, params->generator_time, &manager->event_queue);
+
+    system_array_add(&manager->system_array, propulsion_system);
+    system_array_add(&manager->system_array, life_support_system);
+    system_array_add(&manager->system_array, crew_capsule_system);
+    system_array_add(&manager->system_array, generator_system);
+}
+
+/**
+ * Generates a random but valid resource graph into a `Manager`.
+ *
+ * System i produces resource i mod `resources`, so every resource has a producer and several
+ * systems feed the same resource (fan-in). Each system consumes one of the `degree` resources
+ * after the one it produces, wrapping around, which links resources into chains, makes each
+ * resource feed several systems (fan-out), and closes cycles like Generator→Energy→Life Support.
+ * One system in eight is a source that consumes nothing and one in eight a sink that produces
+ * nothing, so material enters and leaves the graph. The same parameters always give the same graph.
+ *
+ * @param[in,out] manager  Pointer to the freshly initialized `Manager` to populate.
+ * @param[in]     params   Size, degree and seed of the topology.
+ */
+void scenario_generate(Manager *manager, const TopologyParams *params) {
+    unsigned int seed = params->seed;
+    int resource_count = params->resources > 0 ? params->resources : 1;
+    int degree = params->degree > 0 ? params->degree : 1;
+    char name[MAX_STR];
+    int i;
+
+    for (i = 0; i < resource_count; i++) {
+        Resource *resource;
+        int capacity = 100 + rand_r(&seed) % 900;
+
+        snprintf(name, sizeof(name), "Resource %d", i);
+        resource_arena_create(&resource, &manager->arena, name, capacity / 2, capacity);
+        resource_array_add(&manager->resource_array, resource);
+    }
+
+    for (i = 0; i < params->systems; i++) {
+        System *system;
+        ResourceAmount consumed, produced;
+        int produced_index = i % resource_count;
+        int consumed_index = (produced_index + 1 + rand_r(&seed) % degree) % resource_count;
+        int kind = rand_r(&seed) % 8;
+        Resource *input = manager->resource_array.resources[consumed_index];
+        Resource *output = manager->resource_array.resources[produced_index];
+
+        // The first pass over the resources always produces, so none is left without a producer
+        if (kind == 0) {
+            input = NULL;
+        } else if (kind == 1 && i >= resource_count) {
+            output = NULL;
+        }
+
+        resource_amount_init(&consumed, input, 1 + rand_r(&seed) % 5);
+        resource_amount_init(&produced, output, 1 + rand_r(&seed) % 5);
+        snprintf(name, sizeof(name), "System %d", i);
+        system_arena_create(&system, &manager->arena, name, consumed, produced, 5 + rand_r(&seed) % 96, &manager->event_queue);
+        system_array_add(&manager->system_array, system);
+    }
+}
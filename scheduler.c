@@ -0,0 +1,232 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+// A system waiting for its deadline in the scheduler's heap
+typedef struct SchedulerEntry {
+    long long deadline_us;  // Scheduler time at which the system's next step is due
+    System *system;
+} SchedulerEntry;
+
+static void scheduler_push(SchedulerEntry *heap, int *size, long long deadline_us, System *system);
+static SchedulerEntry scheduler_pop(SchedulerEntry *heap, int *size);
+static int scheduler_adopt(Manager *manager, SchedulerEntry **heap, int *size, int *capacity, long long now_us, long long start_ns);
+
+/**
+ * Runs every system as a state machine on the calling thread, with the manager polled in between.
+ *
+ * Systems wait in a min-heap ordered by deadline. Each due system is advanced with `system_step`
+ * and pushed back at its deadline plus the wait it asked for, so nothing sleeps but the scheduler
+ * itself, and only until the earliest deadline or the next manager pass, as an absolute sleep.
+ * Each step's lateness is recorded in the system's pacing statistics.
+ * Terminated systems leave the heap at the start of their next pass, like `system_thread`, and so
+ * do systems removed while running. Systems added while running join the heap at the next pass,
+ * with a health slot if the manager tracks health.
+ * Every system is between steps whenever the manager runs, so its checkpoints need no barrier;
+ * each system's pacing deadline is kept at its heap deadline for them.
+ *
+ * @param[in,out] manager   Pointer to the loaded `Manager`, its systems must use the shared queue.
+ * @param[in]     limit_us  Real time after which the run is stopped, 0 to run until a terminal condition.
+ * @param[out]    stats     Pointer to the `SchedulerStats` to fill.
+ */
+void manager_run_scheduled(Manager *manager, long long limit_us, SchedulerStats *stats) {
+    int size = 0, capacity = 0;
+    int reader = rcu_register(&manager->rcu);
+    unsigned long changes, seen_changes = 0;
+    long long start_ns = latency_now_ns();
+    long long now_us, next_manager_us = 0, wake_us, wake_ns, manager_start_ns;
+    struct timespec wake;
+    SchedulerEntry *heap = NULL;
+
+    stats->steps = 0;
+    stats->late_max_us = 0;
+    stats->late_total_us = 0;
+    stats->manager_ns = 0;
+
+    TRACE_THREAD_NAME("Scheduler");
+    for (;;) {
+        now_us = (latency_now_ns() - start_ns) / 1000;
+
+        // Start whatever was published since the last pass, the first pass starts every system
+        changes = __atomic_load_n(&manager->system_array.changes, __ATOMIC_ACQUIRE);
+        if (heap == NULL || changes != seen_changes) {
+            if (scheduler_adopt(manager, &heap, &size, &capacity, now_us, start_ns) != STATUS_OK) {
+                break;
+            }
+            seen_changes = changes;
+        }
+
+        if (!manager->simulation_running || size == 0 || (limit_us > 0 && now_us >= limit_us)) {
+            break;
+        }
+
+        // Step every system whose deadline has passed
+        while (size > 0 && heap[0].deadline_us <= now_us) {
+            SchedulerEntry entry = scheduler_pop(heap, &size);
+            long long late_us = now_us - entry.deadline_us;
+            long long deadline_ns = start_ns + entry.deadline_us * 1000;
+
+            if (entry.system->phase == SYSTEM_PHASE_START &&
+                (__atomic_load_n(&entry.system->status, __ATOMIC_RELAXED) == TERMINATE ||
+                 __atomic_load_n(&entry.system->retired, __ATOMIC_RELAXED))) {
+                // A removed system may be reclaimed from here on
+                __atomic_store_n(&entry.system->released, 1, __ATOMIC_RELEASE);
+                continue;
+            }
+
+            stats->steps++;
+            stats->late_total_us += late_us;
+            if (late_us > stats->late_max_us) {
+                stats->late_max_us = late_us;
+            }
+            if (deadline_ns > entry.system->pacing.anchor_ns) {
+                entry.system->pacing.scheduled_ns = deadline_ns - entry.system->pacing.anchor_ns;
+                pacing_record(&entry.system->pacing, deadline_ns, start_ns + now_us * 1000);
+            }
+
+            // Deadlines advance from the previous one, so a late step does not push back the rest
+            entry.deadline_us += system_step(entry.system);
+            entry.system->pacing.deadline_ns = start_ns + entry.deadline_us * 1000;
+            scheduler_push(heap, &size, entry.deadline_us, entry.system);
+        }
+
+        if (now_us >= next_manager_us) {
+            manager_start_ns = latency_now_ns();
+            manager_run(manager);
+            manager_checkpoint_poll(manager);
+            stats->manager_ns += latency_now_ns() - manager_start_ns;
+            next_manager_us = now_us + MANAGER_WAIT_TIME * 1000;
+
+            // Every event has been handled, nothing read from the live arrays is held anymore
+            rcu_quiescent(&manager->rcu, reader);
+        }
+
+        // Sleep until whichever comes first, the next deadline or the next manager pass
+        wake_us = next_manager_us;
+        if (size > 0 && heap[0].deadline_us < wake_us) {
+            wake_us = heap[0].deadline_us;
+        }
+        if (limit_us > 0 && limit_us < wake_us) {
+            wake_us = limit_us;
+        }
+        wake_ns = start_ns + wake_us * 1000;
+        wake.tv_sec = wake_ns / 1000000000LL;
+        wake.tv_nsec = wake_ns % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+        }
+    }
+
+    for (int i = 0; i < size; i++) {
+        __atomic_store_n(&heap[i].system->released, 1, __ATOMIC_RELEASE);
+    }
+    rcu_unregister(&manager->rcu, reader);
+    free(heap);
+}
+
+/**
+ * Pushes every published system that nothing runs yet onto the heap, due now or once the wait
+ * a restored checkpoint left it in is over. Systems without a health slot get one first, if the
+ * manager tracks health.
+ *
+ * Costs O(systems), so it only runs when the system array has changed.
+ *
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @param[in,out] heap      Heap array, grown (doubling) to hold every published system.
+ * @param[in,out] size      Number of entries in the heap.
+ * @param[in,out] capacity  Entries the heap array can hold.
+ * @param[in]     now_us    Current scheduler time.
+ * @param[in]     start_ns  Monotonic time the scheduler started.
+ * @return                  `STATUS_OK`, or `STATUS_EMPTY` if the heap could not grow.
+ */
+static int scheduler_adopt(Manager *manager, SchedulerEntry **heap, int *size, int *capacity, long long now_us, long long start_ns) {
+    int count;
+    System **systems;
+
+    if (manager->health_tracked) {
+        manager_health_attach(manager);
+    }
+    systems = system_array_read(&manager->system_array, &count);
+
+    if (*size + count > *capacity || *heap == NULL) {
+        int new_capacity = *capacity > 0 ? *capacity : 1;
+        SchedulerEntry *new_heap;
+
+        while (new_capacity < *size + count) {
+            new_capacity *= 2;
+        }
+        new_heap = malloc(sizeof(SchedulerEntry) * new_capacity);
+        if (new_heap == NULL) {
+            return STATUS_EMPTY;
+        }
+        for (int i = 0; i < *size; i++) {
+            new_heap[i] = (*heap)[i];
+        }
+        free(*heap);
+        *heap = new_heap;
+        *capacity = new_capacity;
+    }
+
+    for (int i = 0; i < count; i++) {
+        System *system = systems[i];
+        if (system->released && !system->retired && __atomic_load_n(&system->status, __ATOMIC_RELAXED) != TERMINATE) {
+            system->released = 0;
+            system->pacing.anchor_ns = start_ns + now_us * 1000;
+            system->pacing.deadline_ns = system->pacing.anchor_ns + system->resume_us * 1000;
+            scheduler_push(*heap, size, now_us + system->resume_us, system);
+            system->resume_us = 0;
+        }
+    }
+    return STATUS_OK;
+}
+
+/**
+ * Adds a system to the heap.
+ *
+ * @param[in,out] heap         Heap array, with room for one more entry.
+ * @param[in,out] size         Number of entries in the heap.
+ * @param[in]     deadline_us  When the system's next step is due.
+ * @param[in]     system       Pointer to the `System`.
+ */
+static void scheduler_push(SchedulerEntry *heap, int *size, long long deadline_us, System *system) {
+    int i = (*size)++;
+
+    // Sift up, moving later parents down into the hole
+    while (i > 0 && heap[(i - 1) / 2].deadline_us > deadline_us) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i].deadline_us = deadline_us;
+    heap[i].system = system;
+}
+
+/**
+ * Removes the entry with the earliest deadline from the heap.
+ *
+ * @param[in,out] heap  Heap array, must not be empty.
+ * @param[in,out] size  Number of entries in the heap.
+ * @return              The earliest entry.
+ */
+static SchedulerEntry scheduler_pop(SchedulerEntry *heap, int *size) {
+    SchedulerEntry top = heap[0];
+    SchedulerEntry last = heap[--(*size)];
+    int i = 0;
+
+    // Sift the last entry down from the root, moving earlier children up into the hole
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *size) {
+            break;
+        }
+        if (child + 1 < *size && heap[child + 1].deadline_us < heap[child].deadline_us) {
+            child++;
+        }
+        if (heap[child].deadline_us >= last.deadline_us) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
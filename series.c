@@ -0,0 +1,288 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+static void series_bucket_add(SeriesBucket *bucket, double t, int amount);
+static void series_bucket_merge(SeriesBucket *into, const SeriesBucket *bucket);
+
+/**
+ * Creates an empty `ResourceSeries`.
+ *
+ * @param[in] interval_ns  Time between samples in nanoseconds.
+ * @return                 Pointer to the new `ResourceSeries`, or NULL if it could not be allocated.
+ */
+ResourceSeries *series_create(long long interval_ns) {
+    ResourceSeries *series = malloc(sizeof(ResourceSeries));
+    int level, slot;
+
+    if (series == NULL) {
+        return NULL;
+    }
+
+    series->interval_ns = interval_ns > 0 ? interval_ns : 1;
+    series->start_ns = 0;
+    series->next_ns = 0;
+    series->last_ns = 0;
+    series->samples = 0;
+    series->seq = 0;
+    for (level = 0; level < SERIES_LEVELS; level++) {
+        for (slot = 0; slot < SERIES_SLOTS; slot++) {
+            series->levels[level][slot].number = -1;
+        }
+    }
+    return series;
+}
+
+/**
+ * Frees a `ResourceSeries`.
+ *
+ * @param[in,out] series  Pointer to the `ResourceSeries`, may be NULL.
+ */
+void series_destroy(ResourceSeries *series) {
+    free(series);
+}
+
+/**
+ * Adds a sample to a series, unless the next one is not due yet.
+ *
+ * Samples fall on a grid of `interval_ns` from the first one, a late call takes the slot it is in
+ * and skips the ones it missed. The sample goes straight into its bucket on every level, recycling
+ * the oldest bucket of a level when a new one starts, so a sample costs O(`SERIES_LEVELS`) and the
+ * memory never grows. Only one thread may add samples; readers never block it.
+ *
+ * @param[in,out] series  Pointer to the `ResourceSeries`.
+ * @param[in]     now_ns  Monotonic time of the sample.
+ * @param[in]     amount  Amount of the resource at that time.
+ */
+void series_sample(ResourceSeries *series, long long now_ns, int amount) {
+    long long width = series->interval_ns, number;
+    SeriesBucket *bucket;
+    double t;
+
+    if (series->start_ns == 0) {
+        series->start_ns = now_ns;
+        series->next_ns = now_ns;
+    }
+    if (now_ns < series->next_ns) {
+        return;
+    }
+    t = (now_ns - series->start_ns) / 1e9;
+
+    subsys_seq_write_begin(&series->seq);
+    for (int level = 0; level < SERIES_LEVELS; level++, width *= SERIES_FANOUT) {
+        number = (now_ns - series->start_ns) / width;
+        bucket = &series->levels[level][number % SERIES_SLOTS];
+        if (bucket->number != number) {
+            bucket->number = number;
+            bucket->count = 0;
+            bucket->sum = 0.0;
+            bucket->sum_t = 0.0;
+            bucket->sum_tt = 0.0;
+            bucket->sum_ta = 0.0;
+        }
+        series_bucket_add(bucket, t, amount);
+    }
+    series->last_ns = now_ns;
+    series->samples++;
+    subsys_seq_write_end(&series->seq);
+
+    series->next_ns += series->interval_ns * ((now_ns - series->next_ns) / series->interval_ns + 1);
+}
+
+/**
+ * Works out the min, max, mean and slope of the samples in the window ending at the latest one.
+ *
+ * The finest level that still holds the whole window answers, merging at most `SERIES_SLOTS` of
+ * its buckets whatever the window, so the cost does not grow with the window or the history.
+ * The window is rounded out to whole buckets of that level, at most 1/(`SERIES_SLOTS` - 1) of it
+ * on fine levels; `span_ns` reports what was covered. A window longer than the coarsest level
+ * holds is cut to it. The read is retried if a sample lands meanwhile, so any thread may query.
+ *
+ * @param[in]  series     Pointer to the `ResourceSeries`.
+ * @param[in]  window_ns  Length of the window in nanoseconds.
+ * @param[out] stats      Pointer to the `SeriesStats` to fill.
+ * @return                `STATUS_OK`, or `STATUS_EMPTY` if the series has no sample yet.
+ */
+int series_query(const ResourceSeries *series, long long window_ns, SeriesStats *stats) {
+    SeriesBucket total;
+    long long width, newest, oldest, number;
+    unsigned int start;
+    int level;
+    double denominator;
+
+    do {
+        start = subsys_seq_read_begin(&series->seq);
+        total.count = 0;
+        total.sum = 0.0;
+        total.sum_t = 0.0;
+        total.sum_tt = 0.0;
+        total.sum_ta = 0.0;
+        stats->span_ns = 0;
+
+        if (series->samples == 0) {
+            continue;
+        }
+
+        width = series->interval_ns;
+        for (level = 0; level < SERIES_LEVELS - 1; level++, width *= SERIES_FANOUT) {
+            if (window_ns / width < SERIES_SLOTS - 1) {
+                break;
+            }
+        }
+        newest = (series->last_ns - series->start_ns) / width;
+        oldest = (series->last_ns - series->start_ns - window_ns) / width;
+        oldest = oldest < 0 ? 0 : oldest;
+        oldest = oldest < newest - (SERIES_SLOTS - 1) ? newest - (SERIES_SLOTS - 1) : oldest;
+
+        for (number = oldest; number <= newest; number++) {
+            const SeriesBucket *bucket = &series->levels[level][number % SERIES_SLOTS];
+            if (bucket->number == number) {
+                series_bucket_merge(&total, bucket);
+            }
+        }
+        stats->span_ns = (newest - oldest + 1) * width;
+    } while (subsys_seq_read_retry(&series->seq, start));
+
+    stats->count = total.count;
+    if (total.count == 0) {
+        stats->min = 0;
+        stats->max = 0;
+        stats->mean = 0.0;
+        stats->slope = 0.0;
+        return STATUS_EMPTY;
+    }
+
+    stats->min = total.min;
+    stats->max = total.max;
+    stats->mean = total.sum / total.count;
+    denominator = total.count * total.sum_tt - total.sum_t * total.sum_t;
+    stats->slope = denominator > 0.0 ? (total.count * total.sum_ta - total.sum_t * total.sum) / denominator : 0.0;
+    return STATUS_OK;
+}
+
+/**
+ * Gives every resource of the manager a history sampled every `interval_ms`.
+ *
+ * Resources that already have one keep it.
+ *
+ * @param[in,out] manager      Pointer to the `Manager`.
+ * @param[in]     interval_ms  Time between samples in milliseconds.
+ */
+void manager_series_attach(Manager *manager, int interval_ms) {
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        Resource *resource = manager->resource_array.resources[i];
+        if (resource->series == NULL) {
+            resource->series = series_create(interval_ms * 1000000LL);
+        }
+    }
+}
+
+/**
+ * Samples every resource with a history whose next sample is due.
+ *
+ * Called by the manager on each pass, so samples are never closer together than its passes.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void manager_series_sample(Manager *manager) {
+    int count;
+    Resource **resources = resource_array_read(&manager->resource_array, &count);
+    long long now_ns = latency_now_ns();
+
+    for (int i = 0; i < count; i++) {
+        if (resources[i]->series != NULL) {
+            series_sample(resources[i]->series, now_ns, __atomic_load_n(&resources[i]->amount, __ATOMIC_RELAXED));
+        }
+    }
+}
+
+/**
+ * Prints the min, max, mean and rate of every recorded resource over its last second and whole history.
+ *
+ * The last second is left out while the history is no longer than that.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ */
+void manager_series_print(const Manager *manager) {
+    static const long long windows_ns[] = { SERIES_DISPLAY_WINDOW_MS * 1000000LL, 0 };
+    SeriesStats stats;
+    int printed = 0;
+
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        Resource *resource = manager->resource_array.resources[i];
+        if (resource->series == NULL) {
+            continue;
+        }
+
+        if (!printed) {
+            printf("%-20s %8s %9s %7s %7s %9s %10s\n", "Series", "Window", "Samples", "Min", "Max", "Mean", "Rate/s");
+            printed = 1;
+        }
+        for (int w = 0; w < 2; w++) {
+            // The whole history is the longest window the coarsest level can hold
+            long long history_ns = resource->series->last_ns - resource->series->start_ns;
+            long long window_ns = windows_ns[w] > 0 ? windows_ns[w] : history_ns;
+            if ((windows_ns[w] > 0 && windows_ns[w] >= history_ns) || series_query(resource->series, window_ns, &stats) != STATUS_OK) {
+                continue;
+            }
+            printf("%-20s %7.2fs %9d %7d %7d %9.1f %10.2f\n", resource->name, stats.span_ns / 1e9,
+                   stats.count, stats.min, stats.max, stats.mean, stats.slope);
+        }
+    }
+}
+
+/**
+ * Frees the history of every resource of the manager.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void manager_series_clean(Manager *manager) {
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        series_destroy(manager->resource_array.resources[i]->series);
+        manager->resource_array.resources[i]->series = NULL;
+    }
+}
+
+/**
+ * Adds one sample to a bucket.
+ *
+ * @param[in,out] bucket  Pointer to the `SeriesBucket`.
+ * @param[in]     t       Time of the sample in seconds since the first sample.
+ * @param[in]     amount  Amount sampled.
+ */
+static void series_bucket_add(SeriesBucket *bucket, double t, int amount) {
+    if (bucket->count == 0 || amount < bucket->min) {
+        bucket->min = amount;
+    }
+    if (bucket->count == 0 || amount > bucket->max) {
+        bucket->max = amount;
+    }
+    bucket->count++;
+    bucket->sum += amount;
+    bucket->sum_t += t;
+    bucket->sum_tt += t * t;
+    bucket->sum_ta += t * amount;
+}
+
+/**
+ * Merges a bucket into a running total.
+ *
+ * @param[in,out] into    Pointer to the total, its min and max are only valid once it counts a sample.
+ * @param[in]     bucket  Pointer to the `SeriesBucket` to add.
+ */
+static void series_bucket_merge(SeriesBucket *into, const SeriesBucket *bucket) {
+    if (bucket->count == 0) {
+        return;
+    }
+    if (into->count == 0 || bucket->min < into->min) {
+        into->min = bucket->min;
+    }
+    if (into->count == 0 || bucket->max > into->max) {
+        into->max = bucket->max;
+    }
+    into->count += bucket->count;
+    into->sum += bucket->sum;
+    into->sum_t += bucket->sum_t;
+    into->sum_tt += bucket->sum_tt;
+    into->sum_ta += bucket->sum_ta;
+}
@@ -0,0 +1,592 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+
+// One system thread inside a worker process
+typedef struct SharedThread {
+    SharedHeader *header;
+    int index;              // Index of the system in the segment
+    pthread_t thread;
+} SharedThread;
+
+// Where the manager process finds the parts of the segment, kept in its own memory
+// Workers can write anywhere in the segment, so the manager never reads a count, offset or size back from it
+typedef struct SharedLayout {
+    SharedHeader *header;
+    unsigned long size;
+    int resource_count;
+    int system_count;
+    SharedResource *resources;
+    SharedSystem *systems;
+    SharedChannel *channels;
+} SharedLayout;
+
+static int shared_segment_create(Manager *manager, System **systems, int workers, SharedLayout *layout);
+static int shared_resource_index(Manager *manager, const Resource *resource);
+static void shared_worker(SharedHeader *header, int worker, int crash, pid_t manager_pid);
+static void *shared_system_thread(void *arg);
+static long long shared_system_step(SharedHeader *header, int index);
+static void shared_report(SharedHeader *header, int index, int resource, int status, int priority);
+static int shared_sleep(SharedHeader *header, long long deadline_ns);
+static void shared_stop(SharedHeader *header);
+static void shared_collect(Manager *manager, System **systems, const SharedLayout *layout, ProcessStats *stats);
+static void shared_publish(System **systems, const SharedLayout *layout);
+static SharedResource *shared_resources(SharedHeader *header);
+static SharedSystem *shared_systems(SharedHeader *header);
+static SharedChannel *shared_channels(SharedHeader *header);
+
+/**
+ * Runs the systems in worker processes sharing the resources through a POSIX shared-memory segment.
+ *
+ * The resources, every system's control state and one event ring per system are copied into a
+ * segment that links everything by offset and index, never by pointer. `workers` processes are
+ * forked, each running a contiguous slice of the systems on one thread per system, like
+ * `--threaded`. This process stays the manager: every `MANAGER_WAIT_TIME` it copies the shared
+ * amounts into its own resources, hands the shared events to `manager_run` and writes the
+ * statuses it set back to the segment.
+ *
+ * Every shared write is a single atomic operation and no lock is ever held in the segment, so a
+ * worker that dies mid-step leaves the resources consistent: it loses at most what its systems
+ * had consumed and not yet stored, and its systems simply stop. The manager reports the crash
+ * and carries on with the other workers. Workers are killed if the manager process dies.
+ * Systems added or removed while running are not picked up.
+ *
+ * @param[in,out] manager       Pointer to the loaded `Manager`, its systems must use the shared queue.
+ * @param[in]     workers       Worker processes to fork, at most `SHARED_MAX_WORKERS`.
+ * @param[in]     crash_worker  Worker killed `SHARED_CRASH_DELAY_MS` into the run to check isolation, -1 for none.
+ * @param[out]    stats         Pointer to the `ProcessStats` to fill.
+ * @return                      0 on success, -1 if the segment or the workers could not be set up.
+ */
+int manager_run_processes(Manager *manager, int workers, int crash_worker, ProcessStats *stats) {
+    SharedLayout layout;
+    System **systems;
+    pid_t pids[SHARED_MAX_WORKERS];
+    int alive[SHARED_MAX_WORKERS];
+    pid_t manager_pid = getpid();
+    long long start_ns;
+    int count, started = 0, running, wstatus, i;
+
+    memset(stats, 0, sizeof(ProcessStats));
+    if (workers < 1 || workers > SHARED_MAX_WORKERS) {
+        return -1;
+    }
+
+    systems = system_array_read(&manager->system_array, &count);
+    if (shared_segment_create(manager, systems, workers, &layout) != 0) {
+        return -1;
+    }
+
+    // Buffered output would be written again by every worker that exits through stdio
+    fflush(NULL);
+    start_ns = latency_now_ns();
+    for (i = 0; i < workers; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            shared_worker(layout.header, i, i == crash_worker, manager_pid);
+        }
+        if (pids[i] < 0) {
+            break;
+        }
+        alive[i] = 1;
+        started++;
+    }
+
+    // A missing worker would leave its systems without anyone to run them
+    if (started < workers) {
+        shared_stop(layout.header);
+        for (i = 0; i < started; i++) {
+            waitpid(pids[i], NULL, 0);
+        }
+        munmap(layout.header, layout.size);
+        return -1;
+    }
+    stats->workers = started;
+
+    running = started;
+    while (manager->simulation_running && running > 0) {
+        shared_collect(manager, systems, &layout, stats);
+        manager_run(manager);
+        shared_publish(systems, &layout);
+
+        // Any worker that exits before being stopped has crashed, the others keep going
+        for (i = 0; i < started; i++) {
+            if (alive[i] && waitpid(pids[i], &wstatus, WNOHANG) == pids[i]) {
+                alive[i] = 0;
+                running--;
+                stats->crashed++;
+                fprintf(stderr, "Worker %d (pid %d) died %s %d, its systems stopped\n", i, (int)pids[i],
+                        WIFSIGNALED(wstatus) ? "from signal" : "with status",
+                        WIFSIGNALED(wstatus) ? WTERMSIG(wstatus) : WEXITSTATUS(wstatus));
+            }
+        }
+        shutdown_sleep(&manager->shutdown, MANAGER_WAIT_TIME * 1000);
+    }
+    if (running == 0) {
+        fprintf(stderr, "Every worker died, stopping the run\n");
+    }
+
+    shared_stop(layout.header);
+    for (i = 0; i < started; i++) {
+        if (alive[i] && waitpid(pids[i], &wstatus, 0) == pids[i] &&
+            (WIFSIGNALED(wstatus) || WEXITSTATUS(wstatus) != 0)) {
+            stats->crashed++;
+        }
+    }
+    stats->elapsed_ns = latency_now_ns() - start_ns;
+
+    // The workers are gone, so their side of the segment can be read plainly
+    for (i = 0; i < layout.system_count; i++) {
+        systems[i]->amount_stored = layout.systems[i].amount_stored;
+        systems[i]->phase = layout.systems[i].phase;
+        systems[i]->conversions = layout.systems[i].conversions;
+        stats->conversions += layout.systems[i].conversions;
+        stats->dropped += layout.channels[i].dropped;
+    }
+    for (i = 0; i < layout.resource_count; i++) {
+        manager->resource_array.resources[i]->amount = layout.resources[i].amount;
+    }
+
+    munmap(layout.header, layout.size);
+    return 0;
+}
+
+/**
+ * Creates the shared-memory segment and copies the resources and systems into it.
+ *
+ * The segment is unlinked as soon as it is mapped, forked workers inherit the mapping and no run
+ * can leave a segment behind.
+ *
+ * @param[in]  manager  Pointer to the `Manager` whose resources are copied.
+ * @param[in]  systems  The manager's systems, in the order they get in the segment.
+ * @param[in]  workers  Number of worker processes to split the systems between.
+ * @param[out] layout   Pointer to the manager's `SharedLayout` of the mapped segment.
+ * @return              0 on success, -1 on failure.
+ */
+static int shared_segment_create(Manager *manager, System **systems, int workers, SharedLayout *layout) {
+    SharedHeader *header;
+    SharedResource *resources;
+    SharedSystem *shared;
+    unsigned long size;
+    char name[64];
+    int resource_count = manager->resource_array.size;
+    int count = manager->system_array.size;
+    int fd, i;
+
+    // Every part starts on a cache line, the structs are sized in whole lines
+    size = (sizeof(SharedHeader) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    size += sizeof(SharedResource) * resource_count;
+    size += (sizeof(SharedSystem) + sizeof(SharedChannel)) * count;
+
+    snprintf(name, sizeof(name), "/rocket-simulation-%d", (int)getpid());
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    shm_unlink(name);
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return -1;
+    }
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        return -1;
+    }
+
+    // ftruncate zero-fills, so the channels start empty
+    header->magic = SHARED_MAGIC;
+    header->resource_count = resource_count;
+    header->system_count = count;
+    header->workers = workers;
+    header->size = size;
+    header->resources = (sizeof(SharedHeader) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    header->systems = header->resources + sizeof(SharedResource) * resource_count;
+    header->channels = header->systems + sizeof(SharedSystem) * count;
+    header->terminated = 0;
+
+    resources = shared_resources(header);
+    for (i = 0; i < resource_count; i++) {
+        resources[i].amount = manager->resource_array.resources[i]->amount;
+        resources[i].max_capacity = manager->resource_array.resources[i]->max_capacity;
+    }
+
+    // Systems keep their state, so a restored checkpoint resumes mid-step
+    shared = shared_systems(header);
+    for (i = 0; i < count; i++) {
+        shared[i].consumed = shared_resource_index(manager, systems[i]->consumed.resource);
+        shared[i].consumed_amount = systems[i]->consumed.amount;
+        shared[i].produced = shared_resource_index(manager, systems[i]->produced.resource);
+        shared[i].produced_amount = systems[i]->produced.amount;
+        shared[i].processing_time = systems[i]->processing_time;
+        shared[i].worker = (int)((long long)i * workers / count);
+        shared[i].status = systems[i]->status;
+        shared[i].amount_stored = systems[i]->amount_stored;
+        shared[i].phase = systems[i]->phase;
+        shared[i].resume_us = systems[i]->resume_us;
+        shared[i].conversions = systems[i]->conversions;
+    }
+
+    layout->header = header;
+    layout->size = size;
+    layout->resource_count = resource_count;
+    layout->system_count = count;
+    layout->resources = resources;
+    layout->systems = shared;
+    layout->channels = shared_channels(header);
+    return 0;
+}
+
+/**
+ * Finds the index of a resource in the manager's resource array.
+ *
+ * @param[in] manager   Pointer to the `Manager`.
+ * @param[in] resource  Pointer to the `Resource`, may be NULL.
+ * @return              The index, or -1 for NULL or a resource the manager does not hold.
+ */
+static int shared_resource_index(Manager *manager, const Resource *resource) {
+    for (int i = 0; resource != NULL && i < manager->resource_array.size; i++) {
+        if (manager->resource_array.resources[i] == resource) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Worker process body, runs its slice of the systems until the manager stops them. Never returns.
+ *
+ * @param[in,out] header       Pointer to the mapped `SharedHeader`.
+ * @param[in]     worker       Index of this worker.
+ * @param[in]     crash        Non-zero to kill the worker `SHARED_CRASH_DELAY_MS` into the run.
+ * @param[in]     manager_pid  Process ID of the manager.
+ */
+static void shared_worker(SharedHeader *header, int worker, int crash, pid_t manager_pid) {
+    SharedSystem *systems = shared_systems(header);
+    SharedThread *threads = malloc(sizeof(SharedThread) * (header->system_count > 0 ? header->system_count : 1));
+    int started = 0, i;
+
+    // Nobody would stop the systems once the manager is gone
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != manager_pid || threads == NULL) {
+        _exit(1);
+    }
+
+    TRACE_THREAD_NAME("Worker process");
+    for (i = 0; i < header->system_count; i++) {
+        if (systems[i].worker != worker) {
+            continue;
+        }
+        threads[started].header = header;
+        threads[started].index = i;
+        if (pthread_create(&threads[started].thread, NULL, shared_system_thread, &threads[started]) == 0) {
+            started++;
+        }
+    }
+
+    // Stands in for a faulty system model taking its whole process down mid-run
+    if (crash && !shared_sleep(header, latency_now_ns() + SHARED_CRASH_DELAY_MS * 1000000LL)) {
+        raise(SIGKILL);
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    free(threads);
+    _exit(0);
+}
+
+/**
+ * Thread body of one shared system, the same loop and paced waits as `system_thread`.
+ *
+ * @param[in,out] arg  Pointer to the `SharedThread`.
+ * @return             NULL.
+ */
+static void *shared_system_thread(void *arg) {
+    SharedThread *thread = (SharedThread*)arg;
+    SharedHeader *header = thread->header;
+    SharedSystem *system = &shared_systems(header)[thread->index];
+    long long deadline_ns = latency_now_ns(), now_ns, wait_us;
+
+    // A restored system finishes the wait it was checkpointed in first
+    if (system->resume_us > 0) {
+        deadline_ns += system->resume_us * 1000;
+        if (shared_sleep(header, deadline_ns)) {
+            return NULL;
+        }
+    }
+
+    for (;;) {
+        // A terminated system stops at the start of its next pass
+        if (system->phase == SYSTEM_PHASE_START &&
+            (__atomic_load_n(&system->status, __ATOMIC_RELAXED) == TERMINATE ||
+             __atomic_load_n(&header->terminated, __ATOMIC_RELAXED))) {
+            break;
+        }
+
+        wait_us = shared_system_step(header, thread->index);
+        if (wait_us > 0) {
+            now_ns = latency_now_ns();
+            if (now_ns - deadline_ns > PACING_RESYNC_US * 1000LL) {
+                deadline_ns = now_ns;
+            }
+            deadline_ns += wait_us * 1000;
+            if (shared_sleep(header, deadline_ns)) {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Advances a shared system up to its next wait, the state machine of `system_step` on indices.
+ *
+ * @param[in,out] header  Pointer to the mapped `SharedHeader`.
+ * @param[in]     index   Index of the system.
+ * @return                Microseconds to wait before the next step.
+ */
+static long long shared_system_step(SharedHeader *header, int index) {
+    SharedResource *resources = shared_resources(header);
+    SharedSystem *system = &shared_systems(header)[index];
+    SharedResource *resource;
+    int current, amount, stored;
+
+    if (system->phase == SYSTEM_PHASE_START && system->amount_stored == 0) {
+        // Consume all or nothing, we can always convert without consuming anything
+        if (system->consumed >= 0) {
+            resource = &resources[system->consumed];
+            amount = system->consumed_amount;
+            current = __atomic_load_n(&resource->amount, __ATOMIC_RELAXED);
+            while (current >= amount &&
+                   !__atomic_compare_exchange_n(&resource->amount, &current, current - amount,
+                                                1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            }
+            if (current < amount) {
+                shared_report(header, index, system->consumed, current == 0 ? STATUS_EMPTY : STATUS_INSUFFICIENT, PRIORITY_HIGH);
+                system->phase = SYSTEM_PHASE_STORE;
+                return SYSTEM_WAIT_TIME * 1000;
+            }
+        }
+
+        system->phase = SYSTEM_PHASE_PROCESSING;
+        switch (__atomic_load_n(&system->status, __ATOMIC_RELAXED)) {
+            case SLOW:
+                return system->processing_time * 2000LL;
+            case FAST:
+                return system->processing_time * 500LL;
+            default:
+                return system->processing_time * 1000LL;
+        }
+    }
+
+    if (system->phase == SYSTEM_PHASE_PROCESSING) {
+        system->conversions++;
+        system->amount_stored = system->produced >= 0 ? system->amount_stored + system->produced_amount : 0;
+    }
+    system->phase = SYSTEM_PHASE_START;
+
+    if (system->amount_stored > 0) {
+        if (system->produced < 0) {
+            system->amount_stored = 0;
+            return 0;
+        }
+
+        // Store as much as fits
+        resource = &resources[system->produced];
+        amount = system->amount_stored;
+        current = __atomic_load_n(&resource->amount, __ATOMIC_RELAXED);
+        do {
+            stored = resource->max_capacity - current;
+            stored = stored >= amount ? amount : stored;
+            if (stored <= 0) {
+                stored = 0;
+                break;
+            }
+        } while (!__atomic_compare_exchange_n(&resource->amount, &current, current + stored,
+                                              1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+        system->amount_stored -= stored;
+        if (stored != amount) {
+            shared_report(header, index, system->produced, STATUS_CAPACITY, PRIORITY_LOW);
+            return SYSTEM_WAIT_TIME * 1000;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reports an event from a shared system to the manager process through the system's channel.
+ *
+ * Like `system_report`, high priority events wait for room unless the run is stopping, and
+ * lower priority ones are dropped and counted.
+ *
+ * @param[in,out] header    Pointer to the mapped `SharedHeader`.
+ * @param[in]     index     Index of the reporting system.
+ * @param[in]     resource  Index of the resource in question.
+ * @param[in]     status    Status of the event.
+ * @param[in]     priority  Priority of the event.
+ */
+static void shared_report(SharedHeader *header, int index, int resource, int status, int priority) {
+    SharedChannel *channel = &shared_channels(header)[index];
+    unsigned int tail = channel->tail;
+    SharedEvent *event;
+
+    while (tail - __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE) >= SHARED_CHANNEL_CAPACITY) {
+        if (priority < PRIORITY_HIGH || __atomic_load_n(&header->terminated, __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&channel->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        sched_yield();
+    }
+
+    event = &channel->slots[tail & (SHARED_CHANNEL_CAPACITY - 1)];
+    event->system = index;
+    event->resource = resource;
+    event->status = status;
+    event->priority = priority;
+    event->amount = __atomic_load_n(&shared_resources(header)[resource].amount, __ATOMIC_RELAXED);
+    event->push_ns = latency_now_ns();
+    // Publishes the slot, the manager never reads one past the tail it sees
+    __atomic_store_n(&channel->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Sleeps until an absolute monotonic deadline, unless the manager stops the run first.
+ *
+ * `FUTEX_WAIT_BITSET` takes an absolute `CLOCK_MONOTONIC` deadline, so the pacing deadline is used
+ * as is, and the futex word lives in the segment so one wake reaches every worker process.
+ *
+ * @param[in,out] header       Pointer to the mapped `SharedHeader`.
+ * @param[in]     deadline_ns  Monotonic time to wake at.
+ * @return                     Non-zero if the run was stopped, before or during the wait.
+ */
+static int shared_sleep(SharedHeader *header, long long deadline_ns) {
+    struct timespec deadline;
+
+    deadline.tv_sec = deadline_ns / 1000000000LL;
+    deadline.tv_nsec = deadline_ns % 1000000000LL;
+    while (!__atomic_load_n(&header->terminated, __ATOMIC_ACQUIRE) && latency_now_ns() < deadline_ns) {
+        syscall(SYS_futex, &header->terminated, FUTEX_WAIT_BITSET, 0, &deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+    }
+    return __atomic_load_n(&header->terminated, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Stops every worker process, waking the systems that are sleeping.
+ *
+ * @param[in,out] header  Pointer to the mapped `SharedHeader`.
+ */
+static void shared_stop(SharedHeader *header) {
+    __atomic_store_n(&header->terminated, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &header->terminated, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * Brings the manager's view up to date with the segment before it runs.
+ *
+ * Copies the shared amounts into the manager's resources, for the display and snapshots, and
+ * queues the events waiting in every channel. Events come from another process, so one with a
+ * field out of range is counted and dropped rather than trusted.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     systems  The manager's systems, in segment order.
+ * @param[in]     layout   Pointer to the manager's `SharedLayout` of the segment.
+ * @param[in,out] stats    Pointer to the `ProcessStats` counting the events.
+ */
+static void shared_collect(Manager *manager, System **systems, const SharedLayout *layout, ProcessStats *stats) {
+    SharedResource *resources = layout->resources;
+    SharedChannel *channels = layout->channels;
+    Event event;
+    int i;
+
+    for (i = 0; i < layout->resource_count; i++) {
+        __atomic_store_n(&manager->resource_array.resources[i]->amount,
+                         __atomic_load_n(&resources[i].amount, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+
+    for (i = 0; i < layout->system_count; i++) {
+        SharedChannel *channel = &channels[i];
+        unsigned int head = channel->head;
+        unsigned int tail = __atomic_load_n(&channel->tail, __ATOMIC_ACQUIRE);
+
+        if (tail - head > SHARED_CHANNEL_CAPACITY) {
+            stats->rejected += tail - head;
+            head = tail;
+        }
+        for (; head != tail; head++) {
+            SharedEvent *shared = &channel->slots[head & (SHARED_CHANNEL_CAPACITY - 1)];
+
+            if (shared->system != i || shared->resource < 0 || shared->resource >= layout->resource_count ||
+                shared->priority < PRIORITY_LOW || shared->priority > PRIORITY_HIGH) {
+                stats->rejected++;
+                continue;
+            }
+            event_init(&event, systems[i], manager->resource_array.resources[shared->resource],
+                       shared->status, shared->priority, shared->amount);
+            event.push_ns = shared->push_ns;
+            event_queue_push(&manager->event_queue, &event);
+            stats->events++;
+        }
+        // Frees the slots for the system
+        __atomic_store_n(&channel->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Writes the statuses the manager set back to the segment, where the workers read them.
+ *
+ * @param[in]     systems  The manager's systems, in segment order.
+ * @param[in]     layout   Pointer to the manager's `SharedLayout` of the segment.
+ */
+static void shared_publish(System **systems, const SharedLayout *layout) {
+    SharedSystem *shared = layout->systems;
+
+    for (int i = 0; i < layout->system_count; i++) {
+        int status = __atomic_load_n(&systems[i]->status, __ATOMIC_RELAXED);
+        // Only changes are written, so the workers' lines are not pulled away every pass
+        if (__atomic_load_n(&shared[i].status, __ATOMIC_RELAXED) != status) {
+            __atomic_store_n(&shared[i].status, status, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * Returns the resources of a segment.
+ *
+ * @param[in] header  Pointer to the mapped `SharedHeader`.
+ * @return            The `SharedResource` array.
+ */
+static SharedResource *shared_resources(SharedHeader *header) {
+    return (SharedResource*)((char*)header + header->resources);
+}
+
+/**
+ * Returns the systems of a segment.
+ *
+ * @param[in] header  Pointer to the mapped `SharedHeader`.
+ * @return            The `SharedSystem` array.
+ */
+static SharedSystem *shared_systems(SharedHeader *header) {
+    return (SharedSystem*)((char*)header + header->systems);
+}
+
+/**
+ * Returns the event channels of a segment.
+ *
+ * @param[in] header  Pointer to the mapped `SharedHeader`.
+ * @return            The `SharedChannel` array, one per system.
+ */
+static SharedChannel *shared_channels(SharedHeader *header) {
+    return (SharedChannel*)((char*)header + header->channels);
+}
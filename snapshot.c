@@ -0,0 +1,235 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <sched.h>
+
+static int snapshot_frame_reserve(SnapshotFrame *frame, int resource_count, int system_count);
+
+/**
+ * Points every system at the manager's commit counters, so their writes are seen by snapshots.
+ *
+ * Must be called after all systems are added and before they run.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void manager_snapshot_attach(Manager *manager) {
+    for (int i = 0; i < manager->system_array.size; i++) {
+        manager->system_array.systems[i]->snapshot_seq = &manager->snapshot_seq;
+    }
+}
+
+/**
+ * Copies every resource amount and system status into a consistent frame.
+ *
+ * The copy is retried until no commit overlapped it, so the frame shows a state the simulation
+ * was really in, never Fuel already debited by a commit that has not finished. Producers are
+ * never stopped. Each attempt costs O(resources + systems). The frame keeps the array versions it
+ * copied, so its entries line up with its values even if systems are added or removed meanwhile.
+ *
+ * @param[in]     manager  Pointer to the `Manager` to snapshot.
+ * @param[in,out] frame    Pointer to the `SnapshotFrame` to fill, grown as needed.
+ */
+void manager_snapshot(Manager *manager, SnapshotFrame *frame) {
+    int resource_count, system_count;
+    Resource **resources = resource_array_read(&manager->resource_array, &resource_count);
+    System **systems = system_array_read(&manager->system_array, &system_count);
+    unsigned long start, end;
+    int i;
+
+    if (snapshot_frame_reserve(frame, resource_count, system_count) != STATUS_OK) {
+        return;
+    }
+
+    for (;;) {
+        // Ends first: if every commit counted as started had already ended, none is in progress
+        end = __atomic_load_n(&manager->snapshot_seq.end, __ATOMIC_ACQUIRE);
+        start = __atomic_load_n(&manager->snapshot_seq.start, __ATOMIC_ACQUIRE);
+
+        if (start == end) {
+            for (i = 0; i < resource_count; i++) {
+                frame->amounts[i] = __atomic_load_n(&resources[i]->amount, __ATOMIC_RELAXED);
+            }
+            for (i = 0; i < system_count; i++) {
+                frame->statuses[i] = __atomic_load_n(&systems[i]->status, __ATOMIC_RELAXED);
+            }
+
+            // Pairs with the fence in snapshot_commit_begin: a copied write means its start is visible
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&manager->snapshot_seq.start, __ATOMIC_RELAXED) == start) {
+                break;
+            }
+        }
+        // A writer is mid-commit, let it finish rather than spin through its time slice
+        frame->retries++;
+        sched_yield();
+    }
+
+    frame->resources = resources;
+    frame->resource_count = resource_count;
+    frame->systems = systems;
+    frame->system_count = system_count;
+    frame->commit = start;
+}
+
+/**
+ * Initializes `SnapshotSeq` counters with no commits.
+ *
+ * @param[out] seq  Pointer to the `SnapshotSeq` to initialize.
+ */
+void snapshot_seq_init(SnapshotSeq *seq) {
+    seq->start = 0;
+    seq->end = 0;
+    seq->barrier = 0;
+}
+
+/**
+ * Marks the start of a commit, before any amount or status it changes is written.
+ *
+ * @param[in,out] seq  Pointer to the `SnapshotSeq`, may be NULL when snapshots are not tracked.
+ */
+void snapshot_commit_begin(SnapshotSeq *seq) {
+    if (seq != NULL) {
+        __atomic_fetch_add(&seq->start, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Marks the end of a commit, after everything it changed is written.
+ *
+ * @param[in,out] seq  Pointer to the `SnapshotSeq`, may be NULL when snapshots are not tracked.
+ */
+void snapshot_commit_end(SnapshotSeq *seq) {
+    if (seq != NULL) {
+        __atomic_fetch_add(&seq->end, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Marks the start of a system step, waiting first while a barrier is raised.
+ *
+ * The step is counted like a commit and ended with `snapshot_commit_end`, so a barrier knows when
+ * no step is in progress. A step that raced the barrier backs out and waits for it to be lowered.
+ *
+ * @param[in,out] seq  Pointer to the `SnapshotSeq`, may be NULL when snapshots are not tracked.
+ */
+void snapshot_step_begin(SnapshotSeq *seq) {
+    if (seq == NULL) {
+        return;
+    }
+
+    for (;;) {
+        while (__atomic_load_n(&seq->barrier, __ATOMIC_ACQUIRE)) {
+            sched_yield();
+        }
+
+        // Either this thread sees the barrier or the one raising it sees this step begun
+        __atomic_fetch_add(&seq->start, 1, __ATOMIC_SEQ_CST);
+        if (!__atomic_load_n(&seq->barrier, __ATOMIC_SEQ_CST)) {
+            return;
+        }
+        __atomic_fetch_add(&seq->end, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Holds every system at the start of its next step and waits for the steps in progress to end.
+ *
+ * Until `snapshot_barrier_lower`, the caller can read what the systems' own threads write, such as
+ * their phase and deadlines, along with every amount and status. Systems waiting out a processing
+ * time or backoff are not woken, they are only held if their wait ends meanwhile. Only one
+ * thread may raise the barrier, and it must not run steps or commits of its own while it is up.
+ * A step can be stuck waiting for room in a full queue only the caller empties, so the barrier
+ * is given up after `timeout_us` rather than waited on forever.
+ *
+ * @param[in,out] seq         Pointer to the `SnapshotSeq`.
+ * @param[in]     timeout_us  Longest time to wait for the steps in progress.
+ * @return                    0 once no step is in progress, -1 if the barrier timed out and was lowered.
+ */
+int snapshot_barrier_raise(SnapshotSeq *seq, long long timeout_us) {
+    long long give_up_ns = latency_now_ns() + timeout_us * 1000;
+    unsigned long start, end;
+
+    __atomic_store_n(&seq->barrier, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+        // Ends first, as in manager_snapshot
+        end = __atomic_load_n(&seq->end, __ATOMIC_SEQ_CST);
+        start = __atomic_load_n(&seq->start, __ATOMIC_SEQ_CST);
+        if (start == end) {
+            return 0;
+        }
+        if (latency_now_ns() >= give_up_ns) {
+            snapshot_barrier_lower(seq);
+            return -1;
+        }
+        sched_yield();
+    }
+}
+
+/**
+ * Lets the systems held by `snapshot_barrier_raise` step again.
+ *
+ * @param[in,out] seq  Pointer to the `SnapshotSeq`.
+ */
+void snapshot_barrier_lower(SnapshotSeq *seq) {
+    __atomic_store_n(&seq->barrier, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Initializes an empty `SnapshotFrame`, its arrays are allocated by the first snapshot.
+ *
+ * @param[out] frame  Pointer to the `SnapshotFrame` to initialize.
+ */
+void snapshot_frame_init(SnapshotFrame *frame) {
+    frame->amounts = NULL;
+    frame->resource_count = 0;
+    frame->resource_capacity = 0;
+    frame->statuses = NULL;
+    frame->resources = NULL;
+    frame->systems = NULL;
+    frame->system_count = 0;
+    frame->system_capacity = 0;
+    frame->commit = 0;
+    frame->retries = 0;
+}
+
+/**
+ * Frees the arrays of a `SnapshotFrame`.
+ *
+ * @param[in,out] frame  Pointer to the `SnapshotFrame` to clean.
+ */
+void snapshot_frame_clean(SnapshotFrame *frame) {
+    free(frame->amounts);
+    free(frame->statuses);
+    snapshot_frame_init(frame);
+}
+
+/**
+ * Makes sure a frame has room for the given numbers of resources and systems.
+ *
+ * @param[in,out] frame           Pointer to the `SnapshotFrame`.
+ * @param[in]     resource_count  Resources to hold.
+ * @param[in]     system_count    Systems to hold.
+ * @return                        `STATUS_OK`, or `STATUS_EMPTY` if the memory could not be allocated.
+ */
+static int snapshot_frame_reserve(SnapshotFrame *frame, int resource_count, int system_count) {
+    if (resource_count > frame->resource_capacity) {
+        int *amounts = malloc(sizeof(int) * resource_count);
+        if (amounts == NULL) {
+            return STATUS_EMPTY;
+        }
+        free(frame->amounts);
+        frame->amounts = amounts;
+        frame->resource_capacity = resource_count;
+    }
+
+    if (system_count > frame->system_capacity) {
+        int *statuses = malloc(sizeof(int) * system_count);
+        if (statuses == NULL) {
+            return STATUS_EMPTY;
+        }
+        free(frame->statuses);
+        frame->statuses = statuses;
+        frame->system_capacity = system_count;
+    }
+    return STATUS_OK;
+}
@@ -0,0 +1,399 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define STREAM_BUFFER_SIZE (256 * 1024)     // Bytes the writer batches into each write()
+#define STREAM_IDLE_US 1000                 // Writer sleep when the ring is empty
+#define STREAM_SNAPSHOT_NS 10000000LL       // At most one resource snapshot per 10 ms
+#define STREAM_BINARY_MAGIC "RKTSTRM1"
+
+#define STREAM_BINARY_NAME     1    // u32 id, u16 length, name bytes
+#define STREAM_BINARY_EVENT    2    // i64 ns, u32 system, u32 resource, i32 status, i32 priority, i32 amount
+#define STREAM_BINARY_RESOURCE 3    // i64 ns, u32 resource, i32 amount, i32 max_capacity
+#define STREAM_BINARY_ITERATION 4   // i64 ns, i32 iteration
+
+static int stream_push(OutputStream *stream, const StreamRecord *record);
+static void *stream_writer(void *arg);
+static void stream_flush(OutputStream *stream);
+static void stream_encode_ndjson(OutputStream *stream, const StreamRecord *record);
+static void stream_encode_binary(OutputStream *stream, const StreamRecord *record);
+static unsigned int stream_name_id(OutputStream *stream, const char *name);
+static void stream_put(OutputStream *stream, const void *data, size_t size);
+
+/**
+ * Opens the output and starts the writer thread of a headless `OutputStream`.
+ *
+ * @param[out] stream  Pointer to the `OutputStream` to start.
+ * @param[in]  format  `STREAM_NDJSON` or `STREAM_BINARY`.
+ * @param[in]  path    File to write, NULL or "-" for standard output.
+ * @return             0 on success, -1 if the output or the writer could not be set up.
+ */
+int output_stream_start(OutputStream *stream, int format, const char *path) {
+    memset(stream, 0, sizeof(*stream));
+    stream->format = format;
+    stream->mask = STREAM_CAPACITY - 1;
+    stream->slots = malloc(sizeof(StreamRecord) * STREAM_CAPACITY);
+    stream->buffer = malloc(STREAM_BUFFER_SIZE);
+    stream->last_snapshot_ns = -STREAM_SNAPSHOT_NS;
+
+    if (path == NULL || strcmp(path, "-") == 0) {
+        stream->fd = STDOUT_FILENO;
+    } else {
+        stream->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (stream->slots == NULL || stream->buffer == NULL || stream->fd < 0) {
+        output_stream_stop(stream);
+        return -1;
+    }
+
+    if (format == STREAM_BINARY) {
+        stream_put(stream, STREAM_BINARY_MAGIC, sizeof(STREAM_BINARY_MAGIC) - 1);
+    }
+
+    stream->running = 1;
+    if (pthread_create(&stream->thread, NULL, stream_writer, stream) != 0) {
+        stream->running = 0;
+        output_stream_stop(stream);
+        return -1;
+    }
+    stream->started = 1;
+    return 0;
+}
+
+/**
+ * Stops the writer once it has drained the ring, flushes and closes the output.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream` to stop.
+ */
+void output_stream_stop(OutputStream *stream) {
+    if (stream->started) {
+        __atomic_store_n(&stream->running, 0, __ATOMIC_RELEASE);
+        pthread_join(stream->thread, NULL);
+        stream->started = 0;
+    }
+
+    if (stream->fd >= 0) {
+        stream_flush(stream);
+        if (stream->fd != STDOUT_FILENO) {
+            close(stream->fd);
+        }
+        stream->fd = -1;
+    }
+
+    free(stream->slots);
+    free(stream->buffer);
+    free(stream->names);
+    stream->slots = NULL;
+    stream->buffer = NULL;
+    stream->names = NULL;
+}
+
+/**
+ * Queues an event record.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ * @param[in]     event   Pointer to the handled `Event`.
+ */
+void output_stream_event(OutputStream *stream, const Event *event) {
+    StreamRecord record;
+
+    record.type = STREAM_RECORD_EVENT;
+    record.ts_ns = latency_now_ns();
+    record.system = event->system->name;
+    record.resource = event->resource->name;
+    record.status = event->status;
+    record.priority = event->priority;
+    record.amount = event->amount;
+    record.max_capacity = 0;
+    stream_push(stream, &record);
+}
+
+/**
+ * Queues one record per resource with its current amount.
+ *
+ * Rate-limited to one snapshot per `STREAM_SNAPSHOT_NS`, so it can be called on every manager pass.
+ * The amounts come from one consistent frame.
+ *
+ * @param[in,out] stream   Pointer to the `OutputStream`.
+ * @param[in,out] manager  Pointer to the `Manager` whose resources are recorded, its frame is refreshed.
+ */
+void output_stream_snapshot(OutputStream *stream, Manager *manager) {
+    long long now_ns = latency_now_ns();
+    StreamRecord record;
+
+    if (now_ns - stream->last_snapshot_ns < STREAM_SNAPSHOT_NS) {
+        return;
+    }
+    stream->last_snapshot_ns = now_ns;
+
+    record.type = STREAM_RECORD_RESOURCE;
+    record.ts_ns = now_ns;
+    record.system = NULL;
+    record.status = 0;
+    record.priority = 0;
+    manager_snapshot(manager, &manager->frame);
+    for (int i = 0; i < manager->frame.resource_count; i++) {
+        Resource *resource = manager->frame.resources[i];
+        record.resource = resource->name;
+        record.amount = manager->frame.amounts[i];
+        record.max_capacity = resource->max_capacity;
+        stream_push(stream, &record);
+    }
+}
+
+/**
+ * Queues the end of a synchronous iteration.
+ *
+ * @param[in,out] stream     Pointer to the `OutputStream`.
+ * @param[in]     iteration  Number of the iteration that finished, from 1.
+ */
+void output_stream_iteration(OutputStream *stream, int iteration) {
+    StreamRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.type = STREAM_RECORD_ITERATION;
+    record.ts_ns = latency_now_ns();
+    record.amount = iteration;
+    stream_push(stream, &record);
+}
+
+/**
+ * Appends a record to the ring, or counts it as dropped if the writer has fallen behind.
+ *
+ * Only the manager thread may push, and it never waits for the writer.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ * @param[in]     record  Pointer to the `StreamRecord` to copy in.
+ * @return                `STATUS_OK` if queued, or `STATUS_CAPACITY` if the ring is full.
+ */
+static int stream_push(OutputStream *stream, const StreamRecord *record) {
+    unsigned int tail = stream->tail;
+    unsigned int head = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head > stream->mask) {
+        stream->dropped++;
+        return STATUS_CAPACITY;
+    }
+
+    stream->slots[tail & stream->mask] = *record;
+    __atomic_store_n(&stream->tail, tail + 1, __ATOMIC_RELEASE);
+    return STATUS_OK;
+}
+
+/**
+ * Writer thread body, encodes records into the buffer until stopped and the ring is empty.
+ *
+ * The buffer is written out whenever it fills up or the ring runs dry, so readers of a pipe
+ * see records promptly while bursts still go out in large writes.
+ *
+ * @param[in,out] arg  Pointer to the `OutputStream`.
+ * @return             NULL.
+ */
+static void *stream_writer(void *arg) {
+    OutputStream *stream = (OutputStream*)arg;
+
+    TRACE_THREAD_NAME("Output writer");
+    for (;;) {
+        // Read the flag first, so records pushed before the stop are always drained
+        int running = __atomic_load_n(&stream->running, __ATOMIC_ACQUIRE);
+        unsigned int head = stream->head;
+        unsigned int tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            stream_flush(stream);
+            if (!running) {
+                break;
+            }
+            usleep(STREAM_IDLE_US);
+            continue;
+        }
+
+        for (; head != tail; head++) {
+            if (stream->format == STREAM_BINARY) {
+                stream_encode_binary(stream, &stream->slots[head & stream->mask]);
+            } else {
+                stream_encode_ndjson(stream, &stream->slots[head & stream->mask]);
+            }
+            stream->written++;
+        }
+        __atomic_store_n(&stream->head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/**
+ * Writes out everything in the buffer.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ */
+static void stream_flush(OutputStream *stream) {
+    size_t done = 0;
+
+    while (done < stream->buffer_used) {
+        ssize_t n = write(stream->fd, stream->buffer + done, stream->buffer_used - done);
+        if (n <= 0) {
+            // The reader went away, there is nobody left to write to
+            break;
+        }
+        done += (size_t)n;
+    }
+    stream->buffer_used = 0;
+}
+
+/**
+ * Encodes a record as one line of JSON.
+ *
+ * Names come from the simulation and never contain quotes or control characters.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ * @param[in]     record  Pointer to the `StreamRecord`.
+ */
+static void stream_encode_ndjson(OutputStream *stream, const StreamRecord *record) {
+    char line[512];
+    int length = 0;
+
+    switch (record->type) {
+        case STREAM_RECORD_EVENT:
+            length = snprintf(line, sizeof(line),
+                              "{\"type\":\"event\",\"ns\":%lld,\"system\":\"%s\",\"resource\":\"%s\",\"status\":%d,\"priority\":%d,\"amount\":%d}\n",
+                              record->ts_ns, record->system, record->resource, record->status, record->priority, record->amount);
+            break;
+        case STREAM_RECORD_RESOURCE:
+            length = snprintf(line, sizeof(line),
+                              "{\"type\":\"resource\",\"ns\":%lld,\"resource\":\"%s\",\"amount\":%d,\"max_capacity\":%d}\n",
+                              record->ts_ns, record->resource, record->amount, record->max_capacity);
+            break;
+        case STREAM_RECORD_ITERATION:
+            length = snprintf(line, sizeof(line), "{\"type\":\"iteration\",\"ns\":%lld,\"iteration\":%d}\n",
+                              record->ts_ns, record->amount);
+            break;
+    }
+
+    if (length > 0) {
+        stream_put(stream, line, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1);
+    }
+}
+
+/**
+ * Encodes a record in the compact binary format, in native byte order.
+ *
+ * Every record starts with a one-byte type. Names are sent once as a `STREAM_BINARY_NAME`
+ * record, after which other records refer to them by id.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ * @param[in]     record  Pointer to the `StreamRecord`.
+ */
+static void stream_encode_binary(OutputStream *stream, const StreamRecord *record) {
+    unsigned char type;
+    int64_t ts = record->ts_ns;
+    uint32_t system, resource;
+    int32_t values[3];
+
+    switch (record->type) {
+        case STREAM_RECORD_EVENT:
+            system = stream_name_id(stream, record->system);
+            resource = stream_name_id(stream, record->resource);
+            type = STREAM_BINARY_EVENT;
+            values[0] = record->status;
+            values[1] = record->priority;
+            values[2] = record->amount;
+            stream_put(stream, &type, 1);
+            stream_put(stream, &ts, sizeof(ts));
+            stream_put(stream, &system, sizeof(system));
+            stream_put(stream, &resource, sizeof(resource));
+            stream_put(stream, values, sizeof(values));
+            break;
+        case STREAM_RECORD_RESOURCE:
+            resource = stream_name_id(stream, record->resource);
+            type = STREAM_BINARY_RESOURCE;
+            values[0] = record->amount;
+            values[1] = record->max_capacity;
+            stream_put(stream, &type, 1);
+            stream_put(stream, &ts, sizeof(ts));
+            stream_put(stream, &resource, sizeof(resource));
+            stream_put(stream, values, sizeof(int32_t) * 2);
+            break;
+        case STREAM_RECORD_ITERATION:
+            type = STREAM_BINARY_ITERATION;
+            values[0] = record->amount;
+            stream_put(stream, &type, 1);
+            stream_put(stream, &ts, sizeof(ts));
+            stream_put(stream, values, sizeof(int32_t));
+            break;
+    }
+}
+
+/**
+ * Gives a name its binary id, emitting the name record the first time it is seen.
+ *
+ * Names are interned in the manager's arena, so the pointer alone identifies them.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ * @param[in]     name    Name to look up.
+ * @return                The name's id.
+ */
+static unsigned int stream_name_id(OutputStream *stream, const char *name) {
+    unsigned int mask, slot;
+    unsigned char type = STREAM_BINARY_NAME;
+    uint32_t id;
+    uint16_t length;
+
+    // Keep the table at most half full, ids are never reused so growing just rehashes
+    if ((stream->name_count + 1) * 2 > stream->name_capacity) {
+        unsigned int capacity = stream->name_capacity ? stream->name_capacity * 2 : 64;
+        StreamName *names = calloc(capacity, sizeof(StreamName));
+        if (names == NULL) {
+            return UINT32_MAX;
+        }
+        for (unsigned int i = 0; i < stream->name_capacity; i++) {
+            if (stream->names[i].name != NULL) {
+                slot = (unsigned int)(((uintptr_t)stream->names[i].name >> 3) * 2654435761u) & (capacity - 1);
+                while (names[slot].name != NULL) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                names[slot] = stream->names[i];
+            }
+        }
+        free(stream->names);
+        stream->names = names;
+        stream->name_capacity = capacity;
+    }
+
+    mask = stream->name_capacity - 1;
+    for (slot = (unsigned int)(((uintptr_t)name >> 3) * 2654435761u) & mask; stream->names[slot].name != NULL; slot = (slot + 1) & mask) {
+        if (stream->names[slot].name == name) {
+            return stream->names[slot].id;
+        }
+    }
+
+    id = stream->name_count++;
+    stream->names[slot].name = name;
+    stream->names[slot].id = id;
+
+    length = (uint16_t)strlen(name);
+    stream_put(stream, &type, 1);
+    stream_put(stream, &id, sizeof(id));
+    stream_put(stream, &length, sizeof(length));
+    stream_put(stream, name, length);
+    return id;
+}
+
+/**
+ * Appends bytes to the buffer, writing it out first if they do not fit.
+ *
+ * @param[in,out] stream  Pointer to the `OutputStream`.
+ * @param[in]     data    Bytes to append.
+ * @param[in]     size    Number of bytes, at most `STREAM_BUFFER_SIZE`.
+ */
+static void stream_put(OutputStream *stream, const void *data, size_t size) {
+    if (stream->buffer_used + size > STREAM_BUFFER_SIZE) {
+        stream_flush(stream);
+    }
+    memcpy(stream->buffer + stream->buffer_used, data, size);
+    stream->buffer_used += size;
+}
@@ -1,5 +1,6 @@
 #include "subsystem.h"
 #include <string.h>
+#include <sched.h>
 
 /* initializes the memory pointed to by the subsystem with name and status.
  
@@ -27,6 +28,12 @@ int subsys_init(Subsystem *subsystem, const char *name, char status){
   // initializes data
   subsystem->data = 0;
 
+  // no writer is active yet
+  subsystem->seq = 0;
+
+  // keeps a single data word until a ring is attached
+  subsystem->ring = NULL;
+
   printf("'%s' has been added to the subsystem collection.\n", name);
   
   return ERR_SUCCESS;
@@ -54,8 +61,11 @@ int subsys_print(Subsystem *subsystem) {
   int subsystemData = (subsystem->status >> STATUS_DATA) & 1;
   unsigned int data;
 
-  // prints data if the subsystem has some
-  if (subsystemData == 1) {
+  // the queued words belong to the consumer, so only their count is shown
+  unsigned int queued;
+  if (subsys_ring_stats(subsystem, &queued, NULL, NULL) == ERR_SUCCESS) {
+    printf("Data: %u queued\n", queued);
+  } else if (subsystemData == 1) {
     subsys_data_get(subsystem, &data);
     printf("Data: %08X\n", data);
   } else {
@@ -65,6 +75,26 @@ int subsys_print(Subsystem *subsystem) {
   return ERR_SUCCESS;
 }
 
+/* prints a subsystem whose data words are queued on a ring, with their count in place of the data.
+ Meant for copies taken with subsys_snapshot, which leave the ring with the subsystem they copied.
+ 
+ in subsystem: Pointer to the Subsystem structure to print
+ in queued:    Number of words queued on the ring of the subsystem it was copied from
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_SUCCESS otherwise */
+int subsys_print_queued(const Subsystem *subsystem, unsigned int queued) {
+  if (subsystem == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  printf("Name: %-16s; Status: ", subsystem->name);
+  subsys_status_print(subsystem);
+  printf("Data: %u queued\n", queued);
+
+  return ERR_SUCCESS;
+}
+
 /* sets the status value of the subsystem.
  
  in/out subsystem: Pointer to the Subsystem structure
@@ -92,34 +122,95 @@ int subsys_status_set(Subsystem *subsystem, unsigned char status, unsigned char
     return ERR_INVALID_STATUS;
   }
 
-  // Modify bits
+  // works out which bits of the status byte are being changed
+  unsigned char mask;
   switch(status){
     case STATUS_POWER:
     case STATUS_DATA:
     case STATUS_ACTIVITY:
     case STATUS_ERROR:
-      //Clear bit
-      subsystem->status &= ~(1 << status);
-      //Set new value
-      subsystem-> status |= (value << status);
+      mask = 1 << status;
       break;
     case STATUS_PERFORMANCE:
-      subsystem ->status &= ~(3 << STATUS_PERFORMANCE); //Clear bits 3-2
-      subsystem->status |= (value << STATUS_PERFORMANCE); //Set new value
+      mask = 3 << STATUS_PERFORMANCE; //bits 3-2
       break;
     case STATUS_RESOURCE:
-      subsystem->status &= ~(3 << STATUS_RESOURCE); //Clear bits 1-0
-      subsystem->status |= (value << STATUS_RESOURCE); //Set new value
+      mask = 3 << STATUS_RESOURCE; //bits 1-0
       break;
 
     default:
       printf("The status number is invalid.\n");
       return ERR_INVALID_STATUS;
   }
+
+  // Modify bits inside the write section so readers never see half an update
+  subsys_seq_write_begin(&subsystem->seq);
+  unsigned char current = __atomic_load_n(&subsystem->status, __ATOMIC_RELAXED);
+  current = (current & ~mask) | ((value << status) & mask);
+  __atomic_store_n(&subsystem->status, current, __ATOMIC_RELAXED);
+  subsys_seq_write_end(&subsystem->seq);
+
   printf("'%s' status was successfully updated.\n", subsystem->name);
   return ERR_SUCCESS;
 }
 
+/* sets a status field with a single atomic update and no printing.
+ Meant for hot paths where one thread per subsystem flips its own bits while others read them.
+ 
+ in/out subsystem: Pointer to the Subsystem structure
+ in status:        Status bit to set
+ in value:         Value to assign to the status bit
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_INVALID_STATUS if the provided status or value is out of range
+ - ERR_SUCCESS otherwise */
+int subsys_status_atomic_set(Subsystem *subsystem, unsigned char status, unsigned char value) {
+  if (subsystem == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  unsigned char mask;
+  switch(status){
+    case STATUS_POWER:
+    case STATUS_DATA:
+    case STATUS_ACTIVITY:
+    case STATUS_ERROR:
+      mask = 1 << status;
+      break;
+    case STATUS_PERFORMANCE:
+    case STATUS_RESOURCE:
+      mask = 3 << status;
+      break;
+    default:
+      return ERR_INVALID_STATUS;
+  }
+
+  if ((value << status) & ~mask) {
+    return ERR_INVALID_STATUS;
+  }
+
+  // single bits can be flipped directly, two bit fields need a compare and swap
+  if (mask == (1 << status)) {
+    if (value) {
+      __atomic_fetch_or(&subsystem->status, mask, __ATOMIC_RELAXED);
+    } else {
+      __atomic_fetch_and(&subsystem->status, ~mask, __ATOMIC_RELAXED);
+    }
+    return ERR_SUCCESS;
+  }
+
+  unsigned char current = __atomic_load_n(&subsystem->status, __ATOMIC_RELAXED);
+  unsigned char next;
+  do {
+    next = (current & ~mask) | (value << status);
+    if (next == current) {
+      break;
+    }
+  } while (!__atomic_compare_exchange_n(&subsystem->status, &current, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  return ERR_SUCCESS;
+}
+
 /* prints the status of the subsystem to the screen.
  
  in subsystem: Pointer to the Subsystem structure
@@ -153,6 +244,7 @@ int subsys_status_print(const Subsystem *subsystem){
  Returns:
  - ERR_NULL_POINTER if a null pointer is passed
  - ERR_NO_DATA if the new data is zero
+ - ERR_MAX_CAPACITY if the subsystem's ring is full and the data was dropped
  - ERR_SUCCESS otherwise */
 int subsys_data_set(Subsystem *subsystem, unsigned int new_data, unsigned int *old_data){
   // check for null values
@@ -166,22 +258,34 @@ int subsys_data_set(Subsystem *subsystem, unsigned int new_data, unsigned int *o
     return ERR_NO_DATA;
   }
 
+  // queues the word when the subsystem owns a ring, nothing is overwritten
+  if (subsys_ring_owned(subsystem) != NULL) {
+    if (old_data != NULL) {
+      *old_data = 0;
+    }
+    return subsys_data_push(subsystem, &new_data, 1, NULL);
+  }
+
+  subsys_seq_write_begin(&subsystem->seq);
+
   // checks if there's old data to be saved
   if (old_data != NULL) {
-    *old_data = subsystem->data;
+    *old_data = __atomic_load_n(&subsystem->data, __ATOMIC_RELAXED);
   }
 
   // sets the new data to the subsystem data
-  subsystem->data = new_data;
+  __atomic_store_n(&subsystem->data, new_data, __ATOMIC_RELAXED);
 
   // updates the data status to true
-  subsys_status_set(subsystem, 6, 1);
+  __atomic_fetch_or(&subsystem->status, 1 << STATUS_DATA, __ATOMIC_RELAXED);
+
+  subsys_seq_write_end(&subsystem->seq);
 
   printf("'%s' data has successfully been set.\n", subsystem->name);
   return ERR_SUCCESS;
 }
 
-/* gets the data of the subsystem.
+/* gets the data of the subsystem, or the oldest queued word if it has a ring.
  
  in subsystem: Pointer to the Subsystem structure
  out data:     Pointer to store the retrieved data
@@ -195,19 +299,115 @@ int subsys_data_get(Subsystem *subsystem, unsigned int *data) {
     return ERR_NULL_POINTER;
   }
 
+  // takes the oldest word off the ring when the subsystem owns one
+  if (subsys_ring_owned(subsystem) != NULL) {
+    *data = 0;
+    return subsys_data_pop(subsystem, data, 1, NULL);
+  }
+
+  subsys_seq_write_begin(&subsystem->seq);
+
   // check if there's any data queued
-  int subsystemData = (subsystem->status >> STATUS_DATA) & 1;
+  int subsystemData = (__atomic_load_n(&subsystem->status, __ATOMIC_RELAXED) >> STATUS_DATA) & 1;
   if (subsystemData == 0) {
+    subsys_seq_write_end(&subsystem->seq);
     *data = 0;
     return ERR_NO_DATA;
   }
 
   // copies subsystem data to data
-  *data = subsystem->data;
+  *data = __atomic_load_n(&subsystem->data, __ATOMIC_RELAXED);
   // set data field to 0
-  subsystem->data = 0;
+  __atomic_store_n(&subsystem->data, 0, __ATOMIC_RELAXED);
   //Clear bit
-  subsystem->status &= ~(1 << STATUS_DATA);
+  __atomic_fetch_and(&subsystem->status, ~(1 << STATUS_DATA), __ATOMIC_RELAXED);
+
+  subsys_seq_write_end(&subsystem->seq);
+
+  return ERR_SUCCESS;
+}
+
+/* starts a write section on a seqlock counter by making it odd.
+ Writers only ever wait for other writers, readers never hold the counter.
+ 
+ in/out seq: Pointer to the sequence counter of the protected data */
+void subsys_seq_write_begin(unsigned int *seq) {
+  unsigned int current;
+
+  for (;;) {
+    current = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    // an even counter means no other writer is active, try to claim it
+    if ((current & 1) == 0 &&
+        __atomic_compare_exchange_n(seq, &current, current + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      break;
+    }
+    sched_yield();
+  }
+
+  // keeps the data stores after the counter becomes odd
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* ends a write section on a seqlock counter by making it even again.
+ 
+ in/out seq: Pointer to the sequence counter of the protected data */
+void subsys_seq_write_end(unsigned int *seq) {
+  __atomic_fetch_add(seq, 1, __ATOMIC_RELEASE);
+}
+
+/* starts a read section on a seqlock counter, waiting out any writer in progress.
+ 
+ in seq: Pointer to the sequence counter of the protected data
+ Returns:
+ - The even counter value to pass to subsys_seq_read_retry */
+unsigned int subsys_seq_read_begin(const unsigned int *seq) {
+  unsigned int current = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+
+  while (current & 1) {
+    sched_yield();
+    current = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+  }
+
+  return current;
+}
+
+/* checks if a read section overlapped a writer and has to be redone.
+ 
+ in seq:   Pointer to the sequence counter of the protected data
+ in start: Value returned by subsys_seq_read_begin
+ Returns:
+ - 1 if the data read may be inconsistent and the read must be retried
+ - 0 otherwise */
+int subsys_seq_read_retry(const unsigned int *seq, unsigned int start) {
+  // keeps the data loads before the second counter load
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+/* copies a consistent view of a subsystem without blocking its writer.
+ 
+ in src:   Pointer to the Subsystem to read
+ out dest: Pointer to the Subsystem that receives the copy
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_SUCCESS otherwise */
+int subsys_snapshot(const Subsystem *src, Subsystem *dest) {
+  if (src == NULL || dest == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  unsigned int start;
+  do {
+    start = subsys_seq_read_begin(&src->seq);
+    memcpy(dest->name, src->name, sizeof(dest->name));
+    dest->status = __atomic_load_n(&src->status, __ATOMIC_RELAXED);
+    dest->data = __atomic_load_n(&src->data, __ATOMIC_RELAXED);
+  } while (subsys_seq_read_retry(&src->seq, start));
+
+  // the copy is private to the caller so it starts with no writer, and the ring stays with its owner
+  dest->ring = NULL;
+  dest->name[sizeof(dest->name) - 1] = '\0';
+  dest->seq = 0;
 
   return ERR_SUCCESS;
 }
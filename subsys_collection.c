@@ -1,6 +1,8 @@
 #include "subsystem.h"
 #include <string.h>
 
+static void subsys_slot_fill(Subsystem *slot, const Subsystem *src, SubsysRing *ring);
+
 /* verifies if the subsystem with the given name exists in the collection.
  
  in collection: Pointer to the SubsystemCollection to search
@@ -36,11 +38,19 @@ int subsys_collection_init(SubsystemCollection *subsystems) {
     /* Initialize the size of the collection to 0 */
     subsystems->size = 0;
 
+    /* No writer is active yet, on the collection or on any of its slots */
+    subsystems->seq = 0;
+    for (unsigned int i = 0; i < MAX_ARR; i++) {
+        subsystems->subsystems[i].seq = 0;
+    }
+
     /* Return success */
     return ERR_SUCCESS;
 }
 
 /* appends a copy of the structure to the end of the collection.
+ Appends and removals change the layout of the collection: they may run from any thread, they wait
+ for each other on the collection's counter, and readers of the collection retry around them.
  
  in/out subsystems: Pointer to the SubsystemCollection to append to
  in subsystem:      Pointer to the Subsystem to append
@@ -60,11 +70,15 @@ int subsys_append(SubsystemCollection *subsystems, const Subsystem *subsystem)
         return ERR_MAX_CAPACITY;
     }
 
-    // adds the provided subsystem to the collection
-    subsystems->subsystems[subsystems->size] = *subsystem;
+    subsys_seq_write_begin(&subsystems->seq);
+
+    // adds the provided subsystem to the collection, a ring stays with the subsystem it was attached to
+    subsys_slot_fill(&subsystems->subsystems[subsystems->size], subsystem, NULL);
 
     // increases the size of the collection
-    subsystems->size++;
+    __atomic_store_n(&subsystems->size, subsystems->size + 1, __ATOMIC_RELAXED);
+
+    subsys_seq_write_end(&subsystems->seq);
 
     return ERR_SUCCESS;
 }
@@ -107,21 +121,42 @@ int subsys_collection_print(SubsystemCollection *subsystems) {
     return ERR_NULL_POINTER;
   }
 
+  // prints from a consistent copy so writers are never held up by the printing
+  // the copy leaves the rings behind, so their queued counts are read alongside it
+  SubsystemCollection snapshot;
+  unsigned int queued[MAX_ARR];
+  int ringed[MAX_ARR];
+  unsigned int start;
+  do {
+    start = subsys_seq_read_begin(&subsystems->seq);
+    subsys_collection_snapshot(subsystems, &snapshot);
+    for (unsigned int i = 0; i < snapshot.size; i++) {
+      ringed[i] = subsys_ring_stats(&subsystems->subsystems[i], &queued[i], NULL, NULL) == ERR_SUCCESS;
+    }
+  } while (subsys_seq_read_retry(&subsystems->seq, start));
+
   // checks that subsystems collection isnt empty
-  if (subsystems->size == 0) {
+  if (snapshot.size == 0) {
     printf("\nThere are no subsystems in the collection.\n");
     return ERR_NO_DATA;
   }
 
   // loops through the array and prints the every subsystem
-  for (unsigned int i = 0; i < subsystems->size; i++) {
-    subsys_print(&subsystems->subsystems[i]);
+  for (unsigned int i = 0; i < snapshot.size; i++) {
+    if (ringed[i]) {
+      subsys_print_queued(&snapshot.subsystems[i], queued[i]);
+    } else {
+      subsys_print(&snapshot.subsystems[i]);
+    }
   }
 
   return ERR_SUCCESS;
 }
 
 /* removes the subsystem at the specified index if it exists.
+ The subsystems after it move down one slot, so it changes the layout of the collection like
+ subsys_append: any thread may call it, and a thread still holding a pointer to a moved
+ subsystem afterwards writes to whichever subsystem now sits in that slot.
  
  in/out subsystems: Pointer to the SubsystemCollection to modify
  in index: Index of the subsystem to remove
@@ -150,13 +185,29 @@ int subsys_remove(SubsystemCollection *subsystems, int index){
   // lets user know which subsystem is getting removed
   printf("Subsystem '%s' was deleted successfully\n", subsystems->subsystems[index].name);
 
-  // shifts all elements to left (after index)
+  // the removed subsystem's ring goes with it
+  subsys_ring_detach(&subsystems->subsystems[index]);
+
+  subsys_seq_write_begin(&subsystems->seq);
+
+  // shifts all elements to left (after index), each ring following its subsystem to the new slot
+  // the subsystem moved out of a slot is held still under its own counter while it is copied
   for (unsigned int i = index; i < subsystems->size - 1; i++){
-    subsystems->subsystems[i] = subsystems->subsystems[i + 1];
+    Subsystem *next = &subsystems->subsystems[i + 1];
+    SubsysRing *ring = subsys_ring_owned(next);
+    subsys_seq_write_begin(&next->seq);
+    subsys_slot_fill(&subsystems->subsystems[i], next, ring);
+    if (ring != NULL) {
+      ring->owner = &subsystems->subsystems[i];
+    }
+    subsys_seq_write_end(&next->seq);
   }
+  subsystems->subsystems[subsystems->size - 1].ring = NULL;
 
   // reduce size
-  subsystems->size--;
+  __atomic_store_n(&subsystems->size, subsystems->size - 1, __ATOMIC_RELAXED);
+
+  subsys_seq_write_end(&subsystems->seq);
 
   return ERR_SUCCESS;
 }
@@ -172,7 +223,7 @@ int subsys_remove(SubsystemCollection *subsystems, int index){
  - ERR_SUCCESS if filtering is completed successfully */
 int subsys_filter(const SubsystemCollection *src, SubsystemCollection *dest, const unsigned char *filter){
   // checks if collection is null
-  if(src == NULL){
+  if(src == NULL || dest == NULL || filter == NULL){
     return ERR_NULL_POINTER;
   }
 
@@ -207,19 +258,27 @@ int subsys_filter(const SubsystemCollection *src, SubsystemCollection *dest, con
   // flips each bit of filter mask
   filterMask = ~filterMask;
 
+  // filters a consistent copy of the source so its writers keep running
+  SubsystemCollection snapshot;
+  subsys_collection_snapshot(src, &snapshot);
+
+  subsys_seq_write_begin(&dest->seq);
+
   // resets size of destination array to 0
   dest->size = 0;
 
   // checks every subsystem of the collection and if it passes the filter
-  for (unsigned int i = 0; i < src->size; i++){
+  for (unsigned int i = 0; i < snapshot.size; i++){
     // checks the filter
-    unsigned char result = (filterMask ^ src->subsystems[i].status) | wildcardMask;
+    unsigned char result = (filterMask ^ snapshot.subsystems[i].status) | wildcardMask;
     if(result == 0b11111111){
       // copies the Subsystems that Match the filter stuff 
-      dest->subsystems[dest->size++] = src->subsystems[i]; 
+      subsys_slot_fill(&dest->subsystems[dest->size++], &snapshot.subsystems[i], NULL);
     }
   }
 
+  subsys_seq_write_end(&dest->seq);
+
   // prints the filtered subsystem
   if (dest->size > 0) {
     subsys_collection_print(dest);
@@ -229,3 +288,54 @@ int subsys_filter(const SubsystemCollection *src, SubsystemCollection *dest, con
 
   return ERR_SUCCESS;
 }
+
+/* copies a consistent view of the whole collection without blocking any writer.
+ The copy is retried if a subsystem was appended or removed while it was taken.
+ 
+ in src:   Pointer to the SubsystemCollection to read
+ out dest: Pointer to the SubsystemCollection that receives the copy
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_SUCCESS otherwise */
+int subsys_collection_snapshot(const SubsystemCollection *src, SubsystemCollection *dest) {
+  if (src == NULL || dest == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  unsigned int start, size;
+  do {
+    start = subsys_seq_read_begin(&src->seq);
+    size = __atomic_load_n(&src->size, __ATOMIC_RELAXED);
+    if (size > MAX_ARR) {
+      size = MAX_ARR;
+    }
+
+    // each subsystem is copied under its own counter
+    for (unsigned int i = 0; i < size; i++) {
+      subsys_snapshot(&src->subsystems[i], &dest->subsystems[i]);
+    }
+  } while (subsys_seq_read_retry(&src->seq, start));
+
+  dest->size = size;
+  dest->seq = 0;
+
+  return ERR_SUCCESS;
+}
+
+/* copies the name, status and data of a subsystem into a slot of a collection.
+ The slot keeps its own counter and is written under it, so a writer that still has the slot
+ open finishes on an even counter and readers of the slot retry around the copy.
+
+ in/out slot: Pointer to the Subsystem slot to fill
+ in src:      Pointer to the Subsystem to copy
+ in ring:     Ring the slot takes over, NULL for none */
+static void subsys_slot_fill(Subsystem *slot, const Subsystem *src, SubsysRing *ring) {
+  subsys_seq_write_begin(&slot->seq);
+
+  memcpy(slot->name, src->name, sizeof(slot->name));
+  __atomic_store_n(&slot->status, __atomic_load_n(&src->status, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->data, __atomic_load_n(&src->data, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+  slot->ring = ring;
+
+  subsys_seq_write_end(&slot->seq);
+}
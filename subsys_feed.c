@@ -0,0 +1,192 @@
+#include "subsystem.h"
+#include <string.h>
+
+static unsigned int subsys_feed_gather(const SubsysFeed *feed, unsigned char *column);
+
+/* starts a change feed over a collection, taking its current statuses as the baseline.
+
+ out feed:      Pointer to the SubsysFeed to initialize
+ in collection: Pointer to the SubsystemCollection to watch, must outlive the feed
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_SUCCESS otherwise */
+int subsys_feed_init(SubsysFeed *feed, const SubsystemCollection *collection) {
+  if (feed == NULL || collection == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  memset(feed, 0, sizeof(SubsysFeed));
+  feed->collection = collection;
+  subsys_feed_gather(feed, feed->previous);
+
+  return ERR_SUCCESS;
+}
+
+/* registers a handler for the changes that touch some status bits.
+ The changed-bits lookup table is updated here, so a poll finds the subscribers of a change
+ with one load whatever the number of subscribers.
+
+ in/out feed: Pointer to the SubsysFeed
+ in mask:     Status bits of interest, e.g. 1 << STATUS_ERROR
+ in handler:  Function called once per poll with the matching changes
+ in context:  Pointer handed back to the handler
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_INVALID_STATUS if the mask is 0
+ - ERR_MAX_CAPACITY if FEED_MAX_SUBSCRIBERS are already registered
+ - The index of the subscriber otherwise */
+int subsys_feed_subscribe(SubsysFeed *feed, unsigned char mask, SubsysChangeHandler handler, void *context) {
+  if (feed == NULL || handler == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  if (mask == 0) {
+    return ERR_INVALID_STATUS;
+  }
+
+  int subscriber;
+  for (subscriber = 0; subscriber < FEED_MAX_SUBSCRIBERS; subscriber++) {
+    if (feed->masks[subscriber] == 0) {
+      break;
+    }
+  }
+  if (subscriber == FEED_MAX_SUBSCRIBERS) {
+    return ERR_MAX_CAPACITY;
+  }
+
+  feed->masks[subscriber] = mask;
+  feed->handlers[subscriber] = handler;
+  feed->contexts[subscriber] = context;
+
+  for (int changed = 1; changed < 256; changed++) {
+    if (changed & mask) {
+      feed->subscribers_for[changed] |= 1 << subscriber;
+    }
+  }
+
+  return subscriber;
+}
+
+/* removes a subscriber registered with subsys_feed_subscribe.
+
+ in/out feed:   Pointer to the SubsysFeed
+ in subscriber: Index returned by subsys_feed_subscribe
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_INVALID_INDEX if no such subscriber is registered
+ - ERR_SUCCESS otherwise */
+int subsys_feed_unsubscribe(SubsysFeed *feed, int subscriber) {
+  if (feed == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  if (subscriber < 0 || subscriber >= FEED_MAX_SUBSCRIBERS || feed->masks[subscriber] == 0) {
+    return ERR_INVALID_INDEX;
+  }
+
+  feed->masks[subscriber] = 0;
+  feed->handlers[subscriber] = NULL;
+  feed->contexts[subscriber] = NULL;
+
+  for (int changed = 0; changed < 256; changed++) {
+    feed->subscribers_for[changed] &= ~(1 << subscriber);
+  }
+
+  return ERR_SUCCESS;
+}
+
+/* reports the status changes since the previous poll to the subscribers.
+ The new status column is gathered in one pass and XORed with the previous one eight bytes at a
+ time, so unchanged stretches cost one compare per word and only changed subsystems are visited.
+ Each subscriber is called at most once, with the changes that touch its mask.
+ Changes are by position: after a removal, the subsystems that moved down are compared with the
+ status previously at their new position, and appended ones with 0.
+ Only one thread may poll a feed, the collection's writers keep running meanwhile.
+
+ in/out feed:  Pointer to the SubsysFeed
+ out changes:  Pointer to store the number of changed subsystems, may be NULL
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_SUCCESS otherwise */
+int subsys_feed_poll(SubsysFeed *feed, unsigned int *changes) {
+  if (feed == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  _Alignas(8) unsigned char current[FEED_COLUMN];
+  unsigned int counts[FEED_MAX_SUBSCRIBERS] = { 0 };
+  unsigned int found = 0;
+
+  subsys_feed_gather(feed, current);
+
+  for (unsigned int word = 0; word < FEED_COLUMN; word += 8) {
+    unsigned long long before, after;
+    memcpy(&before, &feed->previous[word], 8);
+    memcpy(&after, &current[word], 8);
+    if ((before ^ after) == 0) {
+      continue;
+    }
+
+    for (unsigned int i = word; i < word + 8; i++) {
+      unsigned char changed = feed->previous[i] ^ current[i];
+      if (changed == 0) {
+        continue;
+      }
+      found++;
+
+      // hands the change to every subscriber whose mask it touches
+      unsigned char subscribers = feed->subscribers_for[changed];
+      while (subscribers != 0) {
+        int subscriber = __builtin_ctz(subscribers);
+        SubsysChange *change = &feed->batches[subscriber][counts[subscriber]++];
+        change->index = i;
+        change->changed = changed;
+        change->status = current[i];
+        subscribers &= subscribers - 1;
+      }
+    }
+  }
+
+  memcpy(feed->previous, current, FEED_COLUMN);
+  feed->polls++;
+  feed->changes += found;
+
+  for (int subscriber = 0; subscriber < FEED_MAX_SUBSCRIBERS; subscriber++) {
+    if (counts[subscriber] > 0) {
+      feed->handlers[subscriber](feed->batches[subscriber], counts[subscriber], feed->contexts[subscriber]);
+    }
+  }
+
+  if (changes != NULL) {
+    *changes = found;
+  }
+
+  return ERR_SUCCESS;
+}
+
+/* copies the status byte of every subsystem of the feed's collection into a column.
+ The copy is retried if a subsystem was appended or removed while it was taken.
+
+ in feed:    Pointer to the SubsysFeed
+ out column: Array of FEED_COLUMN bytes, zero past the last subsystem
+ Returns:
+ - The number of subsystems copied */
+static unsigned int subsys_feed_gather(const SubsysFeed *feed, unsigned char *column) {
+  const SubsystemCollection *collection = feed->collection;
+  unsigned int start, size;
+
+  do {
+    start = subsys_seq_read_begin(&collection->seq);
+    size = __atomic_load_n(&collection->size, __ATOMIC_RELAXED);
+    if (size > MAX_ARR) {
+      size = MAX_ARR;
+    }
+
+    for (unsigned int i = 0; i < size; i++) {
+      column[i] = __atomic_load_n(&collection->subsystems[i].status, __ATOMIC_RELAXED);
+    }
+  } while (subsys_seq_read_retry(&collection->seq, start));
+
+  memset(column + size, 0, FEED_COLUMN - size);
+  return size;
+}
@@ -0,0 +1,650 @@
+#include "subsystem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Kinds of parsed query nodes
+#define QUERY_NODE_COMPARE 0
+#define QUERY_NODE_AND 1
+#define QUERY_NODE_OR 2
+#define QUERY_NODE_NOT 3
+
+// Comparison operators
+#define QUERY_OP_EQ 0
+#define QUERY_OP_NE 1
+#define QUERY_OP_LT 2
+#define QUERY_OP_LE 3
+#define QUERY_OP_GT 4
+#define QUERY_OP_GE 5
+
+// A field a query can compare, shift is -1 for the data word
+typedef struct QueryField {
+  const char *name;
+  int shift;
+  unsigned int max;
+} QueryField;
+
+static const QueryField query_fields[] = {
+  { "PWR", STATUS_POWER, 1 },
+  { "DATA", STATUS_DATA, 1 },
+  { "ACT", STATUS_ACTIVITY, 1 },
+  { "ERR", STATUS_ERROR, 1 },
+  { "PERF", STATUS_PERFORMANCE, 3 },
+  { "RES", STATUS_RESOURCE, 3 },
+  { "data", -1, UINT_MAX },
+};
+
+// One node of a parsed query, left and right index other nodes
+typedef struct QueryNode {
+  int kind;
+  int left;
+  int right;
+  int field;
+  int op;
+  unsigned int number;
+} QueryNode;
+
+// Parsing state, only alive while a query is compiled
+typedef struct QueryParser {
+  const char *at;
+  QueryNode nodes[QUERY_MAX_NODES];
+  int count;
+  const char *error;
+  const char *error_at;
+} QueryParser;
+
+// Sorted disjoint ranges of data words
+typedef struct QuerySet {
+  int count;
+  SubsysRange ranges[QUERY_MAX_RANGES];
+} QuerySet;
+
+static int query_parse_or(QueryParser *parser);
+static int query_parse_and(QueryParser *parser);
+static int query_parse_not(QueryParser *parser);
+static int query_parse_compare(QueryParser *parser);
+static int query_node(QueryParser *parser, int kind, int left, int right);
+static int query_fail(QueryParser *parser, const char *error);
+static int query_word(QueryParser *parser, const char *word);
+static int query_symbol(QueryParser *parser, const char *symbol);
+static int query_eval(const QueryParser *parser, int node, unsigned char status, QuerySet *out);
+static int query_set_append(QuerySet *set, unsigned int low, unsigned int high);
+static int query_set_and(const QuerySet *a, const QuerySet *b, QuerySet *out);
+static int query_set_or(const QuerySet *a, const QuerySet *b, QuerySet *out);
+static int query_set_not(const QuerySet *a, QuerySet *out);
+static void query_plan(SubsysQuery *query);
+
+/* compiles a query over the status fields and data of a subsystem.
+ Conditions compare PWR, DATA, ACT, ERR, PERF, RES or the data word `data` to a number with
+ ==, !=, <, <=, > or >=, and are combined with and, or, not (or &&, ||, !) and parentheses,
+ e.g. "PERF >= 2 and RES <= 1 and ERR == 0". Numbers may be decimal or 0x hexadecimal.
+ The query is evaluated for all 256 status bytes here, so matching never parses or walks it:
+ a status byte either always matches, never matches, or matches a set of data ranges.
+ When the matching bytes form a single bit pattern the query becomes one mask compare.
+
+ out query: Pointer to the SubsysQuery to fill
+ in text:   Query to compile
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_NO_MEMORY if the parser could not be allocated
+ - ERR_INVALID_QUERY if the text is not a valid query or needs too many data ranges
+ - ERR_SUCCESS otherwise */
+int subsys_query_compile(SubsysQuery *query, const char *text) {
+  if (query == NULL || text == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  QueryParser *parser = malloc(sizeof(QueryParser));
+  if (parser == NULL) {
+    return ERR_NO_MEMORY;
+  }
+  parser->at = text;
+  parser->count = 0;
+  parser->error = NULL;
+
+  int root = query_parse_or(parser);
+  if (root >= 0 && !query_symbol(parser, "")) {
+    query_fail(parser, "expected 'and', 'or' or the end of the query");
+  }
+  if (parser->error != NULL) {
+    printf("Query error at column %d: %s.\n", (int)(parser->error_at - text) + 1, parser->error);
+    free(parser);
+    return ERR_INVALID_QUERY;
+  }
+
+  memset(query, 0, sizeof(SubsysQuery));
+  strncpy(query->text, text, QUERY_MAX_TEXT - 1);
+
+  // every status byte gets the data ranges it matches, identical ranges share a class
+  int classes = 0;
+  for (int status = 0; status < 256; status++) {
+    QuerySet set;
+    if (query_eval(parser, root, (unsigned char)status, &set) != 0) {
+      printf("Query error: a data condition needs more than %d ranges.\n", QUERY_MAX_RANGES);
+      free(parser);
+      return ERR_INVALID_QUERY;
+    }
+
+    if (set.count == 0) {
+      query->table[status] = 0;
+      continue;
+    }
+    if (set.count == 1 && set.ranges[0].low == 0 && set.ranges[0].high == UINT_MAX) {
+      query->table[status] = 1;
+      continue;
+    }
+
+    int c;
+    for (c = 0; c < classes; c++) {
+      if (query->range_counts[c] == set.count &&
+          memcmp(query->ranges[c], set.ranges, sizeof(SubsysRange) * set.count) == 0) {
+        break;
+      }
+    }
+    if (c == classes) {
+      if (classes == QUERY_MAX_CLASSES) {
+        printf("Query error: more than %d different data conditions.\n", QUERY_MAX_CLASSES);
+        free(parser);
+        return ERR_INVALID_QUERY;
+      }
+      query->range_counts[c] = set.count;
+      memcpy(query->ranges[c], set.ranges, sizeof(SubsysRange) * set.count);
+      classes++;
+    }
+    query->table[status] = 2 + c;
+    query->reads_data = 1;
+  }
+
+  query_plan(query);
+  free(parser);
+  return ERR_SUCCESS;
+}
+
+/* checks one status byte and data word against a compiled query.
+
+ in query:  Pointer to the compiled SubsysQuery
+ in status: Status byte of the subsystem
+ in data:   Data word of the subsystem
+ Returns:
+ - 1 if they match
+ - 0 otherwise, or if a null pointer is passed */
+int subsys_query_match(const SubsysQuery *query, unsigned char status, unsigned int data) {
+  if (query == NULL) {
+    return 0;
+  }
+
+  unsigned char class;
+  if (query->plan == QUERY_PLAN_MASK) {
+    class = (status & query->mask) == query->value ? query->mask_class : 0;
+  } else {
+    class = query->table[status];
+  }
+
+  if (class <= 1) {
+    return class;
+  }
+
+  const SubsysRange *ranges = query->ranges[class - 2];
+  for (int r = 0; r < query->range_counts[class - 2]; r++) {
+    if (data >= ranges[r].low && data <= ranges[r].high) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* finds every subsystem of a collection matching a compiled query, in one pass.
+ Only the status byte of each subsystem is read unless the query depends on data, in which case
+ status and data are read together under the subsystem's counter. The words queued on a ring
+ belong to its consumer, so subsystems with a ring compare `data` as 0. The pass is retried if a
+ subsystem is appended or removed meanwhile, so writers are never held up.
+
+ in query:    Pointer to the compiled SubsysQuery
+ in src:      Pointer to the SubsystemCollection to search
+ out indices: Array of at least MAX_ARR entries receiving the indices of the matches, ascending
+ out count:   Pointer to store the number of matches
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_SUCCESS otherwise */
+int subsys_query_select(const SubsysQuery *query, const SubsystemCollection *src, unsigned int *indices, unsigned int *count) {
+  if (query == NULL || src == NULL || indices == NULL || count == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  unsigned int start, size, found;
+  do {
+    start = subsys_seq_read_begin(&src->seq);
+    size = __atomic_load_n(&src->size, __ATOMIC_RELAXED);
+    if (size > MAX_ARR) {
+      size = MAX_ARR;
+    }
+
+    found = 0;
+    for (unsigned int i = 0; i < size; i++) {
+      const Subsystem *subsystem = &src->subsystems[i];
+      unsigned char status;
+      unsigned int data = 0;
+
+      if (!query->reads_data) {
+        status = __atomic_load_n(&subsystem->status, __ATOMIC_RELAXED);
+      } else {
+        unsigned int seq;
+        do {
+          seq = subsys_seq_read_begin(&subsystem->seq);
+          status = __atomic_load_n(&subsystem->status, __ATOMIC_RELAXED);
+          data = __atomic_load_n(&subsystem->data, __ATOMIC_RELAXED);
+        } while (subsys_seq_read_retry(&subsystem->seq, seq));
+      }
+
+      if (subsys_query_match(query, status, data)) {
+        indices[found++] = i;
+      }
+    }
+  } while (subsys_seq_read_retry(&src->seq, start));
+
+  *count = found;
+  return ERR_SUCCESS;
+}
+
+/* parses conditions joined by 'or'.
+
+ in/out parser: Pointer to the QueryParser
+ Returns:
+ - The index of the parsed node
+ - -1 on error */
+static int query_parse_or(QueryParser *parser) {
+  int left = query_parse_and(parser);
+  while (left >= 0 && (query_word(parser, "or") || query_symbol(parser, "||"))) {
+    int right = query_parse_and(parser);
+    left = right >= 0 ? query_node(parser, QUERY_NODE_OR, left, right) : -1;
+  }
+  return left;
+}
+
+/* parses conditions joined by 'and'.
+
+ in/out parser: Pointer to the QueryParser
+ Returns:
+ - The index of the parsed node
+ - -1 on error */
+static int query_parse_and(QueryParser *parser) {
+  int left = query_parse_not(parser);
+  while (left >= 0 && (query_word(parser, "and") || query_symbol(parser, "&&"))) {
+    int right = query_parse_not(parser);
+    left = right >= 0 ? query_node(parser, QUERY_NODE_AND, left, right) : -1;
+  }
+  return left;
+}
+
+/* parses a negated condition, a parenthesised query or a comparison.
+
+ in/out parser: Pointer to the QueryParser
+ Returns:
+ - The index of the parsed node
+ - -1 on error */
+static int query_parse_not(QueryParser *parser) {
+  // a lone '!' negates, '!=' is left for the comparison to reject
+  query_symbol(parser, "");
+  if (query_word(parser, "not") || (parser->at[0] == '!' && parser->at[1] != '=' && query_symbol(parser, "!"))) {
+    int operand = query_parse_not(parser);
+    return operand >= 0 ? query_node(parser, QUERY_NODE_NOT, operand, -1) : -1;
+  }
+
+  if (query_symbol(parser, "(")) {
+    int inner = query_parse_or(parser);
+    if (inner >= 0 && !query_symbol(parser, ")")) {
+      return query_fail(parser, "expected ')'");
+    }
+    return inner;
+  }
+
+  return query_parse_compare(parser);
+}
+
+/* parses a field compared to a number, e.g. "RES <= 1".
+
+ in/out parser: Pointer to the QueryParser
+ Returns:
+ - The index of the parsed node
+ - -1 on error */
+static int query_parse_compare(QueryParser *parser) {
+  static const char *ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+  static const int op_codes[] = { QUERY_OP_EQ, QUERY_OP_NE, QUERY_OP_LE, QUERY_OP_GE, QUERY_OP_LT, QUERY_OP_GT };
+  int field, op;
+
+  for (field = 0; field < (int)(sizeof(query_fields) / sizeof(query_fields[0])); field++) {
+    if (query_word(parser, query_fields[field].name)) {
+      break;
+    }
+  }
+  if (field == (int)(sizeof(query_fields) / sizeof(query_fields[0]))) {
+    return query_fail(parser, "expected PWR, DATA, ACT, ERR, PERF, RES, data, 'not' or '('");
+  }
+
+  for (op = 0; op < 6; op++) {
+    if (query_symbol(parser, ops[op])) {
+      break;
+    }
+  }
+  if (op == 6) {
+    return query_fail(parser, "expected ==, !=, <, <=, > or >=");
+  }
+
+  // strtoul would accept a sign, so the number has to start with a digit
+  char *end;
+  query_symbol(parser, "");
+  if (*parser->at < '0' || *parser->at > '9') {
+    return query_fail(parser, "expected a number");
+  }
+  unsigned long number = strtoul(parser->at, &end, 0);
+  if (number > query_fields[field].max) {
+    return query_fail(parser, "the value is out of range for the field");
+  }
+  parser->at = end;
+
+  int node = query_node(parser, QUERY_NODE_COMPARE, -1, -1);
+  if (node >= 0) {
+    parser->nodes[node].field = field;
+    parser->nodes[node].op = op_codes[op];
+    parser->nodes[node].number = (unsigned int)number;
+  }
+  return node;
+}
+
+/* adds a node to the parsed query.
+
+ in/out parser: Pointer to the QueryParser
+ in kind:       QUERY_NODE_* kind of the node
+ in left:       Index of the first operand, or -1
+ in right:      Index of the second operand, or -1
+ Returns:
+ - The index of the new node
+ - -1 if the query has too many nodes */
+static int query_node(QueryParser *parser, int kind, int left, int right) {
+  if (parser->count == QUERY_MAX_NODES) {
+    return query_fail(parser, "the query is too long");
+  }
+
+  QueryNode *node = &parser->nodes[parser->count];
+  node->kind = kind;
+  node->left = left;
+  node->right = right;
+  return parser->count++;
+}
+
+/* records the first parse error and where it happened.
+
+ in/out parser: Pointer to the QueryParser
+ in error:      Description of the error
+ Returns:
+ - -1 */
+static int query_fail(QueryParser *parser, const char *error) {
+  if (parser->error == NULL) {
+    parser->error = error;
+    parser->error_at = parser->at;
+  }
+  return -1;
+}
+
+/* consumes a word if it is next, as a whole word.
+
+ in/out parser: Pointer to the QueryParser
+ in word:       Word to look for
+ Returns:
+ - 1 if it was consumed
+ - 0 otherwise */
+static int query_word(QueryParser *parser, const char *word) {
+  size_t length = strlen(word);
+  char after;
+
+  query_symbol(parser, "");
+  if (strncmp(parser->at, word, length) != 0) {
+    return 0;
+  }
+
+  after = parser->at[length];
+  if ((after >= 'a' && after <= 'z') || (after >= 'A' && after <= 'Z') || (after >= '0' && after <= '9') || after == '_') {
+    return 0;
+  }
+
+  parser->at += length;
+  return 1;
+}
+
+/* skips spaces and consumes a symbol if it is next.
+ The empty symbol only skips spaces, and is consumed when nothing is left.
+
+ in/out parser: Pointer to the QueryParser
+ in symbol:     Symbol to look for
+ Returns:
+ - 1 if it was consumed
+ - 0 otherwise */
+static int query_symbol(QueryParser *parser, const char *symbol) {
+  size_t length = strlen(symbol);
+
+  while (*parser->at == ' ' || *parser->at == '\t') {
+    parser->at++;
+  }
+
+  if (length == 0) {
+    return *parser->at == '\0';
+  }
+  if (strncmp(parser->at, symbol, length) != 0) {
+    return 0;
+  }
+
+  parser->at += length;
+  return 1;
+}
+
+/* works out which data words match a parsed query for one status byte.
+
+ in parser: Pointer to the QueryParser holding the nodes
+ in node:   Index of the node to evaluate
+ in status: Status byte
+ out out:   Pointer to the QuerySet receiving the matching data words
+ Returns:
+ - 0 on success
+ - -1 if a set needs more than QUERY_MAX_RANGES ranges */
+static int query_eval(const QueryParser *parser, int node, unsigned char status, QuerySet *out) {
+  const QueryNode *n = &parser->nodes[node];
+  QuerySet left, right;
+
+  out->count = 0;
+  switch (n->kind) {
+    case QUERY_NODE_AND:
+      if (query_eval(parser, n->left, status, &left) != 0 || query_eval(parser, n->right, status, &right) != 0) {
+        return -1;
+      }
+      return query_set_and(&left, &right, out);
+    case QUERY_NODE_OR:
+      if (query_eval(parser, n->left, status, &left) != 0 || query_eval(parser, n->right, status, &right) != 0) {
+        return -1;
+      }
+      return query_set_or(&left, &right, out);
+    case QUERY_NODE_NOT:
+      if (query_eval(parser, n->left, status, &left) != 0) {
+        return -1;
+      }
+      return query_set_not(&left, out);
+    default:
+      break;
+  }
+
+  unsigned int number = n->number;
+
+  // a status field is fixed by the byte, so it matches every data word or none
+  if (query_fields[n->field].shift >= 0) {
+    unsigned int value = (status >> query_fields[n->field].shift) & query_fields[n->field].max;
+    int matches;
+    switch (n->op) {
+      case QUERY_OP_EQ: matches = value == number; break;
+      case QUERY_OP_NE: matches = value != number; break;
+      case QUERY_OP_LT: matches = value < number; break;
+      case QUERY_OP_LE: matches = value <= number; break;
+      case QUERY_OP_GT: matches = value > number; break;
+      default: matches = value >= number; break;
+    }
+    return matches ? query_set_append(out, 0, UINT_MAX) : 0;
+  }
+
+  switch (n->op) {
+    case QUERY_OP_EQ:
+      return query_set_append(out, number, number);
+    case QUERY_OP_NE:
+      if (number > 0 && query_set_append(out, 0, number - 1) != 0) {
+        return -1;
+      }
+      return number < UINT_MAX ? query_set_append(out, number + 1, UINT_MAX) : 0;
+    case QUERY_OP_LT:
+      return number > 0 ? query_set_append(out, 0, number - 1) : 0;
+    case QUERY_OP_LE:
+      return query_set_append(out, 0, number);
+    case QUERY_OP_GT:
+      return number < UINT_MAX ? query_set_append(out, number + 1, UINT_MAX) : 0;
+    default:
+      return query_set_append(out, number, UINT_MAX);
+  }
+}
+
+/* adds a range after the last one of a set, merging it when they touch.
+
+ in/out set: Pointer to the QuerySet
+ in low:     First word of the range, not below the last range's first word
+ in high:    Last word of the range
+ Returns:
+ - 0 on success
+ - -1 if the set is full */
+static int query_set_append(QuerySet *set, unsigned int low, unsigned int high) {
+  if (set->count > 0) {
+    SubsysRange *last = &set->ranges[set->count - 1];
+    if (low <= last->high || low == last->high + 1) {
+      if (high > last->high) {
+        last->high = high;
+      }
+      return 0;
+    }
+  }
+
+  if (set->count == QUERY_MAX_RANGES) {
+    return -1;
+  }
+  set->ranges[set->count].low = low;
+  set->ranges[set->count].high = high;
+  set->count++;
+  return 0;
+}
+
+/* intersects two sets.
+
+ in a:    Pointer to the first QuerySet
+ in b:    Pointer to the second QuerySet
+ out out: Pointer to the QuerySet receiving the words in both
+ Returns:
+ - 0 on success
+ - -1 if the result does not fit */
+static int query_set_and(const QuerySet *a, const QuerySet *b, QuerySet *out) {
+  int i = 0, j = 0;
+
+  out->count = 0;
+  while (i < a->count && j < b->count) {
+    unsigned int low = a->ranges[i].low > b->ranges[j].low ? a->ranges[i].low : b->ranges[j].low;
+    unsigned int high = a->ranges[i].high < b->ranges[j].high ? a->ranges[i].high : b->ranges[j].high;
+    if (low <= high && query_set_append(out, low, high) != 0) {
+      return -1;
+    }
+    if (a->ranges[i].high < b->ranges[j].high) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return 0;
+}
+
+/* unites two sets.
+
+ in a:    Pointer to the first QuerySet
+ in b:    Pointer to the second QuerySet
+ out out: Pointer to the QuerySet receiving the words in either
+ Returns:
+ - 0 on success
+ - -1 if the result does not fit */
+static int query_set_or(const QuerySet *a, const QuerySet *b, QuerySet *out) {
+  int i = 0, j = 0;
+
+  out->count = 0;
+  while (i < a->count || j < b->count) {
+    const SubsysRange *next;
+    if (j == b->count || (i < a->count && a->ranges[i].low <= b->ranges[j].low)) {
+      next = &a->ranges[i++];
+    } else {
+      next = &b->ranges[j++];
+    }
+    if (query_set_append(out, next->low, next->high) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* complements a set.
+
+ in a:    Pointer to the QuerySet
+ out out: Pointer to the QuerySet receiving the words not in it
+ Returns:
+ - 0 on success
+ - -1 if the result does not fit */
+static int query_set_not(const QuerySet *a, QuerySet *out) {
+  unsigned int next = 0;
+
+  out->count = 0;
+  for (int i = 0; i < a->count; i++) {
+    if (a->ranges[i].low > next && query_set_append(out, next, a->ranges[i].low - 1) != 0) {
+      return -1;
+    }
+    if (a->ranges[i].high == UINT_MAX) {
+      return 0;
+    }
+    next = a->ranges[i].high + 1;
+  }
+  return query_set_append(out, next, UINT_MAX);
+}
+
+/* picks a single mask compare when the status bytes a query accepts are exactly one bit pattern
+ sharing one class, and the lookup table otherwise.
+
+ in/out query: Pointer to the SubsysQuery whose table is filled */
+static void query_plan(SubsysQuery *query) {
+  unsigned char all = 0xFF, any = 0, class = 0;
+  int accepted = 0, single_class = 1;
+
+  for (int status = 0; status < 256; status++) {
+    if (query->table[status] == 0) {
+      continue;
+    }
+    if (accepted > 0 && query->table[status] != class) {
+      single_class = 0;
+    }
+    class = query->table[status];
+    all &= status;
+    any |= status;
+    accepted++;
+  }
+
+  // bits that are the same in every accepted byte are the ones a pattern would test
+  unsigned char mask = ~(all ^ any);
+  int free_bits = 0;
+  for (int bit = 0; bit < 8; bit++) {
+    free_bits += !((mask >> bit) & 1);
+  }
+
+  if (accepted == 0 || (single_class && accepted == 1 << free_bits)) {
+    query->plan = QUERY_PLAN_MASK;
+    query->mask = accepted == 0 ? 0 : mask;
+    query->value = accepted == 0 ? 0 : all & mask;
+    query->mask_class = class;
+  } else {
+    query->plan = QUERY_PLAN_TABLE;
+  }
+}
@@ -0,0 +1,289 @@
+#include "subsystem.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* gives the ring of a subsystem, only if the subsystem is the one it was attached to.
+ A copy of the subsystem that still carries the pointer gets NULL, so it can never consume,
+ produce or free the ring behind its owner's back.
+
+ in subsystem: Pointer to the Subsystem
+ Returns:
+ - The ring owned by the subsystem
+ - NULL if it has none */
+SubsysRing *subsys_ring_owned(const Subsystem *subsystem) {
+  SubsysRing *ring = subsystem->ring;
+  return ring != NULL && ring->owner == subsystem ? ring : NULL;
+}
+
+/* keeps the DATA status bit in line with the ring after the consumer drained it.
+ The bit is cleared first and then set again if the producer raced in a new word,
+ so it can never stay cleared while words are queued.
+
+ in/out subsystem: Pointer to the Subsystem that owns the ring */
+static void subsys_ring_sync_data_bit(Subsystem *subsystem) {
+  SubsysRing *ring = subsystem->ring;
+
+  __atomic_fetch_and(&subsystem->status, ~(1 << STATUS_DATA), __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head) {
+    __atomic_fetch_or(&subsystem->status, 1 << STATUS_DATA, __ATOMIC_SEQ_CST);
+  }
+}
+
+/* gives the subsystem a bounded ring of data words instead of its single data word.
+
+ in/out subsystem: Pointer to the Subsystem structure
+ in capacity:      Number of words the ring holds, rounded up to a power of two
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_MAX_CAPACITY if the capacity is 0, above MAX_RING, or a ring is already attached
+ - ERR_NO_MEMORY if the ring could not be allocated
+ - ERR_SUCCESS otherwise */
+int subsys_ring_attach(Subsystem *subsystem, unsigned int capacity) {
+  if (subsystem == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  if (capacity == 0 || capacity > MAX_RING || subsys_ring_owned(subsystem) != NULL) {
+    return ERR_MAX_CAPACITY;
+  }
+
+  // rounds the capacity up so indexes can be masked instead of divided
+  unsigned int size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  SubsysRing *ring = aligned_alloc(CACHE_LINE, sizeof(SubsysRing));
+  if (ring == NULL) {
+    return ERR_NO_MEMORY;
+  }
+
+  ring->slots = malloc(sizeof(unsigned int) * size);
+  if (ring->slots == NULL) {
+    free(ring);
+    return ERR_NO_MEMORY;
+  }
+
+  ring->owner = subsystem;
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->overflows = 0;
+  ring->drops = 0;
+
+  // a word already in the data field becomes the first queued word
+  subsys_seq_write_begin(&subsystem->seq);
+  if ((subsystem->status >> STATUS_DATA) & 1) {
+    ring->slots[0] = subsystem->data;
+    ring->tail = 1;
+  }
+  subsystem->data = 0;
+  subsystem->ring = ring;
+  subsys_seq_write_end(&subsystem->seq);
+
+  return ERR_SUCCESS;
+}
+
+/* removes the data ring of a subsystem, discarding any queued words.
+ Must not be called while the producer or consumer is still using the ring.
+ Only the subsystem the ring was attached to can detach it.
+
+ in/out subsystem: Pointer to the Subsystem structure
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_NO_DATA if the subsystem has no ring
+ - ERR_SUCCESS otherwise */
+int subsys_ring_detach(Subsystem *subsystem) {
+  if (subsystem == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  SubsysRing *ring = subsys_ring_owned(subsystem);
+  if (ring == NULL) {
+    return ERR_NO_DATA;
+  }
+
+  subsys_seq_write_begin(&subsystem->seq);
+  subsystem->ring = NULL;
+  subsystem->status &= ~(1 << STATUS_DATA);
+  subsys_seq_write_end(&subsystem->seq);
+
+  free(ring->slots);
+  free(ring);
+
+  return ERR_SUCCESS;
+}
+
+/* queues a batch of data words, only the producer thread may call this.
+ Words that do not fit are dropped and counted rather than overwriting queued words.
+
+ in/out subsystem: Pointer to the Subsystem structure
+ in data:          Array of words to queue
+ in count:         Number of words in data
+ out pushed:       Number of words actually queued, may be NULL
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_NO_DATA if the subsystem has no ring
+ - ERR_MAX_CAPACITY if some words were dropped
+ - ERR_SUCCESS otherwise */
+int subsys_data_push(Subsystem *subsystem, const unsigned int *data, unsigned int count, unsigned int *pushed) {
+  if (subsystem == NULL || (data == NULL && count > 0)) {
+    return ERR_NULL_POINTER;
+  }
+
+  SubsysRing *ring = subsys_ring_owned(subsystem);
+  if (ring == NULL) {
+    return ERR_NO_DATA;
+  }
+
+  // tail is ours, head is only read once for the whole batch
+  unsigned int tail = ring->tail;
+  unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  unsigned int space = ring->mask + 1 - (tail - head);
+  unsigned int n = count < space ? count : space;
+
+  for (unsigned int i = 0; i < n; i++) {
+    ring->slots[(tail + i) & ring->mask] = data[i];
+  }
+
+  // publishes the whole batch with a single store
+  __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+
+  if (n > 0) {
+    __atomic_fetch_or(&subsystem->status, 1 << STATUS_DATA, __ATOMIC_SEQ_CST);
+  }
+
+  if (pushed != NULL) {
+    *pushed = n;
+  }
+
+  if (n < count) {
+    __atomic_fetch_add(&ring->overflows, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ring->drops, count - n, __ATOMIC_RELAXED);
+    return ERR_MAX_CAPACITY;
+  }
+
+  return ERR_SUCCESS;
+}
+
+/* dequeues up to max data words, only the consumer thread may call this.
+
+ in/out subsystem: Pointer to the Subsystem structure
+ out dest:         Array that receives the words
+ in max:           Size of dest
+ out popped:       Number of words dequeued, may be NULL
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_NO_DATA if the subsystem has no ring or nothing was queued
+ - ERR_SUCCESS otherwise */
+int subsys_data_pop(Subsystem *subsystem, unsigned int *dest, unsigned int max, unsigned int *popped) {
+  if (subsystem == NULL || (dest == NULL && max > 0)) {
+    return ERR_NULL_POINTER;
+  }
+
+  if (popped != NULL) {
+    *popped = 0;
+  }
+
+  SubsysRing *ring = subsys_ring_owned(subsystem);
+  if (ring == NULL) {
+    return ERR_NO_DATA;
+  }
+
+  // head is ours, tail is only read once for the whole batch
+  unsigned int head = ring->head;
+  unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  unsigned int queued = tail - head;
+  unsigned int n = max < queued ? max : queued;
+
+  if (n == 0) {
+    return ERR_NO_DATA;
+  }
+
+  for (unsigned int i = 0; i < n; i++) {
+    dest[i] = ring->slots[(head + i) & ring->mask];
+  }
+
+  // hands the slots back to the producer
+  __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+
+  if (n == queued) {
+    subsys_ring_sync_data_bit(subsystem);
+  }
+
+  if (popped != NULL) {
+    *popped = n;
+  }
+
+  return ERR_SUCCESS;
+}
+
+/* reads the oldest queued word without removing it, only the consumer thread may call this.
+ Monitoring threads use subsys_ring_stats instead, the slot may be reused once the consumer moves on.
+
+ in subsystem: Pointer to the Subsystem structure
+ out data:     Oldest queued word, 0 if the ring is empty
+ out queued:   Number of words queued, may be NULL
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_NO_DATA if the subsystem has no ring or nothing was queued
+ - ERR_SUCCESS otherwise */
+int subsys_data_peek(const Subsystem *subsystem, unsigned int *data, unsigned int *queued) {
+  if (subsystem == NULL || data == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  const SubsysRing *ring = subsys_ring_owned(subsystem);
+  if (ring == NULL) {
+    return ERR_NO_DATA;
+  }
+
+  unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if (queued != NULL) {
+    *queued = tail - head;
+  }
+
+  if (tail == head) {
+    *data = 0;
+    return ERR_NO_DATA;
+  }
+
+  *data = ring->slots[head & ring->mask];
+  return ERR_SUCCESS;
+}
+
+/* reports the fill level and overflow counters of a subsystem's ring.
+
+ in subsystem:  Pointer to the Subsystem structure
+ out queued:    Number of words queued, may be NULL
+ out overflows: Number of pushes that dropped words, may be NULL
+ out drops:     Number of words dropped, may be NULL
+ Returns:
+ - ERR_NULL_POINTER if a null pointer is passed
+ - ERR_NO_DATA if the subsystem has no ring
+ - ERR_SUCCESS otherwise */
+int subsys_ring_stats(const Subsystem *subsystem, unsigned int *queued, unsigned int *overflows, unsigned int *drops) {
+  if (subsystem == NULL) {
+    return ERR_NULL_POINTER;
+  }
+
+  const SubsysRing *ring = subsys_ring_owned(subsystem);
+  if (ring == NULL) {
+    return ERR_NO_DATA;
+  }
+
+  if (queued != NULL) {
+    *queued = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  }
+  if (overflows != NULL) {
+    *overflows = __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+  }
+  if (drops != NULL) {
+    *drops = __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+  }
+
+  return ERR_SUCCESS;
+}
@@ -1,3 +1,6 @@
+#ifndef SUBSYSTEM_H
+#define SUBSYSTEM_H
+
 #include <stdio.h>
 #include <string.h>
 
@@ -9,6 +12,8 @@
 #define ERR_MAX_CAPACITY -4
 #define ERR_NULL_POINTER -5
 #define ERR_SYS_NOT_FOUND -6
+#define ERR_NO_MEMORY -7
+#define ERR_INVALID_QUERY -8
 
 // Status Bits
 #define STATUS_POWER 7
@@ -21,29 +26,110 @@
 // Magic Numbers
 #define MAX_STR 32
 #define MAX_ARR 100
+#define MAX_RING 65536
+#define CACHE_LINE 64
+#define QUERY_MAX_TEXT 128     // Longest query text kept for display
+#define QUERY_MAX_NODES 64     // Comparisons and operators in one query
+#define QUERY_MAX_RANGES 8     // Disjoint data ranges one condition may hold
+#define QUERY_MAX_CLASSES 8    // Distinct data conditions one compiled query may hold
+#define FEED_MAX_SUBSCRIBERS 8 // Subscribers one change feed can notify
+#define FEED_COLUMN (((MAX_ARR) + 7) / 8 * 8)   // Status column padded to whole 64-bit words
+
+// How a compiled query picks the status bytes it accepts
+#define QUERY_PLAN_MASK 0      // (status & mask) == value, every accepted byte sharing one class
+#define QUERY_PLAN_TABLE 1     // class looked up per status byte
+
+// Single-producer/single-consumer ring of data words for one subsystem
+// head is only written by the consumer and tail only by the producer, so each gets its own cache line
+// owner is the one Subsystem the ring belongs to, copies of it that still point at the ring cannot use it
+typedef struct SubsysRing {
+    const void *owner;                       // Subsystem the ring was attached to
+    unsigned int *slots;
+    unsigned int mask;                       // capacity - 1, capacity is a power of two
+    _Alignas(CACHE_LINE) unsigned int head;  // next slot to read
+    _Alignas(CACHE_LINE) unsigned int tail;  // next slot to write
+    unsigned int overflows;                  // enqueues that could not fit every word
+    unsigned int drops;                      // words lost to overflow
+} SubsysRing;
 
 // Subsystem Structure
+// seq is a seqlock counter: odd while a writer is updating the subsystem
+// ring is optional, when set data words are queued there instead of overwriting data
+// ring is never copied: snapshots, filter results and appended copies start without one
 typedef struct {
     char name[MAX_STR];
     unsigned char status;
     unsigned int data;
+    unsigned int seq;
+    SubsysRing *ring;
 } Subsystem;
 
+// Inclusive range of data words
+typedef struct SubsysRange {
+    unsigned int low;
+    unsigned int high;
+} SubsysRange;
+
+// Query over the status fields and data of subsystems, compiled once by subsys_query_compile
+// Each status byte maps to a class: 0 never matches, 1 always matches and 2 or more matches when
+// data falls in ranges[class - 2], so a subsystem is checked with one mask or lookup and at most
+// a few range compares
+typedef struct SubsysQuery {
+    unsigned char plan;                 // QUERY_PLAN_MASK or QUERY_PLAN_TABLE
+    unsigned char mask;                 // Status bits tested by QUERY_PLAN_MASK
+    unsigned char value;                // Value of those bits
+    unsigned char mask_class;           // Class of every byte accepted by QUERY_PLAN_MASK
+    unsigned char reads_data;           // non-zero if some class depends on data
+    unsigned char table[256];           // Class of each status byte for QUERY_PLAN_TABLE
+    unsigned char range_counts[QUERY_MAX_CLASSES];
+    SubsysRange ranges[QUERY_MAX_CLASSES][QUERY_MAX_RANGES];
+    char text[QUERY_MAX_TEXT];          // Source of the query, truncated
+} SubsysQuery;
+
 // Subsystem Collection Structure
+// seq guards the membership of the collection (append/remove), each subsystem guards its own fields
 typedef struct {
     Subsystem subsystems[MAX_ARR];
     unsigned int size;
+    unsigned int seq;
 } SubsystemCollection;
 
+// One subsystem whose status changed between two polls of a change feed
+typedef struct SubsysChange {
+    unsigned int index;       // Position in the collection at the time of the poll
+    unsigned char changed;    // Status bits that differ from the previous poll
+    unsigned char status;     // Status now
+} SubsysChange;
+
+// Receives the changes of one poll that touch a subscriber's mask, in index order
+typedef void (*SubsysChangeHandler)(const SubsysChange *changes, unsigned int count, void *context);
+
+// Change feed over the status bytes of a collection
+// previous is the status column seen by the last poll, a poll gathers the new column and XORs the two
+// a word at a time, so only changed subsystems are looked at and handed to the subscribers
+typedef struct SubsysFeed {
+    const SubsystemCollection *collection;
+    _Alignas(8) unsigned char previous[FEED_COLUMN];  // Zero past the last subsystem
+    unsigned char subscribers_for[256];               // Bit per subscriber whose mask meets a changed-bits value
+    unsigned char masks[FEED_MAX_SUBSCRIBERS];        // 0 for a free slot
+    SubsysChangeHandler handlers[FEED_MAX_SUBSCRIBERS];
+    void *contexts[FEED_MAX_SUBSCRIBERS];
+    SubsysChange batches[FEED_MAX_SUBSCRIBERS][MAX_ARR];
+    unsigned long long polls;
+    unsigned long long changes;                       // Changed subsystems seen over every poll
+} SubsysFeed;
+
 // Forward Declarations
 int subsys_init(Subsystem *subsystem, const char *name, char status);
 int subsys_collection_init(SubsystemCollection *subsystems);
 int subsys_append(SubsystemCollection *subsystems, const Subsystem *subsystem);
 int subsys_find(const SubsystemCollection *subsystems, const char *name);
 int subsys_print(Subsystem *subsystem);
+int subsys_print_queued(const Subsystem *subsystem, unsigned int queued);
 int subsys_collection_print(SubsystemCollection *subsystems);
 int subsys_status_set(Subsystem *subsystem, unsigned char status, unsigned char value);
 int subsys_status_print(const Subsystem *subsystem);
+int subsys_status_atomic_set(Subsystem *subsystem, unsigned char status, unsigned char value);
 int subsys_data_set(Subsystem *subsystem, unsigned int new_data, unsigned int *old_data);
 int subsys_data_get(Subsystem *subsystem, unsigned int *dest);
 int subsys_remove(SubsystemCollection *subsystems, int index);
@@ -51,3 +137,33 @@ int subsys_filter(const SubsystemCollection *src, SubsystemCollection *dest, con
 
 // helper functions
 int verify_subsystem_exists(SubsystemCollection *collection, const char *name);
+
+// seqlock functions
+void subsys_seq_write_begin(unsigned int *seq);
+void subsys_seq_write_end(unsigned int *seq);
+unsigned int subsys_seq_read_begin(const unsigned int *seq);
+int subsys_seq_read_retry(const unsigned int *seq, unsigned int start);
+int subsys_snapshot(const Subsystem *src, Subsystem *dest);
+int subsys_collection_snapshot(const SubsystemCollection *src, SubsystemCollection *dest);
+
+// data ring functions
+int subsys_ring_attach(Subsystem *subsystem, unsigned int capacity);
+int subsys_ring_detach(Subsystem *subsystem);
+SubsysRing *subsys_ring_owned(const Subsystem *subsystem);
+int subsys_data_push(Subsystem *subsystem, const unsigned int *data, unsigned int count, unsigned int *pushed);
+int subsys_data_pop(Subsystem *subsystem, unsigned int *dest, unsigned int max, unsigned int *popped);
+int subsys_data_peek(const Subsystem *subsystem, unsigned int *data, unsigned int *queued);
+int subsys_ring_stats(const Subsystem *subsystem, unsigned int *queued, unsigned int *overflows, unsigned int *drops);
+
+// change feed functions
+int subsys_feed_init(SubsysFeed *feed, const SubsystemCollection *collection);
+int subsys_feed_subscribe(SubsysFeed *feed, unsigned char mask, SubsysChangeHandler handler, void *context);
+int subsys_feed_unsubscribe(SubsysFeed *feed, int subscriber);
+int subsys_feed_poll(SubsysFeed *feed, unsigned int *changes);
+
+// query functions
+int subsys_query_compile(SubsysQuery *query, const char *text);
+int subsys_query_match(const SubsysQuery *query, unsigned char status, unsigned int data);
+int subsys_query_select(const SubsysQuery *query, const SubsystemCollection *src, unsigned int *indices, unsigned int *count);
+
+#endif
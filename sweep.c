@@ -0,0 +1,384 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define SWEEP_MAX_ITERATIONS 1000000   // Iteration cap per run, in case no system advances the clock
+#define SWEEP_DEFAULT_LIMIT 600        // Default virtual time limit per run in seconds
+#define SWEEP_OUTCOMES 3
+
+// A rocket parameter that can be varied, with the range it is drawn from
+typedef struct SweepParam {
+    const char *name;
+    size_t offset;      // Offset of the int field inside RocketParams
+    int min;
+    int max;
+} SweepParam;
+
+// The parameters and outcome of a single run
+typedef struct SweepRun {
+    RocketParams params;
+    int outcome;            // OUTCOME_*, OUTCOME_RUNNING if the time limit was hit
+    long long finish_us;    // Virtual time when the run stopped
+    int min_oxygen;         // Lowest Oxygen amount seen
+    int iterations;
+} SweepRun;
+
+// Work shared by all sweep threads, runs are claimed one at a time through `next`
+typedef struct SweepJob {
+    SweepRun *runs;
+    int count;
+    int next;
+    long long limit_us;
+} SweepJob;
+
+static SweepParam sweep_params[] = {
+    { "fuel",              offsetof(RocketParams, fuel),              0, 0 },
+    { "fuel-capacity",     offsetof(RocketParams, fuel_capacity),     0, 0 },
+    { "oxygen",            offsetof(RocketParams, oxygen),            0, 0 },
+    { "oxygen-capacity",   offsetof(RocketParams, oxygen_capacity),   0, 0 },
+    { "energy",            offsetof(RocketParams, energy),            0, 0 },
+    { "energy-capacity",   offsetof(RocketParams, energy_capacity),   0, 0 },
+    { "distance-capacity", offsetof(RocketParams, distance_capacity), 0, 0 },
+    { "propulsion-time",   offsetof(RocketParams, propulsion_time),   0, 0 },
+    { "life-support-time", offsetof(RocketParams, life_support_time), 0, 0 },
+    { "crew-time",         offsetof(RocketParams, crew_time),         0, 0 },
+    { "generator-time",    offsetof(RocketParams, generator_time),    0, 0 },
+};
+
+#define SWEEP_PARAM_COUNT ((int)(sizeof(sweep_params) / sizeof(sweep_params[0])))
+
+static int sweep_parse_range(const char *spec);
+static void sweep_draw(SweepRun *run, unsigned int *seed);
+static void sweep_run_one(SweepRun *run, long long limit_us);
+static void *sweep_worker(void *arg);
+static void sweep_print_summary(const SweepRun *runs, int count);
+static int sweep_write_csv(const SweepRun *runs, int count, const char *path);
+
+/**
+ * Runs a Monte Carlo sweep of the rocket scenario.
+ *
+ * Draws the varied parameters for every run up front from `--seed`, so a sweep is reproducible
+ * regardless of thread count, then runs each independent `Manager` in virtual time on a pool of
+ * threads and prints a summary table of the outcomes.
+ *
+ * Usage: --sweep RUNS [--threads N] [--seed S] [--limit SECONDS] [--csv FILE] [--vary NAME=MIN:MAX]...
+ *
+ * @param[in] argc  Argument count, `argv[0]` is `--sweep`.
+ * @param[in] argv  Arguments.
+ * @return          Process exit status.
+ */
+int sweep_main(int argc, char *argv[]) {
+    RocketParams defaults;
+    SweepJob job;
+    pthread_t *threads;
+    const char *csv_path = NULL;
+    unsigned int seed = 1;
+    int thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int i;
+
+    // Every parameter starts fixed at its standard value
+    rocket_params_default(&defaults);
+    for (i = 0; i < SWEEP_PARAM_COUNT; i++) {
+        sweep_params[i].min = *(int*)((char*)&defaults + sweep_params[i].offset);
+        sweep_params[i].max = sweep_params[i].min;
+    }
+
+    job.count = argc > 1 ? atoi(argv[1]) : 0;
+    job.next = 0;
+    job.limit_us = SWEEP_DEFAULT_LIMIT * 1000000LL;
+
+    for (i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            job.limit_us = atoll(argv[++i]) * 1000000LL;
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--vary") == 0 && i + 1 < argc && sweep_parse_range(argv[i + 1])) {
+            i++;
+        } else {
+            job.count = 0;
+            break;
+        }
+    }
+
+    if (job.count <= 0 || job.limit_us <= 0) {
+        fprintf(stderr, "Usage: --sweep RUNS [--threads N] [--seed S] [--limit SECONDS] [--csv FILE] [--vary NAME=MIN:MAX]...\n");
+        fprintf(stderr, "Parameters:");
+        for (i = 0; i < SWEEP_PARAM_COUNT; i++) {
+            fprintf(stderr, " %s", sweep_params[i].name);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (thread_count > job.count) {
+        thread_count = job.count;
+    }
+
+    job.runs = malloc(sizeof(SweepRun) * job.count);
+    threads = malloc(sizeof(pthread_t) * thread_count);
+    if (job.runs == NULL || threads == NULL) {
+        free(job.runs);
+        free(threads);
+        return 1;
+    }
+
+    for (i = 0; i < job.count; i++) {
+        sweep_draw(&job.runs[i], &seed);
+    }
+
+    for (i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, sweep_worker, &job);
+    }
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("Sweep of %d runs on %d threads\n", job.count, thread_count);
+    for (i = 0; i < SWEEP_PARAM_COUNT; i++) {
+        if (sweep_params[i].min != sweep_params[i].max) {
+            printf("  %-18s %d..%d\n", sweep_params[i].name, sweep_params[i].min, sweep_params[i].max);
+        }
+    }
+    sweep_print_summary(job.runs, job.count);
+
+    if (csv_path != NULL && sweep_write_csv(job.runs, job.count, csv_path) != 0) {
+        fprintf(stderr, "Could not write '%s'\n", csv_path);
+    }
+
+    free(job.runs);
+    free(threads);
+    return 0;
+}
+
+/**
+ * Parses a `NAME=MIN:MAX` range and stores it in the parameter table.
+ *
+ * @param[in] spec  Range specification.
+ * @return          Non-zero if the range was valid.
+ */
+static int sweep_parse_range(const char *spec) {
+    const char *equals = strchr(spec, '=');
+    int min, max;
+
+    if (equals == NULL || sscanf(equals + 1, "%d:%d", &min, &max) != 2 || min < 0 || max < min) {
+        return 0;
+    }
+
+    for (int i = 0; i < SWEEP_PARAM_COUNT; i++) {
+        if (strlen(sweep_params[i].name) == (size_t)(equals - spec) &&
+            strncmp(sweep_params[i].name, spec, equals - spec) == 0) {
+            sweep_params[i].min = min;
+            sweep_params[i].max = max;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Draws the parameters of one run uniformly from the configured ranges.
+ *
+ * @param[out]    run   Pointer to the `SweepRun` to fill.
+ * @param[in,out] seed  Random state, advanced by the draw.
+ */
+static void sweep_draw(SweepRun *run, unsigned int *seed) {
+    for (int i = 0; i < SWEEP_PARAM_COUNT; i++) {
+        int span = sweep_params[i].max - sweep_params[i].min + 1;
+        int *field = (int*)((char*)&run->params + sweep_params[i].offset);
+        *field = sweep_params[i].min + (span > 1 ? rand_r(seed) % span : 0);
+    }
+
+    // Keep the starting amounts valid for the drawn capacities
+    if (run->params.fuel > run->params.fuel_capacity) {
+        run->params.fuel = run->params.fuel_capacity;
+    }
+    if (run->params.oxygen > run->params.oxygen_capacity) {
+        run->params.oxygen = run->params.oxygen_capacity;
+    }
+    if (run->params.energy > run->params.energy_capacity) {
+        run->params.energy = run->params.energy_capacity;
+    }
+}
+
+/**
+ * Runs one simulation to completion in virtual time.
+ *
+ * Everything the run touches lives in its own `Manager`, so runs never share mutable state.
+ * Each system keeps its own deadline, as in the scheduled and deterministic modes: every pass
+ * advances the shared clock to the earliest deadline and steps each system that is due.
+ *
+ * @param[in,out] run       Pointer to the `SweepRun` holding the parameters, receives the outcome.
+ * @param[in]     limit_us  Virtual time after which the run is stopped.
+ */
+static void sweep_run_one(SweepRun *run, long long limit_us) {
+    Manager manager;
+    Resource *oxygen;
+    long long *due_us;
+    long long next_us;
+    int i;
+
+    manager_init(&manager);
+    manager.quiet = 1;
+    sim_clock_init(&manager.clock, 1);
+    scenario_load_rocket(&manager, &run->params);
+
+    for (i = 0; i < manager.system_array.size; i++) {
+        manager.system_array.systems[i]->clock = &manager.clock;
+    }
+
+    // Oxygen is the second resource of the rocket scenario
+    oxygen = manager.resource_array.resources[1];
+    run->min_oxygen = oxygen->amount;
+    run->iterations = 0;
+
+    due_us = calloc(manager.system_array.size + 1, sizeof(long long));
+    if (due_us == NULL) {
+        manager.simulation_running = 0;
+    }
+
+    while (manager.simulation_running && manager.clock.now_us < limit_us && run->iterations < SWEEP_MAX_ITERATIONS) {
+        manager_run(&manager);
+
+        // Jump straight to the earliest deadline instead of waiting out every system in turn
+        next_us = -1;
+        for (i = 0; i < manager.system_array.size; i++) {
+            System *system = manager.system_array.systems[i];
+            if (system->phase == SYSTEM_PHASE_START && system->status == TERMINATE) {
+                continue;
+            }
+            if (next_us < 0 || due_us[i] < next_us) {
+                next_us = due_us[i];
+            }
+        }
+        if (next_us < 0) {
+            break;
+        }
+        if (next_us > manager.clock.now_us) {
+            manager.clock.now_us = next_us;
+        }
+
+        for (i = 0; i < manager.system_array.size && manager.simulation_running; i++) {
+            System *system = manager.system_array.systems[i];
+            if (due_us[i] > manager.clock.now_us ||
+                (system->phase == SYSTEM_PHASE_START && system->status == TERMINATE)) {
+                continue;
+            }
+            due_us[i] += system_step(system);
+            if (oxygen->amount < run->min_oxygen) {
+                run->min_oxygen = oxygen->amount;
+            }
+        }
+        run->iterations++;
+    }
+
+    run->outcome = manager.outcome;
+    run->finish_us = manager.clock.now_us;
+    free(due_us);
+    manager_clean(&manager);
+}
+
+/**
+ * Sweep thread body, claims and runs simulations until none are left.
+ *
+ * @param[in,out] arg  Pointer to the shared `SweepJob`.
+ * @return             NULL.
+ */
+static void *sweep_worker(void *arg) {
+    SweepJob *job = (SweepJob*)arg;
+    int index;
+
+    while ((index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        sweep_run_one(&job->runs[index], job->limit_us);
+    }
+    return NULL;
+}
+
+/**
+ * Prints the aggregated outcomes of a sweep as a table.
+ *
+ * @param[in] runs   Completed runs.
+ * @param[in] count  Number of runs.
+ */
+static void sweep_print_summary(const SweepRun *runs, int count) {
+    static const char *names[SWEEP_OUTCOMES] = { "Time limit", "Destination", "Oxygen depleted" };
+    long long total_us[SWEEP_OUTCOMES] = { 0 }, min_us[SWEEP_OUTCOMES], max_us[SWEEP_OUTCOMES] = { 0 };
+    long long total_oxygen[SWEEP_OUTCOMES] = { 0 };
+    int runs_per[SWEEP_OUTCOMES] = { 0 }, lowest_oxygen[SWEEP_OUTCOMES];
+    int i, o;
+
+    for (o = 0; o < SWEEP_OUTCOMES; o++) {
+        min_us[o] = -1;
+        lowest_oxygen[o] = 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        o = runs[i].outcome;
+        if (runs_per[o] == 0 || runs[i].min_oxygen < lowest_oxygen[o]) {
+            lowest_oxygen[o] = runs[i].min_oxygen;
+        }
+        if (min_us[o] < 0 || runs[i].finish_us < min_us[o]) {
+            min_us[o] = runs[i].finish_us;
+        }
+        if (runs[i].finish_us > max_us[o]) {
+            max_us[o] = runs[i].finish_us;
+        }
+        runs_per[o]++;
+        total_us[o] += runs[i].finish_us;
+        total_oxygen[o] += runs[i].min_oxygen;
+    }
+
+    printf("\n%-16s %8s %7s %10s %10s %10s %10s %10s\n",
+           "Outcome", "Runs", "Share", "Mean s", "Min s", "Max s", "Mean minO2", "Lowest O2");
+    printf("-------------------------------------------------------------------------------------\n");
+    for (o = 0; o < SWEEP_OUTCOMES; o++) {
+        if (runs_per[o] == 0) {
+            continue;
+        }
+        printf("%-16s %8d %6.1f%% %10.2f %10.2f %10.2f %10.1f %10d\n",
+               names[o], runs_per[o], 100.0 * runs_per[o] / count,
+               total_us[o] / 1e6 / runs_per[o], min_us[o] / 1e6, max_us[o] / 1e6,
+               (double)total_oxygen[o] / runs_per[o], lowest_oxygen[o]);
+    }
+}
+
+/**
+ * Writes one CSV row per run with its parameters and outcome.
+ *
+ * @param[in] runs   Completed runs.
+ * @param[in] count  Number of runs.
+ * @param[in] path   Path of the CSV file.
+ * @return           0 on success, -1 on failure.
+ */
+static int sweep_write_csv(const SweepRun *runs, int count, const char *path) {
+    FILE *file = fopen(path, "w");
+    int i, p;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    for (p = 0; p < SWEEP_PARAM_COUNT; p++) {
+        fprintf(file, "%s,", sweep_params[p].name);
+    }
+    fprintf(file, "outcome,finish_us,min_oxygen,iterations\n");
+
+    for (i = 0; i < count; i++) {
+        for (p = 0; p < SWEEP_PARAM_COUNT; p++) {
+            fprintf(file, "%d,", *(const int*)((const char*)&runs[i].params + sweep_params[p].offset));
+        }
+        fprintf(file, "%d,%lld,%d,%d\n", runs[i].outcome, runs[i].finish_us, runs[i].min_oxygen, runs[i].iterations);
+    }
+
+    return fclose(file) == 0 ? 0 : -1;
+}
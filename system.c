@@ -3,13 +3,19 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <sched.h>
 
 // Helper functions just used by this C file to clean up our code
 // Using static means they can't get linked into other files
 
-static int system_convert(System *);
-static void system_simulate_process_time(System *);
-static int system_store_resources(System *);
+static void system_init(System *, ResourceAmount, ResourceAmount, int, EventQueue *);
+static long long system_process_time_us(System *);
+static void system_health_set(System *, unsigned char, unsigned char);
+static void system_health_refresh(System *);
+static void system_report(System *, const Event *);
+static void system_step_report(System *, SystemRequest *);
+static ArrayVersion *system_array_copy(const ArrayVersion *, int);
+static void system_array_publish(SystemArray *, ArrayVersion *);
 
 /**
  * Creates a new `System` object.
@@ -25,8 +31,8 @@ static int system_store_resources(System *);
  * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
  */
 void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
-  // Allocate memory for the system
-  *system = (System*)malloc(sizeof(System));
+  // Allocate memory for the system, cache line aligned so each group of fields gets its own lines
+  *system = (System*)aligned_alloc(CACHE_LINE, sizeof(System));
   if (*system == NULL) {
       return;
   }
@@ -41,12 +47,84 @@ void system_create(System **system, const char *name, ResourceAmount consumed, R
   strcpy((*system)->name, name);
 
   // Initialize other fields
-  (*system)->consumed = consumed;
-  (*system)->produced = produced;
-  (*system)->processing_time = processing_time;
-  (*system)->event_queue = event_queue;
-  (*system)->status = STANDARD;
-  (*system)->amount_stored = 0;
+  system_init(*system, consumed, produced, processing_time, event_queue);
+}
+
+/**
+ * Creates a new `System` object inside an `Arena`.
+ *
+ * The struct is a pointer bump and the name is interned, so systems with the same name share it.
+ * The system must not be passed to `system_destroy`, it is freed with the arena.
+ *
+ * @param[out] system          Pointer to the `System*` to be allocated and initialized.
+ * @param[in,out] arena        Arena that owns the system.
+ * @param[in]  name            Name of the system (interned).
+ * @param[in]  consumed        `ResourceAmount` representing the resource consumed.
+ * @param[in]  produced        `ResourceAmount` representing the resource produced.
+ * @param[in]  processing_time Processing time in milliseconds.
+ * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
+ */
+void system_arena_create(System **system, Arena *arena, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
+  *system = (System*)arena_alloc(arena, sizeof(System), _Alignof(System));
+  if (*system == NULL) {
+      return;
+  }
+
+  (*system)->name = arena_intern(arena, name);
+  if ((*system)->name == NULL) {
+      *system = NULL;
+      return;
+  }
+
+  system_init(*system, consumed, produced, processing_time, event_queue);
+}
+
+/**
+ * Reinitializes the memory of a reclaimed arena `System` as a new system.
+ *
+ * Lets systems removed from a live simulation be replaced without growing the arena.
+ *
+ * @param[out]    system          Pointer to the reclaimed `System`, no reader may still hold it.
+ * @param[in,out] arena           Arena that owns the system.
+ * @param[in]     name            Name of the system (interned).
+ * @param[in]     consumed        `ResourceAmount` representing the resource consumed.
+ * @param[in]     produced        `ResourceAmount` representing the resource produced.
+ * @param[in]     processing_time Processing time in milliseconds.
+ * @param[in]     event_queue     Pointer to the `EventQueue` for event handling.
+ */
+void system_arena_reuse(System *system, Arena *arena, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
+  system->name = arena_intern(arena, name);
+  system_init(system, consumed, produced, processing_time, event_queue);
+}
+
+/**
+ * Sets every field of a `System` but its name to the state of a new system.
+ *
+ * @param[out] system          Pointer to the `System` to initialize.
+ * @param[in]  consumed        `ResourceAmount` representing the resource consumed.
+ * @param[in]  produced        `ResourceAmount` representing the resource produced.
+ * @param[in]  processing_time Processing time in milliseconds.
+ * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
+ */
+static void system_init(System *system, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
+  system->consumed = consumed;
+  system->produced = produced;
+  system->processing_time = processing_time;
+  system->event_queue = event_queue;
+  system->status = STANDARD;
+  system->retired = 0;
+  system->amount_stored = 0;
+  system->released = 1;
+  system->health = NULL;
+  system->health_index = -1;
+  system->clock = NULL;
+  system->shutdown = NULL;
+  system->channel = NULL;
+  system->snapshot_seq = NULL;
+  system->phase = SYSTEM_PHASE_START;
+  system->resume_us = 0;
+  pacing_init(&system->pacing);
+  system->conversions = 0;
 }
 
 /**
@@ -70,70 +148,89 @@ void system_destroy(System *system) {
  * This function manages the lifecycle of a system, including resource conversion,
  * processing time simulation, and resource storage. It generates events based on
  * the success or failure of these operations.
+ * One pass is a run of `system_step` calls, waiting on the system's clock in between.
+ * Waits are paced against absolute deadlines, so a cycle's overshoot is absorbed by the next one.
+ * A wait cut short by the system's `Shutdown` ends the pass where it is, the system is terminated.
+ * Each step and the deadline it sets are counted on the snapshot counters, so a checkpoint barrier
+ * sees the system either waiting with its deadline set or held before its next step.
  *
  * @param[in,out] system  Pointer to the `System` to run.
  */
 void system_run(System *system) {
-    Event event;
-    int result_status;
-    
-    if (system->amount_stored == 0) {
-        // Need to convert resources (consume and process)
-        result_status = system_convert(system);
-
-        if (result_status != STATUS_OK) {
-            // Report that resources were out / insufficient
-            event_init(&event, system, system->consumed.resource, result_status, PRIORITY_HIGH, system->consumed.resource->amount);
-            event_queue_push(system->event_queue, &event);    
-            // Sleep to prevent looping too frequently and spamming with events
-            usleep(SYSTEM_WAIT_TIME * 1000);          
+    long long wait_us;
+    int interrupted;
+
+    do {
+        snapshot_step_begin(system->snapshot_seq);
+        if (system->resume_us > 0) {
+            // Finish the wait a restored checkpoint was in before stepping on
+            wait_us = system->resume_us;
+            system->resume_us = 0;
+        } else {
+            wait_us = system_step(system);
         }
-    }
+        sim_clock_pace(system->clock, &system->pacing, wait_us);
+        snapshot_commit_end(system->snapshot_seq);
 
-    if (system->amount_stored  > 0) {
-        // Attempt to store the produced resources
-        result_status = system_store_resources(system);
+        TRACE_BEGIN("system_wait");
+        interrupted = sim_clock_sleep_paced(system->clock, system->shutdown, &system->pacing, wait_us);
+        TRACE_END("system_wait");
+    } while (!interrupted && system->phase != SYSTEM_PHASE_START);
+}
 
-        if (result_status != STATUS_OK) {
-            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, system->produced.resource->amount);
-            event_queue_push(system->event_queue, &event);
-            // Sleep to prevent looping too frequently and spamming with events
-            usleep(SYSTEM_WAIT_TIME * 1000);
-        }
-    }
+/**
+ * Advances a `System` up to its next wait, without ever sleeping.
+ *
+ * The main loop is a small state machine: converting may start a processing wait, and a failed
+ * conversion or store starts a backoff wait. The caller waits the returned time and calls again,
+ * which lets a single thread drive many systems (see `manager_run_scheduled`).
+ * A step is its request, committed right away, and its completion; the deterministic mode runs
+ * the three apart so it can order the commits.
+ *
+ * @param[in,out] system  Pointer to the `System` to advance.
+ * @return                Microseconds to wait before the next step.
+ */
+long long system_step(System *system) {
+    SystemRequest request;
+
+    request.defer_event = 0;
+    system_step_request(system, &request);
+    system_request_commit(&request, system->snapshot_seq);
+    return system_step_complete(system, &request);
 }
 
 /**
- * Converts resources in a `System`.
+ * Runs the first part of a step, up to the resource change it needs.
  *
- * Handles the consumption of required resources and simulates processing time.
- * Updates the amount of produced resources based on the system's configuration.
+ * Only the system's own fields are written, resources are read but never changed.
  *
- * @param[in,out] system           Pointer to the `System` performing the conversion.
- * @param[out]    amount_produced  Pointer to the integer tracking the amount of produced resources.
- * @return                         `STATUS_OK` if successful, or an error status code.
+ * @param[in,out] system   Pointer to the `System` to advance.
+ * @param[out]    request  Pointer to the `SystemRequest` to fill, `defer_event` is left as is.
  */
-static int system_convert(System *system) {
-    int status;
-    Resource *consumed_resource = system->consumed.resource;
-    int amount_consumed = system->consumed.amount;
-
-    // We can always convert without consuming anything
-    if (consumed_resource == NULL) {
-        status = STATUS_OK;
-    } else {
-        // Attempt to consume the required resources
-        if (consumed_resource->amount >= amount_consumed) {
-            consumed_resource->amount -= amount_consumed;
-            status = STATUS_OK;
-        } else {
-            status = (consumed_resource->amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
-        }
-    }
+void system_step_request(System *system, SystemRequest *request) {
+    request->kind = SYSTEM_REQUEST_NONE;
+    request->converting = 0;
+    request->resource = NULL;
+    request->amount = 0;
+    request->has_event = 0;
 
-    if (status == STATUS_OK) {
-        system_simulate_process_time(system);
+    if (system->phase == SYSTEM_PHASE_START) {
+        // Mirror the status the manager last set into the health byte
+        system_health_refresh(system);
 
+        if (system->amount_stored == 0) {
+            // Need to convert resources (consume and process), we can always convert without consuming anything
+            request->converting = 1;
+            if (system->consumed.resource != NULL) {
+                request->kind = SYSTEM_REQUEST_CONSUME;
+                request->resource = system->consumed.resource;
+                request->amount = system->consumed.amount;
+            }
+            return;
+        }
+    } else if (system->phase == SYSTEM_PHASE_PROCESSING) {
+        system_health_set(system, STATUS_ACTIVITY, 0);
+        system->conversions++;
         if (system->produced.resource != NULL) {
             system->amount_stored += system->produced.amount;
         }
@@ -142,109 +239,310 @@ static int system_convert(System *system) {
         }
     }
 
-    return status;
+    if (system->amount_stored > 0) {
+        // We can always proceed if there's nothing to store
+        if (system->produced.resource == NULL) {
+            system->amount_stored = 0;
+        } else {
+            request->kind = SYSTEM_REQUEST_STORE;
+            request->resource = system->produced.resource;
+            request->amount = system->amount_stored;
+        }
+    }
+}
+
+/**
+ * Applies a step's resource change.
+ *
+ * Consumes all or nothing, and stores as much as fits, retrying if another system changed the
+ * amount first. Commits on one resource happen in the order they are called, so serializing them
+ * makes the outcome deterministic.
+ *
+ * @param[in,out] request  Pointer to the `SystemRequest`, its outcome is filled in.
+ * @param[in,out] seq      Commit counters for snapshots, may be NULL.
+ */
+void system_request_commit(SystemRequest *request, SnapshotSeq *seq) {
+    Resource *resource = request->resource;
+    int amount = request->amount;
+    int current, stored;
+
+    request->status = STATUS_OK;
+    request->stored = 0;
+
+    if (request->kind == SYSTEM_REQUEST_CONSUME) {
+        TRACE_BEGIN("system_convert");
+        snapshot_commit_begin(seq);
+        current = __atomic_load_n(&resource->amount, __ATOMIC_RELAXED);
+        while (current >= amount &&
+               !__atomic_compare_exchange_n(&resource->amount, &current, current - amount,
+                                            1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        }
+        snapshot_commit_end(seq);
+
+        if (current < amount) {
+            request->status = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+        }
+        TRACE_END("system_convert");
+    } else if (request->kind == SYSTEM_REQUEST_STORE) {
+        TRACE_BEGIN("system_store_resources");
+        snapshot_commit_begin(seq);
+        current = __atomic_load_n(&resource->amount, __ATOMIC_RELAXED);
+        do {
+            // Calculate available space
+            stored = resource->max_capacity - current;
+            stored = stored >= amount ? amount : stored;
+            if (stored <= 0) {
+                stored = 0;
+                break;
+            }
+        } while (!__atomic_compare_exchange_n(&resource->amount, &current, current + stored,
+                                              1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        snapshot_commit_end(seq);
+
+        request->stored = stored;
+        if (stored != amount) {
+            request->status = STATUS_CAPACITY;
+        }
+        TRACE_END("system_store_resources");
+    }
+}
+
+/**
+ * Runs the rest of a step once its request is committed.
+ *
+ * Moves the state machine on and reports what failed, or keeps the event in the request when
+ * `defer_event` is set.
+ *
+ * @param[in,out] system   Pointer to the `System` to advance.
+ * @param[in,out] request  Pointer to the committed `SystemRequest`.
+ * @return                 Microseconds to wait before the next step.
+ */
+long long system_step_complete(System *system, SystemRequest *request) {
+    if (request->converting) {
+        system_health_set(system, STATUS_ERROR, request->status == STATUS_EMPTY || request->status == STATUS_INSUFFICIENT);
+        if (request->status == STATUS_OK) {
+            system_health_set(system, STATUS_ACTIVITY, 1);
+            system_health_refresh(system);
+            // Wait out the processing time, the produced resources are added once it is over
+            system->phase = SYSTEM_PHASE_PROCESSING;
+            return system_process_time_us(system);
+        }
+        system_health_refresh(system);
+
+        // Report that resources were out / insufficient
+        event_init(&request->event, system, system->consumed.resource, request->status, PRIORITY_HIGH, system->consumed.resource->amount);
+        system_step_report(system, request);
+        // Wait to prevent looping too frequently and spamming with events
+        system->phase = SYSTEM_PHASE_STORE;
+        return SYSTEM_WAIT_TIME * 1000;
+    }
+
+    system->phase = SYSTEM_PHASE_START;
+    if (request->kind == SYSTEM_REQUEST_STORE) {
+        system->amount_stored -= request->stored;
+
+        if (request->status != STATUS_OK) {
+            event_init(&request->event, system, system->produced.resource, request->status, PRIORITY_LOW, system->produced.resource->amount);
+            system_step_report(system, request);
+            // Wait to prevent looping too frequently and spamming with events
+            return SYSTEM_WAIT_TIME * 1000;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Thread body that runs a `System` until the manager terminates it.
+ *
+ * @param[in,out] arg  Pointer to the `System` to run.
+ * @return             NULL.
+ */
+void *system_thread(void *arg) {
+    System *system = (System*)arg;
+
+    TRACE_THREAD_NAME(system->name);
+    while (__atomic_load_n(&system->status, __ATOMIC_RELAXED) != TERMINATE &&
+           !__atomic_load_n(&system->retired, __ATOMIC_RELAXED)) {
+        system_run(system);
+    }
+    // A removed system may be reclaimed from here on
+    __atomic_store_n(&system->released, 1, __ATOMIC_RELEASE);
+    return NULL;
 }
 
 /**
- * Simulates the processing time for a `System`.
+ * Works out the processing time for a `System`.
  *
- * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST)
- * and sleeps for the adjusted time to simulate processing.
+ * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST).
  *
  * @param[in] system  Pointer to the `System` whose processing time is being simulated.
+ * @return            Time to wait in microseconds.
  */
-static void system_simulate_process_time(System *system) {
-    int adjusted_processing_time;
+static long long system_process_time_us(System *system) {
+    long long adjusted_processing_time;
 
-    // Adjust based on the current system status modifier
-    switch (system->status) {
+    // Adjust based on the current system status modifier, in microseconds so FAST halves 5 ms to 2.5 ms exactly
+    switch (__atomic_load_n(&system->status, __ATOMIC_RELAXED)) {
         case SLOW:
-            adjusted_processing_time = system->processing_time * 2;
+            adjusted_processing_time = system->processing_time * 2000LL;
             break;
         case FAST:
-            adjusted_processing_time = system->processing_time / 2;
+            adjusted_processing_time = system->processing_time * 500LL;
             break;
         default:
-            adjusted_processing_time = system->processing_time;
+            adjusted_processing_time = system->processing_time * 1000LL;
+    }
+
+    return adjusted_processing_time;
+}
+
+/**
+ * Reports an `Event` to the manager.
+ *
+ * Uses the system's private channel when it has one, otherwise the shared queue.
+ * If the channel is full, high priority events wait for the manager to make room
+ * (unless the system is being terminated) and lower priority events are dropped and counted.
+ *
+ * @param[in,out] system  Pointer to the `System` reporting the event.
+ * @param[in]     event   Pointer to the `Event` to report.
+ */
+static void system_report(System *system, const Event *event) {
+    if (system->channel == NULL) {
+        event_queue_push(system->event_queue, event);
+        return;
     }
 
-    // Sleep for the required time
-    usleep(adjusted_processing_time * 1000);
+    while (event_channel_push(system->channel, event) != STATUS_OK) {
+        if (event->priority < PRIORITY_HIGH || __atomic_load_n(&system->status, __ATOMIC_RELAXED) == TERMINATE) {
+            __atomic_fetch_add(&system->channel->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        sched_yield();
+    }
 }
 
 /**
- * Stores produced resources in a `System`.
+ * Reports the event of a step, or keeps it in the request for the caller to report in order.
  *
- * Attempts to add the produced resources to the corresponding resource's amount,
- * considering the maximum capacity. Updates the `produced_resource_count` to reflect
- * any leftover resources that couldn't be stored.
+ * @param[in,out] system   Pointer to the `System` reporting the event.
+ * @param[in,out] request  Pointer to the `SystemRequest` holding the event.
+ */
+static void system_step_report(System *system, SystemRequest *request) {
+    if (request->defer_event) {
+        request->has_event = 1;
+    } else {
+        system_report(system, &request->event);
+    }
+}
+
+/**
+ * Sets one field of the system's health byte, if the system is tracked.
  *
- * @param[in,out] system                   Pointer to the `System` storing resources.
- * @param[in,out] produced_resource_count  Pointer to the integer value of how many resources need to be stored, updated with the amount that could not be stored.
- * @return                                 `STATUS_OK` if all resources were stored, or `STATUS_CAPACITY` if not all could be stored.
+ * @param[in,out] system  Pointer to the `System` whose health is updated.
+ * @param[in]     field   Status bit of the field (see `subsystem.h`).
+ * @param[in]     value   New value of the field.
  */
-static int system_store_resources(System *system) {
-    Resource *produced_resource = system->produced.resource;
-    int available_space, amount_to_store;
-
-    // We can always proceed if there's nothing to store
-    if (produced_resource == NULL || system->amount_stored == 0) {
-        system->amount_stored = 0;
-        return STATUS_OK;
+static void system_health_set(System *system, unsigned char field, unsigned char value) {
+    SubsystemCollection *health = __atomic_load_n(&system->health, __ATOMIC_ACQUIRE);
+
+    // The index is set before health is published and never moves while the system runs
+    if (health != NULL) {
+        subsys_status_atomic_set(&health->subsystems[system->health_index], field, value);
     }
+}
 
-    amount_to_store = system->amount_stored;
+/**
+ * Refreshes the health fields derived from the system's current state.
+ *
+ * POWER is on unless the system is terminated or disabled, PERFORMANCE mirrors
+ * SLOW / STANDARD / FAST as 1 / 2 / 3, and RESOURCE is the level of the consumed
+ * resource in quarters of its capacity (3 when nothing is consumed).
+ *
+ * @param[in,out] system  Pointer to the `System` whose health is updated.
+ */
+static void system_health_refresh(System *system) {
+    Resource *consumed = system->consumed.resource;
+    int performance, level;
 
-    // Calculate available space
-    available_space = produced_resource->max_capacity - produced_resource->amount;
+    if (__atomic_load_n(&system->health, __ATOMIC_ACQUIRE) == NULL) {
+        return;
+    }
 
-    if (available_space >= amount_to_store) {
-        // Store all produced resources
-        produced_resource->amount += amount_to_store;
-        system->amount_stored = 0;
-    } else if (available_space > 0) {
-        // Store as much as possible
-        produced_resource->amount += available_space;
-        system->amount_stored = amount_to_store - available_space;
+    switch (system->status) {
+        case SLOW:
+            performance = 1;
+            break;
+        case STANDARD:
+            performance = 2;
+            break;
+        case FAST:
+            performance = 3;
+            break;
+        default:
+            performance = 0;
     }
 
-    if (system->amount_stored != 0) {
-        return STATUS_CAPACITY;
+    if (consumed == NULL || consumed->max_capacity <= 0) {
+        level = 3;
+    } else {
+        level = consumed->amount * 4 / consumed->max_capacity;
+        level = level > 3 ? 3 : (level < 0 ? 0 : level);
     }
 
-    return STATUS_OK;
+    system_health_set(system, STATUS_POWER, performance != 0);
+    system_health_set(system, STATUS_PERFORMANCE, performance);
+    system_health_set(system, STATUS_RESOURCE, level);
 }
 
-
 /**
  * Initializes the `SystemArray`.
  *
- * Allocates memory for the array of `System*` pointers of capacity 1 and sets up initial values.
+ * Allocates a first version of capacity 1 and sets up initial values.
  *
  * @param[out] array  Pointer to the `SystemArray` to initialize.
  */
 void system_array_init(SystemArray *array) {
-  array->systems = (System**)malloc(sizeof(System*));
-  if (array->systems == NULL) {
-      return;
-  }
+  array->systems = NULL;
   array->size = 0;
-  array->capacity = 1;
+  array->capacity = 0;
+  array->arena = NULL;
+  array->version = NULL;
+  array->rcu = NULL;
+  array->changes = 0;
+  system_array_publish(array, system_array_copy(NULL, 1));
+}
+
+/**
+ * Initializes a `SystemArray` whose systems belong to an `Arena`.
+ *
+ * Only systems created with `system_arena_create` on the same arena may be added.
+ * The storage itself is malloc'd, so replaced versions can be reclaimed.
+ *
+ * @param[out]    array  Pointer to the `SystemArray` to initialize.
+ * @param[in,out] arena  Arena that owns the systems.
+ */
+void system_array_init_arena(SystemArray *array, Arena *arena) {
+  system_array_init(array);
+  array->arena = arena;
 }
 
 /**
  * Cleans up the `SystemArray` by destroying all systems and freeing memory.
  *
  * Iterates through the array, cleaning any memory for each System pointed to by the array.
+ * Arena-owned systems are left to the arena. No reader may still be running.
  *
  * @param[in,out] array  Pointer to the `SystemArray` to clean.
  */
 void system_array_clean(SystemArray *array) {
   if (array != NULL) {
-    for (int i = 0; i < array->size; i++) {
-        system_destroy(array->systems[i]);
+    if (array->arena == NULL) {
+        for (int i = 0; i < array->size; i++) {
+            system_destroy(array->systems[i]);
+        }
     }
-    free(array->systems);
+    free(array->version);
+    array->version = NULL;
     array->systems = NULL;
     array->size = 0;
     array->capacity = 0;
@@ -254,29 +552,152 @@ void system_array_clean(SystemArray *array) {
 /**
  * Adds a `System` to the `SystemArray`, resizing if necessary (doubling the size).
  *
- * Resizes the array when the capacity is reached and adds the new `System`.
+ * The system is written into spare capacity before the larger size is published, so readers
+ * of the current version never see a half-added entry. When the capacity is reached a copy
+ * twice the size is published instead and the old version is retired.
  * Use of realloc is NOT permitted.
+ * While readers run, the caller must hold the array's `rcu_lock`.
  *
  * @param[in,out] array   Pointer to the `SystemArray`.
  * @param[in]     system  Pointer to the `System` to add.
  */
 void system_array_add(SystemArray *array, System *system) {
-  if (array->size >= array->capacity) {
-    int new_capacity = array->capacity * 2;
-    System **new_array = (System**)malloc(sizeof(System*) * new_capacity);
-    if (new_array == NULL) {
+  ArrayVersion *version = array->version;
+
+  if (version == NULL || version->size >= version->capacity) {
+    version = system_array_copy(version, version != NULL ? version->capacity * 2 : 1);
+    if (version == NULL) {
         return;
     }
-    
-    for (int i = 0; i < array->size; i++) {
-        new_array[i] = array->systems[i];
-    }
-    
-    free(array->systems);
-    array->systems = new_array;
-    array->capacity = new_capacity;
+    system_array_publish(array, version);
+  }
+
+  array->systems[version->size] = system;
+  __atomic_store_n(&version->size, version->size + 1, __ATOMIC_RELEASE);
+  array->size = version->size;
+  __atomic_fetch_add(&array->changes, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Removes systems from the `SystemArray` and retires them.
+ *
+ * The systems are marked retired and a single copy without them is published, so readers still
+ * iterating the old version are unaffected and removing a batch costs O(systems) once. Each
+ * executor drops its system at its next pass, and the system is reclaimed once that has happened
+ * and every reader has moved on.
+ * While readers run, the caller must hold the array's `rcu_lock`.
+ *
+ * @param[in,out] array    Pointer to the `SystemArray`.
+ * @param[in]     systems  Systems to remove, which must be in the array.
+ * @param[in]     count    Number of systems.
+ * @return                 Number of systems removed, 0 if the memory for the copy ran out.
+ */
+int system_array_remove(SystemArray *array, System **systems, int count) {
+  ArrayVersion *old = array->version;
+  System **old_entries = array->systems;
+  ArrayVersion *version;
+  int removed;
+
+  for (int i = 0; i < count; i++) {
+      __atomic_store_n(&systems[i]->retired, 1, __ATOMIC_RELAXED);
+  }
+
+  // Retired systems were already removed, so the ones left out are exactly the batch
+  version = system_array_copy(old, array->capacity);
+  if (version == NULL) {
+      for (int i = 0; i < count; i++) {
+          __atomic_store_n(&systems[i]->retired, 0, __ATOMIC_RELAXED);
+      }
+      return 0;
+  }
+  removed = old->size - version->size;
+
+  __atomic_store_n(&array->version, version, __ATOMIC_RELEASE);
+  array->systems = (System**)(version + 1);
+  array->size = version->size;
+  __atomic_fetch_add(&array->changes, 1, __ATOMIC_RELEASE);
+
+  // Only retired once unpublished, their grace periods must start after readers can no longer find them
+  for (int i = 0; i < old->size; i++) {
+      if (old_entries[i]->retired) {
+          rcu_retire(array->rcu, RCU_RETIRED_SYSTEM, old_entries[i], array->arena == NULL);
+      }
+  }
+  rcu_retire(array->rcu, RCU_RETIRED_VERSION, old, 1);
+  return removed;
+}
+
+/**
+ * Gets the systems of the published version without locking.
+ *
+ * The entries stay valid until the calling reader's next `rcu_quiescent`, even if writers
+ * publish new versions in the meantime.
+ *
+ * @param[in]  array  Pointer to the `SystemArray`.
+ * @param[out] size   Number of entries.
+ * @return            The entries, NULL when there are none.
+ */
+System **system_array_read(SystemArray *array, int *size) {
+  ArrayVersion *version = __atomic_load_n(&array->version, __ATOMIC_ACQUIRE);
+
+  if (version == NULL) {
+      *size = 0;
+      return NULL;
+  }
+  *size = __atomic_load_n(&version->size, __ATOMIC_ACQUIRE);
+  return (System**)(version + 1);
+}
+
+/**
+ * Allocates a version holding the entries of another.
+ *
+ * Retired systems are left out, so a copy after marking systems retired removes them.
+ *
+ * @param[in] from      Version to copy, NULL for an empty one.
+ * @param[in] capacity  Entries the new version can hold.
+ * @return              The new version, NULL if the memory could not be allocated.
+ */
+static ArrayVersion *system_array_copy(const ArrayVersion *from, int capacity) {
+  ArrayVersion *version = malloc(sizeof(ArrayVersion) + sizeof(System*) * capacity);
+  System **entries;
+
+  if (version == NULL) {
+      return NULL;
   }
+  entries = (System**)(version + 1);
+  version->size = 0;
+  version->capacity = capacity;
 
-  array->systems[array->size] = system;
-  array->size++;
+  if (from != NULL) {
+      System * const *old = (System * const *)(from + 1);
+      for (int i = 0; i < from->size; i++) {
+          if (!old[i]->retired) {
+              entries[version->size++] = old[i];
+          }
+      }
+  }
+  return version;
+}
+
+/**
+ * Makes a version the one readers see and retires the one it replaces.
+ *
+ * @param[in,out] array    Pointer to the `SystemArray`.
+ * @param[in]     version  Version to publish, ignored if NULL.
+ */
+static void system_array_publish(SystemArray *array, ArrayVersion *version) {
+  ArrayVersion *old = array->version;
+
+  if (version == NULL) {
+      return;
+  }
+
+  // Entries are written before the pointer, readers load it with acquire
+  __atomic_store_n(&array->version, version, __ATOMIC_RELEASE);
+  array->systems = (System**)(version + 1);
+  array->size = version->size;
+  array->capacity = version->capacity;
+  if (old != NULL) {
+      rcu_retire(array->rcu, RCU_RETIRED_VERSION, old, 1);
+  }
 }
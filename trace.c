@@ -0,0 +1,180 @@
+#include "defs.h"
+
+// Everything below is only built with `make TRACE=1`, otherwise the TRACE_* macros expand to nothing
+#ifdef ENABLE_TRACE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_CHUNK_EVENTS 4096     // Spans ends recorded per allocation
+
+// A begin or end of a span
+typedef struct TraceEvent {
+    const char *name;   // String literal, never freed
+    long long ts_ns;
+    char phase;         // 'B' or 'E'
+} TraceEvent;
+
+// Fixed block of trace events, chained when a thread records more than one block
+typedef struct TraceChunk {
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    int size;
+    struct TraceChunk *next;
+} TraceChunk;
+
+// Everything one thread recorded, only that thread writes to it until the trace is written
+typedef struct TraceBuffer {
+    int tid;
+    char name[MAX_STR];
+    TraceChunk *first;
+    TraceChunk *last;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static __thread TraceBuffer *trace_local = NULL;
+static TraceBuffer *trace_buffers = NULL;
+static int trace_thread_count = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static TraceBuffer *trace_buffer(void);
+static void trace_record(const char *name, char phase);
+
+/**
+ * Begins a span on the calling thread.
+ *
+ * @param[in] name  Span name, must be a string literal.
+ */
+void trace_begin(const char *name) {
+    trace_record(name, 'B');
+}
+
+/**
+ * Ends the innermost open span on the calling thread.
+ *
+ * @param[in] name  Span name, must match the `trace_begin`.
+ */
+void trace_end(const char *name) {
+    trace_record(name, 'E');
+}
+
+/**
+ * Names the calling thread's lane in the trace viewer.
+ *
+ * @param[in] name  Lane name (copied).
+ */
+void trace_thread_name(const char *name) {
+    TraceBuffer *buffer = trace_buffer();
+
+    if (buffer != NULL) {
+        strncpy(buffer->name, name, MAX_STR - 1);
+        buffer->name[MAX_STR - 1] = '\0';
+    }
+}
+
+/**
+ * Writes every recorded span as Chrome trace-event JSON and frees the buffers.
+ *
+ * Must only be called once all traced threads have been joined.
+ *
+ * @param[in] path  Path of the JSON file.
+ * @return          0 on success, -1 on failure.
+ */
+int trace_write(const char *path) {
+    FILE *file = fopen(path, "w");
+    TraceBuffer *buffer, *next_buffer;
+    TraceChunk *chunk, *next_chunk;
+    int first = 1;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (buffer = trace_buffers; buffer != NULL; buffer = next_buffer) {
+        // One lane per thread, labelled with the thread's name
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->name);
+        first = 0;
+
+        for (chunk = buffer->first; chunk != NULL; chunk = next_chunk) {
+            for (int i = 0; i < chunk->size; i++) {
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+                        chunk->events[i].name, chunk->events[i].phase, buffer->tid, chunk->events[i].ts_ns / 1000.0);
+            }
+            next_chunk = chunk->next;
+            free(chunk);
+        }
+
+        next_buffer = buffer->next;
+        free(buffer);
+    }
+    fprintf(file, "\n]}\n");
+
+    trace_buffers = NULL;
+    trace_local = NULL;
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/**
+ * Gives the calling thread its buffer, registering it on first use.
+ *
+ * @return  The thread's `TraceBuffer`, or NULL if it could not be allocated.
+ */
+static TraceBuffer *trace_buffer(void) {
+    if (trace_local != NULL) {
+        return trace_local;
+    }
+
+    trace_local = calloc(1, sizeof(TraceBuffer));
+    if (trace_local == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    trace_local->tid = ++trace_thread_count;
+    trace_local->next = trace_buffers;
+    trace_buffers = trace_local;
+    pthread_mutex_unlock(&trace_mutex);
+
+    snprintf(trace_local->name, MAX_STR, "Thread %d", trace_local->tid);
+    return trace_local;
+}
+
+/**
+ * Appends a span begin or end to the calling thread's buffer.
+ *
+ * @param[in] name   Span name.
+ * @param[in] phase  'B' or 'E'.
+ */
+static void trace_record(const char *name, char phase) {
+    TraceBuffer *buffer = trace_buffer();
+    TraceChunk *chunk;
+
+    if (buffer == NULL) {
+        return;
+    }
+
+    chunk = buffer->last;
+    if (chunk == NULL || chunk->size == TRACE_CHUNK_EVENTS) {
+        chunk = malloc(sizeof(TraceChunk));
+        if (chunk == NULL) {
+            return;
+        }
+        chunk->size = 0;
+        chunk->next = NULL;
+        if (buffer->last == NULL) {
+            buffer->first = chunk;
+        } else {
+            buffer->last->next = chunk;
+        }
+        buffer->last = chunk;
+    }
+
+    chunk->events[chunk->size].name = name;
+    chunk->events[chunk->size].ts_ns = latency_now_ns();
+    chunk->events[chunk->size].phase = phase;
+    chunk->size++;
+}
+
+#endif